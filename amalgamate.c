@@ -0,0 +1,454 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "amalgamate.h"
+#include "build.h"
+#include "config.h"
+#include "dependency.h"
+#include "util.h"
+
+#define BINDIR         "bin"
+#define AMALGAMATE_DIR ".flotsam/amalgamate"
+#define OBJ_DIR        AMALGAMATE_DIR "/obj"
+#define PROJECT_ORIGIN "project"
+#define SRC_DIR        "src"
+#define RENAME_SUFFIX  "__flotsam"
+#define C_EXT          ".c"
+
+/**
+ * symbol is a symbol defined by one of the sources.
+ * Static symbols coming from headers are left out since
+ * include guards make them appear once in the
+ * amalgamation anyway.
+ */
+struct symbol
+{
+    char *name;
+    int source;
+    int global;
+};
+
+/**
+ * source is a C file going into the amalgamation along
+ * with the project or dependency it belongs to.
+ */
+struct source
+{
+    char *path;
+    const char *origin;
+    int has_main;
+    int skip;
+};
+
+/**
+ * amalgamation holds the sources and the symbols they
+ * define.
+ */
+struct amalgamation
+{
+    struct source *sources;
+    int source_count;
+    struct symbol *symbols;
+    int symbol_count;
+};
+
+/**
+ * cmp_str compares 2 strings for qsort.
+ */
+static int
+cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * add_sources adds the C files at the top of dir to the
+ * amalgamation in name order.
+ */
+static int
+add_sources(struct amalgamation *a, const char *dir, const char *origin)
+{
+    DIR *dp = opendir(dir);
+    if (dp == NULL) {
+        perror(dir);
+        return -1;
+    }
+
+    char **names = NULL;
+    int count = 0;
+    struct dirent *dirp;
+    while ((dirp = readdir(dp)) != NULL) {
+        size_t len = strlen(dirp->d_name);
+        if (len <= strlen(C_EXT) || strcmp(dirp->d_name + len - strlen(C_EXT), C_EXT) != 0) {
+            continue;
+        }
+        char **n = realloc(names, (count + 1) * sizeof(char*));
+        if (n == NULL) {
+            break;
+        }
+        names = n;
+        names[count++] = strdup(dirp->d_name);
+    }
+    closedir(dp);
+
+    if (count == 0) {
+        fprintf(stderr, "error: %s has no C sources in %s\n", origin, dir);
+        free(names);
+        return -1;
+    }
+    qsort(names, count, sizeof(char*), cmp_str);
+
+    struct source *s = realloc(a->sources, (a->source_count + count) * sizeof(struct source));
+    if (s == NULL) {
+        perror("unable to allocate memory for sources");
+        for (int i = 0; i < count; i++) {
+            free(names[i]);
+        }
+        free(names);
+        return -1;
+    }
+    a->sources = s;
+
+    for (int i = 0; i < count; i++) {
+        struct strbuf path = { 0 };
+        strbuf_appendf(&path, "%s/%s", dir, names[i]);
+        a->sources[a->source_count++] = (struct source){ .path = path.buf, .origin = origin };
+        free(names[i]);
+    }
+    free(names);
+
+    return 0;
+}
+
+/**
+ * add_symbol records a symbol defined by the source.
+ */
+static int
+add_symbol(struct amalgamation *a, const char *name, int source, int global)
+{
+    struct symbol *s = realloc(a->symbols, (a->symbol_count + 1) * sizeof(struct symbol));
+    if (s == NULL) {
+        perror("unable to allocate memory for symbols");
+        return -1;
+    }
+    a->symbols = s;
+    a->symbols[a->symbol_count++] = (struct symbol){ strdup(name), source, global };
+
+    return 0;
+}
+
+/**
+ * scan_symbols compiles the source on its own with debug
+ * info and reads the symbols it defines with nm, whose
+ * -l option tells statics defined by the source apart
+ * from those its headers define. Optimization is turned
+ * off after the profile's flags so statics that would be
+ * inlined or dropped still reach the object.
+ */
+static int
+scan_symbols(struct amalgamation *a, int source, const char *cc, const char *cflags)
+{
+    struct source *src = &a->sources[source];
+    struct strbuf obj = { 0 };
+    struct strbuf cmd = { 0 };
+    int res = 0;
+
+    strbuf_appendf(&obj, "%s/%d.o", OBJ_DIR, source);
+    strbuf_appendf(&cmd, "%s %s -O0 -fno-inline -g -c '%s' -o %s", cc, cflags, src->path, obj.buf);
+    if (system(cmd.buf) != 0) {
+        fprintf(stderr, "error: %s doesn't compile on its own\n", src->path);
+        strbuf_free(&obj);
+        strbuf_free(&cmd);
+        return -1;
+    }
+
+    strbuf_free(&cmd);
+    strbuf_appendf(&cmd, "nm -l --defined-only %s 2>/dev/null", obj.buf);
+    FILE *fp = popen(cmd.buf, "r");
+    strbuf_free(&cmd);
+    if (fp == NULL) {
+        perror("popen");
+        strbuf_free(&obj);
+        return -1;
+    }
+
+    char line[PATH_MAX * 2];
+    while (res == 0 && fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+
+        // <value> <type> <name>[\t<file>:<line>]
+        char *type = strchr(line, ' ');
+        if (type == NULL || type[1] == '\0' || type[2] != ' ') {
+            continue;
+        }
+        char *name = type + 3;
+        char *loc = strchr(name, '\t');
+        if (loc != NULL) {
+            *loc++ = '\0';
+            char *colon = strrchr(loc, ':');
+            if (colon != NULL) {
+                *colon = '\0';
+            }
+        }
+
+        // function local statics get a numbered suffix and
+        // can't clash
+        if (strchr(name, '.') != NULL || strchr("tdbrgsTDBRGSWV", type[1]) == NULL) {
+            continue;
+        }
+
+        int global = type[1] >= 'A' && type[1] <= 'Z';
+        if (global && strcmp(name, "main") == 0) {
+            src->has_main = 1;
+            continue;
+        }
+        if (!global && loc != NULL && strcmp(loc, src->path) != 0) {
+            continue;
+        }
+        res = add_symbol(a, name, source, global);
+    }
+    pclose(fp);
+    strbuf_free(&obj);
+
+    return res;
+}
+
+/**
+ * clashes returns 1 if the symbol is defined by another
+ * source that's part of the amalgamation.
+ */
+static int
+clashes(const struct amalgamation *a, const struct symbol *sym)
+{
+    for (int i = 0; i < a->symbol_count; i++) {
+        const struct symbol *other = &a->symbols[i];
+        if (other->source != sym->source && !a->sources[other->source].skip &&
+            strcmp(other->name, sym->name) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * write_amalgamation writes the translation unit
+ * including every source, wrapping sources whose
+ * statics clash with another source's symbols in
+ * defines renaming them. It returns -1 if 2 sources
+ * define the same global symbol.
+ */
+static int
+write_amalgamation(const struct amalgamation *a)
+{
+    struct strbuf sb = { 0 };
+    int res = 0;
+
+    for (int i = 0; i < a->symbol_count; i++) {
+        const struct symbol *sym = &a->symbols[i];
+        if (a->sources[sym->source].skip || !sym->global || !clashes(a, sym)) {
+            continue;
+        }
+        // only the first of each pair reports it
+        for (int j = 0; j < i; j++) {
+            if (a->symbols[j].global && strcmp(a->symbols[j].name, sym->name) == 0 &&
+                !a->sources[a->symbols[j].source].skip) {
+                fprintf(stderr, "error: %s is defined by both %s and %s\n", sym->name,
+                        a->sources[a->symbols[j].source].path, a->sources[sym->source].path);
+                res = -1;
+            }
+        }
+    }
+    if (res != 0) {
+        return res;
+    }
+
+    strbuf_append(&sb, "/* Generated by flotsam. Do not edit. */\n");
+    for (int i = 0; i < a->source_count; i++) {
+        const struct source *src = &a->sources[i];
+        if (src->skip) {
+            continue;
+        }
+
+        strbuf_appendf(&sb, "\n/* %s */\n", src->origin);
+        for (int j = 0; j < a->symbol_count; j++) {
+            const struct symbol *sym = &a->symbols[j];
+            if (sym->source == i && !sym->global && clashes(a, sym)) {
+                strbuf_appendf(&sb, "#define %s %s" RENAME_SUFFIX "%d\n", sym->name, sym->name, i);
+                printf("renamed static %s in %s\n", sym->name, src->path);
+            }
+        }
+        strbuf_appendf(&sb, "#include \"%s\"\n", src->path);
+        for (int j = 0; j < a->symbol_count; j++) {
+            const struct symbol *sym = &a->symbols[j];
+            if (sym->source == i && !sym->global && clashes(a, sym)) {
+                strbuf_appendf(&sb, "#undef %s\n", sym->name);
+            }
+        }
+    }
+
+    res = write_file_if_changed(AMALGAMATION, sb.buf);
+    strbuf_free(&sb);
+
+    return res;
+}
+
+/**
+ * amalgamation_free frees the sources and symbols.
+ */
+static void
+amalgamation_free(struct amalgamation *a)
+{
+    for (int i = 0; i < a->source_count; i++) {
+        free(a->sources[i].path);
+    }
+    for (int i = 0; i < a->symbol_count; i++) {
+        free(a->symbols[i].name);
+    }
+    free(a->sources);
+    free(a->symbols);
+}
+
+/**
+ * collect_sources adds the project's sources and those
+ * of the amalgamated dependencies, which need to be
+ * checked out already.
+ */
+static int
+collect_sources(struct amalgamation *a)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+
+    // dependencies come first so the project's sources see
+    // them the way they would through their headers
+    struct dependencies *deps = config_get_dependencies();
+    for (int i = 0; i < deps->count; i++) {
+        struct dependency *dep = &deps->dependencies[i];
+        if (!config_dependency_amalgamate(dep)) {
+            continue;
+        }
+
+        char *path = dependency_path(dep->name, dep->vers);
+        struct stat s;
+        int res = 0;
+        if (stat(path, &s) != 0) {
+            fprintf(stderr, "error: %s@%s isn't checked out, run update\n", dep->name, dep->vers);
+            res = -1;
+        } else {
+            res = add_sources(a, path, dep->name);
+        }
+        free(path);
+        if (res != 0) {
+            return -1;
+        }
+    }
+
+    // generated projects keep their sources in src
+    struct strbuf src = { 0 };
+    struct stat s;
+    strbuf_appendf(&src, "%s/%s", cwd, SRC_DIR);
+    int res = add_sources(a, stat(src.buf, &s) == 0 ? src.buf : cwd, PROJECT_ORIGIN);
+    strbuf_free(&src);
+
+    return res;
+}
+
+int
+amalgamate_build(const struct profile *profile)
+{
+    if (config_get_type() == NULL || strcmp(config_get_type(), "bin") != 0) {
+        fprintf(stderr, "error: only binaries can be amalgamated\n");
+        return 1;
+    }
+    if (mkdir_p(OBJ_DIR, 0700) != 0) {
+        perror(OBJ_DIR);
+        return 1;
+    }
+
+    char *cc = NULL, *cflags = NULL, *ldflags = NULL;
+    if (build_make_vars(profile, &cc, &cflags, &ldflags) != 0) {
+        return 1;
+    }
+
+    struct amalgamation a = { 0 };
+    int res = collect_sources(&a);
+
+    for (int i = 0; res == 0 && i < a.source_count; i++) {
+        res = scan_symbols(&a, i, cc, cflags);
+    }
+
+    // test programs and examples shipped with dependencies
+    // have their own main
+    for (int i = 0; res == 0 && i < a.source_count; i++) {
+        struct source *src = &a.sources[i];
+        if (src->has_main && strcmp(src->origin, PROJECT_ORIGIN) != 0) {
+            printf("skipping %s, it defines main\n", src->path);
+            src->skip = 1;
+        }
+    }
+
+    if (res == 0) {
+        res = write_amalgamation(&a);
+    }
+
+    if (res == 0) {
+        char *output = build_output();
+        struct strbuf cmd = { 0 };
+
+        mkdir_p(BINDIR, 0755);
+        strbuf_appendf(&cmd, "%s %s %s -o %s %s", cc, cflags, AMALGAMATION, output, ldflags);
+        printf("%s\n", cmd.buf);
+        res = system(cmd.buf) == 0 ? 0 : -1;
+
+        strbuf_free(&cmd);
+        free(output);
+    }
+
+    amalgamation_free(&a);
+    free(cc);
+    free(cflags);
+    free(ldflags);
+
+    return res == 0 ? 0 : 1;
+}
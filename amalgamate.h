@@ -0,0 +1,52 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _AMALGAMATE_H
+#define _AMALGAMATE_H
+
+#include "config.h"
+
+/**
+ * AMALGAMATION is the generated translation unit including the sources of
+ * the project and its amalgamated dependencies.
+ */
+#define AMALGAMATION ".flotsam/amalgamate/amalgamation.c"
+
+/**
+ * amalgamate_build compiles the project's sources and those of every
+ * dependency selected by config_dependency_amalgamate into the project's
+ * binary as a single translation unit, giving the compiler the whole program
+ * without LTO. Each source is first compiled on its own to find file scope
+ * static symbols defined in more than one source, which are renamed in the
+ * amalgamation. Clashing global symbols are reported. The compiler and flags
+ * come from the project's Makefile and the remaining dependencies are linked
+ * as usual.
+ */
+int
+amalgamate_build(const struct profile *profile);
+
+#endif /* _AMALGAMATE_H */
@@ -0,0 +1,1446 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include <git2.h>
+#include <jansson.h>
+
+#include "bench.h"
+#include "build.h"
+#include "config.h"
+#include "dependency.h"
+#include "lock.h"
+#include "stats.h"
+#include "util.h"
+
+#define SHELL           "/bin/sh"
+#define CONFIG_FILE     "Flotsam.json"
+#define ISOLATED_CPUS   "/sys/devices/system/cpu/isolated"
+#define HARNESS_RESULTS BENCH_RESULTS_DIR "/harness.json"
+#define COMPARE_DIR     BENCH_RESULTS_DIR "/compare"
+#define DEP_DIR         BENCH_RESULTS_DIR "/dep"
+
+#ifdef __APPLE__
+#define PRELOAD_ENV "DYLD_INSERT_LIBRARIES"
+#define SHLIB_EXT   ".dylib"
+#else
+#define PRELOAD_ENV "LD_PRELOAD"
+#define SHLIB_EXT   ".so"
+#endif
+
+// collect_counters is set by --counters for the run.
+static int collect_counters;
+
+/**
+ * bench_result holds the samples of a single
+ * benchmark and those of its performance counters,
+ * if they were collected.
+ */
+struct bench_result
+{
+    char *name;
+    double *samples;
+    int n;
+    struct bench_results *counters;
+};
+
+/**
+ * bench_results is the set of benchmarks of one run,
+ * all measured in the same unit.
+ */
+struct bench_results
+{
+    char *unit;
+    int count;
+    struct bench_result *items;
+};
+
+/**
+ * run_in runs the shell command from the given directory
+ * with the library preloaded, if given, and stores its
+ * wall time in ns.
+ */
+static int
+run_in(const char *dir, const char *cmd, const char *preload, uint64_t *ns)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+    if (chdir(dir) != 0) {
+        perror(dir);
+        return -1;
+    }
+
+    char *prev = getenv(PRELOAD_ENV) != NULL ? strdup(getenv(PRELOAD_ENV)) : NULL;
+    if (preload != NULL) {
+        setenv(PRELOAD_ENV, preload, 1);
+    }
+
+    char *const argv[] = { SHELL, "-c", (char *)cmd, NULL };
+    int res = run_timed(argv, ns);
+
+    if (preload != NULL) {
+        if (prev != NULL) {
+            setenv(PRELOAD_ENV, prev, 1);
+        } else {
+            unsetenv(PRELOAD_ENV);
+        }
+    }
+    free(prev);
+
+    if (chdir(cwd) != 0) {
+        perror(cwd);
+        return -1;
+    }
+
+    return res;
+}
+
+int
+bench_commands(struct bench_cmd *cmds, int count, int warmup, int runs, double **samples)
+{
+    for (int round = 0; round < warmup + runs; round++) {
+        for (int k = 0; k < count; k++) {
+            int i = (round + k) % count;
+            if (cmds[i].failed) {
+                continue;
+            }
+
+            uint64_t ns = 0;
+            if (run_in(cmds[i].dir, cmds[i].cmd, cmds[i].preload, &ns) != 0) {
+                fprintf(stderr, "error: benchmark failed in %s: %s\n", cmds[i].dir, cmds[i].cmd);
+                cmds[i].failed = 1;
+                continue;
+            }
+            if (round >= warmup) {
+                samples[i][round - warmup] = (double)ns / 1e6;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!cmds[i].failed) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+void
+bench_set_counters(int counters)
+{
+    collect_counters = counters;
+}
+
+int
+bench_load_config(struct bench_config *bc)
+{
+    memset(bc, 0, sizeof(struct bench_config));
+    bc->runs = BENCH_DEFAULT_RUNS;
+    bc->warmup = BENCH_DEFAULT_WARMUP;
+    bc->threshold = BENCH_DEFAULT_THRESHOLD;
+    bc->counters = collect_counters;
+
+    json_error_t error;
+    json_t *root = json_load_file(CONFIG_FILE, 0, &error);
+    if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", CONFIG_FILE, error.line, error.text);
+        return -1;
+    }
+
+    json_t *bench = json_object_get(root, "bench");
+    const char *command = json_string_value(json_object_get(bench, "command"));
+    json_t *runs = json_object_get(bench, "runs");
+    json_t *warmup = json_object_get(bench, "warmup");
+    json_t *threshold = json_object_get(bench, "threshold");
+    json_t *counters = json_object_get(bench, "counters");
+
+    if (command != NULL) {
+        bc->command = strdup(command);
+    }
+    if (json_is_integer(runs) && json_integer_value(runs) > 0) {
+        bc->runs = (int)json_integer_value(runs);
+    }
+    if (json_is_integer(warmup) && json_integer_value(warmup) >= 0) {
+        bc->warmup = (int)json_integer_value(warmup);
+    }
+    if (json_is_number(threshold) && json_number_value(threshold) >= 0) {
+        bc->threshold = json_number_value(threshold);
+    }
+    if (json_is_true(counters)) {
+        bc->counters = 1;
+    }
+    json_decref(root);
+
+    // counters are read by the harness around each sample,
+    // there's nothing to read them around in a command
+    if (bc->command != NULL && bc->counters) {
+        fprintf(stderr, "warning: counters are only collected for the micro-benchmarks in %s\n",
+                BENCH_DIR);
+        bc->counters = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * print_header prints the column names of a result
+ * table in the given unit.
+ */
+static void
+print_header(const char *first, const char *unit)
+{
+    char median[32], mad[32], ci[32];
+    snprintf(median, sizeof(median), "median (%s)", unit);
+    snprintf(mad, sizeof(mad), "MAD (%s)", unit);
+    snprintf(ci, sizeof(ci), "95%% CI (%s)", unit);
+
+    printf("%-16s %12s %10s %21s %9s %8s\n", first, median, mad, ci, "speedup", "p");
+}
+
+/**
+ * print_row prints the results of one benchmark compared
+ * to the baseline samples, if any.
+ */
+static void
+print_row(const char *name, const double *samples, int runs, const double *base, int base_runs)
+{
+    struct stats s, b;
+    stats_compute(samples, runs, &s);
+
+    printf("%-16s %12.3f %10.3f %10.3f-%-10.3f", name, s.median, s.mad, s.ci_low, s.ci_high);
+    if (base == NULL || base == samples) {
+        printf(" %9s %8s\n", "-", "-");
+        return;
+    }
+
+    stats_compute(base, base_runs, &b);
+    double p = stats_mann_whitney(samples, runs, base, base_runs);
+    printf(" %8.3fx %8.4f%s\n", b.median / s.median, p, p < STATS_ALPHA ? " *" : "");
+}
+
+/**
+ * results_add appends a copy of the samples of the named
+ * benchmark.
+ */
+static int
+results_add(struct bench_results *rs, const char *name, const double *samples, int n)
+{
+    struct bench_result *items = realloc(rs->items, (rs->count + 1) * sizeof(struct bench_result));
+    if (items == NULL) {
+        perror("unable to allocate memory for results");
+        return -1;
+    }
+    rs->items = items;
+
+    struct bench_result *r = &rs->items[rs->count];
+    r->name = strdup(name);
+    r->samples = malloc(n * sizeof(double));
+    if (r->name == NULL || r->samples == NULL) {
+        perror("unable to allocate memory for results");
+        free(r->name);
+        free(r->samples);
+        return -1;
+    }
+    memcpy(r->samples, samples, n * sizeof(double));
+    r->n = n;
+    r->counters = NULL;
+    rs->count++;
+
+    return 0;
+}
+
+/**
+ * results_free frees the results and their samples.
+ */
+static void
+results_free(struct bench_results *rs)
+{
+    for (int i = 0; i < rs->count; i++) {
+        free(rs->items[i].name);
+        free(rs->items[i].samples);
+        if (rs->items[i].counters != NULL) {
+            results_free(rs->items[i].counters);
+            free(rs->items[i].counters);
+        }
+    }
+    free(rs->items);
+    free(rs->unit);
+    memset(rs, 0, sizeof(struct bench_results));
+}
+
+/**
+ * results_find returns the results of the named benchmark
+ * or NULL if there are none.
+ */
+static const struct bench_result*
+results_find(const struct bench_results *rs, const char *name)
+{
+    for (int i = 0; i < rs->count; i++) {
+        if (strcmp(rs->items[i].name, name) == 0) {
+            return &rs->items[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * results_merge appends the samples of every benchmark
+ * and its counters in src to the same benchmark in dst,
+ * adding the ones dst doesn't have yet.
+ */
+static int
+results_merge(struct bench_results *dst, const struct bench_results *src)
+{
+    if (dst->unit == NULL && src->unit != NULL) {
+        dst->unit = strdup(src->unit);
+    }
+
+    for (int i = 0; i < src->count; i++) {
+        const struct bench_result *r = &src->items[i];
+        struct bench_result *d = NULL;
+        for (int j = 0; j < dst->count; j++) {
+            if (strcmp(dst->items[j].name, r->name) == 0) {
+                d = &dst->items[j];
+                break;
+            }
+        }
+        if (d == NULL) {
+            if (results_add(dst, r->name, r->samples, r->n) != 0) {
+                return -1;
+            }
+            d = &dst->items[dst->count - 1];
+        } else {
+            double *samples = realloc(d->samples, (d->n + r->n) * sizeof(double));
+            if (samples == NULL) {
+                perror("unable to allocate memory for samples");
+                return -1;
+            }
+            memcpy(samples + d->n, r->samples, r->n * sizeof(double));
+            d->samples = samples;
+            d->n += r->n;
+        }
+
+        if (r->counters == NULL) {
+            continue;
+        }
+        if (d->counters == NULL && (d->counters = calloc(1, sizeof(struct bench_results))) == NULL) {
+            perror("unable to allocate memory for counters");
+            return -1;
+        }
+        if (results_merge(d->counters, r->counters) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * results_add_json appends the samples of the named
+ * benchmark from a JSON array.
+ */
+static int
+results_add_json(struct bench_results *rs, const char *name, json_t *arr)
+{
+    int n = (int)json_array_size(arr);
+    double *samples = calloc(n, sizeof(double));
+    if (samples == NULL) {
+        perror("unable to allocate memory for samples");
+        return -1;
+    }
+    for (int j = 0; j < n; j++) {
+        samples[j] = json_number_value(json_array_get(arr, j));
+    }
+    int res = results_add(rs, name, samples, n);
+    free(samples);
+
+    return res;
+}
+
+/**
+ * results_load_counters reads the counters of the last
+ * benchmark in rs, given as arrays of samples by the
+ * harness and as objects holding them in results files.
+ */
+static int
+results_load_counters(struct bench_results *rs, json_t *counters)
+{
+    struct bench_result *r = &rs->items[rs->count - 1];
+    if ((r->counters = calloc(1, sizeof(struct bench_results))) == NULL) {
+        perror("unable to allocate memory for counters");
+        return -1;
+    }
+    r->counters->unit = strdup("op");
+
+    const char *name;
+    json_t *value;
+    json_object_foreach(counters, name, value) {
+        json_t *arr = json_is_array(value) ? value : json_object_get(value, "samples");
+        if (json_array_size(arr) > 0 && results_add_json(r->counters, name, arr) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * results_load reads the results in the given file. The
+ * samples of every benchmark are read from the member
+ * named key, as results files and the harness' output
+ * name them differently.
+ */
+static int
+results_load(const char *path, const char *key, struct bench_results *rs)
+{
+    json_error_t error;
+    json_t *root = json_load_file(path, 0, &error);
+    if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", path, error.line, error.text);
+        return -1;
+    }
+
+    const char *unit = json_string_value(json_object_get(root, "unit"));
+    rs->unit = strdup(unit != NULL ? unit : "ns");
+
+    int res = 0;
+    size_t i;
+    json_t *bench;
+    json_array_foreach(json_object_get(root, "benchmarks"), i, bench) {
+        const char *name = json_string_value(json_object_get(bench, "name"));
+        json_t *arr = json_object_get(bench, key);
+        int n = (int)json_array_size(arr);
+        if (name == NULL || n == 0) {
+            fprintf(stderr, "error: %s: benchmark without a name or samples\n", path);
+            res = -1;
+            break;
+        }
+
+        json_t *counters = json_object_get(bench, "counters");
+        res = results_add_json(rs, name, arr);
+        if (res == 0 && json_is_object(counters)) {
+            res = results_load_counters(rs, counters);
+        }
+        if (res != 0) {
+            break;
+        }
+    }
+    json_decref(root);
+
+    return res;
+}
+
+int
+bench_load_samples(const char *path, const char *name, double **samples, int *n, char **unit)
+{
+    struct bench_results rs = { 0 };
+    if (results_load(path, "samples", &rs) != 0) {
+        results_free(&rs);
+        return -1;
+    }
+
+    const struct bench_result *r = NULL;
+    if (name != NULL) {
+        r = results_find(&rs, name);
+        if (r == NULL) {
+            fprintf(stderr, "error: %s: no benchmark named %s\n", path, name);
+        }
+    } else if (rs.count == 1) {
+        r = &rs.items[0];
+    } else {
+        fprintf(stderr, "error: %s: %d benchmarks, pick one by name\n", path, rs.count);
+    }
+
+    int res = -1;
+    if (r != NULL && (*samples = malloc(r->n * sizeof(double))) != NULL) {
+        memcpy(*samples, r->samples, r->n * sizeof(double));
+        *n = r->n;
+        *unit = strdup(rs.unit);
+        res = 0;
+    }
+    results_free(&rs);
+
+    return res;
+}
+
+/**
+ * result_json returns the statistics and samples of one
+ * benchmark or counter as a JSON object, starting with
+ * the name if one is given.
+ */
+static json_t*
+result_json(const struct bench_result *r, const char *name)
+{
+    struct stats s;
+    stats_compute(r->samples, r->n, &s);
+
+    json_t *samples = json_array();
+    for (int j = 0; j < r->n; j++) {
+        json_array_append_new(samples, json_real(r->samples[j]));
+    }
+
+    json_t *obj = json_object();
+    if (name != NULL) {
+        json_object_set_new(obj, "name", json_string(name));
+    }
+    json_object_set_new(obj, "median", json_real(s.median));
+    json_object_set_new(obj, "mad", json_real(s.mad));
+    json_object_set_new(obj, "ci_low", json_real(s.ci_low));
+    json_object_set_new(obj, "ci_high", json_real(s.ci_high));
+    json_object_set_new(obj, "samples", samples);
+
+    return obj;
+}
+
+/**
+ * results_save writes the results with their statistics
+ * to BENCH_RESULTS_DIR/<name>.json.
+ */
+static int
+results_save(const struct bench_results *rs, const struct profile *profile, const char *name)
+{
+    if (mkdir_p(BENCH_RESULTS_DIR, 0755) != 0) {
+        perror(BENCH_RESULTS_DIR);
+        return -1;
+    }
+
+    json_t *root = json_object();
+    json_t *arr = json_array();
+    json_object_set_new(root, "profile", json_string(profile != NULL ? profile->name : "default"));
+    json_object_set_new(root, "unit", json_string(rs->unit));
+    json_object_set_new(root, "benchmarks", arr);
+
+    for (int i = 0; i < rs->count; i++) {
+        const struct bench_result *r = &rs->items[i];
+        json_t *obj = result_json(r, r->name);
+        if (r->counters != NULL) {
+            json_t *counters = json_object();
+            for (int j = 0; j < r->counters->count; j++) {
+                const struct bench_result *c = &r->counters->items[j];
+                json_object_set_new(counters, c->name, result_json(c, NULL));
+            }
+            json_object_set_new(obj, "counters", counters);
+        }
+        json_array_append_new(arr, obj);
+    }
+
+    struct strbuf path = { 0 };
+    strbuf_appendf(&path, "%s/%s.json", BENCH_RESULTS_DIR, name);
+    int res = json_dump_file(root, path.buf, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    if (res != 0) {
+        fprintf(stderr, "error: unable to write %s\n", path.buf);
+    }
+    strbuf_free(&path);
+    json_decref(root);
+
+    return res;
+}
+
+/**
+ * isolated_cpu returns the first CPU isolated from the
+ * scheduler with isolcpus or -1 if there's none.
+ */
+static int
+isolated_cpu()
+{
+    size_t len;
+    char *cpus = read_file(ISOLATED_CPUS, &len);
+    if (cpus == NULL) {
+        return -1;
+    }
+
+    char *end;
+    long cpu = strtol(cpus, &end, 10);
+    int res = end != cpus ? (int)cpu : -1;
+    free(cpus);
+
+    return res;
+}
+
+/**
+ * has_harness returns 1 if the project has micro-benchmarks
+ * in BENCH_DIR.
+ */
+static int
+has_harness()
+{
+    struct stat s;
+    return stat(BENCH_DIR, &s) == 0 && S_ISDIR(s.st_mode);
+}
+
+/**
+ * run_harness builds and runs the micro-benchmarks in
+ * BENCH_DIR through the project's bench target, taking
+ * the given number of samples of each. With quiet set
+ * make doesn't echo the commands it runs. With counters
+ * set the harness also reads performance counters.
+ */
+static int
+run_harness(const struct profile *profile, int runs, int quiet, int counters,
+            struct bench_results *rs)
+{
+    if (mkdir_p(BENCH_RESULTS_DIR, 0755) != 0) {
+        perror(BENCH_RESULTS_DIR);
+        return -1;
+    }
+    unlink(HARNESS_RESULTS);
+
+    struct strbuf args = { 0 };
+    strbuf_appendf(&args, "%sbench BENCHFLAGS='-q -s %d -j %s%s'", quiet ? "-s " : "", runs,
+                   HARNESS_RESULTS, counters ? " -c" : "");
+
+    int cpu = isolated_cpu();
+    if (cpu >= 0 && system("command -v taskset > /dev/null 2>&1") == 0) {
+        if (!quiet) {
+            printf("pinning benchmarks to isolated CPU %d\n", cpu);
+            fflush(stdout);
+        }
+        strbuf_appendf(&args, " BENCHRUN='taskset -c %d'", cpu);
+    } else if (cpu >= 0 && !quiet) {
+        fprintf(stderr, "warning: taskset not found, benchmarks aren't pinned to CPU %d\n", cpu);
+    }
+
+    int res = build_project_with(profile, args.buf);
+    strbuf_free(&args);
+    if (res != 0) {
+        fprintf(stderr, "error: make bench failed\n");
+        return -1;
+    }
+
+    return results_load(HARNESS_RESULTS, "ns", rs);
+}
+
+/**
+ * run_command builds the project and runs the benchmark
+ * command of the config.
+ */
+static int
+run_command(const struct profile *profile, const struct bench_config *bc,
+            struct bench_results *rs)
+{
+    if (build_project(profile) != 0) {
+        return -1;
+    }
+
+    double *samples = calloc(bc->runs, sizeof(double));
+    struct bench_cmd cmd = { .dir = ".", .cmd = bc->command };
+    int res = -1;
+
+    if (samples != NULL && bench_commands(&cmd, 1, bc->warmup, bc->runs, &samples) == 0) {
+        rs->unit = strdup("ms");
+        res = results_add(rs, "command", samples, bc->runs);
+    }
+    free(samples);
+
+    return res;
+}
+
+/**
+ * load_baseline reads the baseline given either as the
+ * name of saved results or as the path of a results file.
+ */
+static int
+load_baseline(const char *baseline, struct bench_results *rs)
+{
+    size_t len = strlen(baseline);
+    if (strchr(baseline, '/') != NULL || (len > 5 && strcmp(baseline + len - 5, ".json") == 0)) {
+        return results_load(baseline, "samples", rs);
+    }
+
+    struct strbuf path = { 0 };
+    strbuf_appendf(&path, "%s/%s.json", BENCH_RESULTS_DIR, baseline);
+    int res = results_load(path.buf, "samples", rs);
+    strbuf_free(&path);
+
+    return res;
+}
+
+/**
+ * print_counters prints the median and MAD per iteration
+ * of the performance counters of every benchmark and,
+ * with a baseline, their change and its p-value.
+ */
+static void
+print_counters(const struct bench_results *rs, const struct bench_results *base)
+{
+    int header = 0;
+
+    for (int i = 0; i < rs->count; i++) {
+        const struct bench_result *r = &rs->items[i];
+        if (r->counters == NULL || r->counters->count == 0) {
+            continue;
+        }
+        const struct bench_result *b = base != NULL ? results_find(base, r->name) : NULL;
+        const struct bench_results *bcs = b != NULL ? b->counters : NULL;
+
+        if (header++ == 0) {
+            printf("\n%-18s %12s %10s", "counters/op", "median", "MAD");
+            if (base != NULL) {
+                printf(" %12s %9s %8s", "baseline", "change", "p");
+            }
+            printf("\n");
+        }
+        printf("%s\n", r->name);
+
+        for (int j = 0; j < r->counters->count; j++) {
+            const struct bench_result *c = &r->counters->items[j];
+            const struct bench_result *bc = bcs != NULL ? results_find(bcs, c->name) : NULL;
+            struct stats s, bs;
+            stats_compute(c->samples, c->n, &s);
+
+            printf("  %-16s %12.4g %10.4g", c->name, s.median, s.mad);
+            if (bc == NULL) {
+                printf(base != NULL ? " %12s %9s %8s\n" : "\n", "-", "-", "-");
+                continue;
+            }
+
+            stats_compute(bc->samples, bc->n, &bs);
+            double p = stats_mann_whitney(c->samples, c->n, bc->samples, bc->n);
+            if (bs.median != 0) {
+                printf(" %12.4g %+8.1f%%", bs.median, (s.median - bs.median) / bs.median * 100);
+            } else {
+                printf(" %12.4g %9s", bs.median, "-");
+            }
+            printf(" %8.4f%s\n", p, p < STATS_ALPHA ? " *" : "");
+        }
+    }
+}
+
+/**
+ * report prints the results compared to the baseline, if
+ * given, and returns the number of benchmarks that are
+ * significantly slower than their baseline by more than
+ * the threshold in percent. label names the baseline in
+ * the regression lines, e.g. a revision or a saved run.
+ * Benchmarks missing from the baseline are only printed.
+ */
+static int
+report(const struct bench_results *rs, const struct bench_results *base, const char *label,
+       double threshold)
+{
+    int regressions = 0;
+
+    print_header("benchmark", rs->unit);
+    for (int i = 0; i < rs->count; i++) {
+        const struct bench_result *r = &rs->items[i];
+        const struct bench_result *b = base != NULL ? results_find(base, r->name) : NULL;
+        print_row(r->name, r->samples, r->n, b != NULL ? b->samples : NULL, b != NULL ? b->n : 0);
+    }
+    print_counters(rs, base);
+
+    for (int i = 0; base != NULL && i < rs->count; i++) {
+        const struct bench_result *r = &rs->items[i];
+        const struct bench_result *b = results_find(base, r->name);
+        if (b == NULL) {
+            continue;
+        }
+
+        struct stats s, bs;
+        stats_compute(r->samples, r->n, &s);
+        stats_compute(b->samples, b->n, &bs);
+        double change = (s.median - bs.median) / bs.median * 100;
+        if (change > threshold && stats_significant(r->samples, r->n, b->samples, b->n)) {
+            if (regressions++ == 0) {
+                printf("\n");
+            }
+            printf("regression: %s is %.1f%% slower than %s\n", r->name, change, label);
+        }
+    }
+
+    return regressions;
+}
+
+/**
+ * checkout_rev checks out the given revision of the
+ * project's repository into dir, leaving the repository's
+ * index and working tree alone. The id of the commit is
+ * stored in id and the path of the project within dir,
+ * which differs from dir if the project isn't at the root
+ * of the repository, in project.
+ */
+static int
+checkout_rev(const char *rev, const char *dir, char *id, size_t len, struct strbuf *project)
+{
+    char cwd[PATH_MAX];
+    if (realpath(".", cwd) == NULL) {
+        perror("realpath");
+        return -1;
+    }
+
+    git_repository *repo = NULL;
+    if (git_repository_open_ext(&repo, ".", 0, NULL) != 0 || git_repository_workdir(repo) == NULL) {
+        fprintf(stderr, "error: the project isn't in a git repository with a working tree\n");
+        git_repository_free(repo);
+        return -1;
+    }
+
+    // the working directory ends in a slash, the project's
+    // path within the repository starts with one
+    const char *workdir = git_repository_workdir(repo);
+    size_t wlen = strlen(workdir) - 1;
+    const char *prefix = strncmp(cwd, workdir, wlen) == 0 ? cwd + wlen : "";
+
+    struct strbuf spec = { 0 };
+    strbuf_appendf(&spec, "%s^{commit}", rev);
+    git_object *commit = NULL;
+    int res = git_revparse_single(&commit, repo, spec.buf);
+    strbuf_free(&spec);
+    if (res != 0) {
+        const git_error *e = giterr_last();
+        fprintf(stderr, "error: %s: %s\n", rev, e != NULL ? e->message : "unknown revision");
+        git_repository_free(repo);
+        return -1;
+    }
+    git_oid_tostr(id, len, git_object_id(commit));
+
+    struct strbuf target = { 0 };
+    strbuf_appendf(&target, "%s/%s", cwd, dir);
+    if (remove_tree(target.buf) != 0 || mkdir_p(target.buf, 0755) != 0) {
+        perror(target.buf);
+        res = -1;
+        goto out;
+    }
+
+    git_checkout_options co_opts = GIT_CHECKOUT_OPTIONS_INIT;
+    co_opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_DONT_UPDATE_INDEX;
+    co_opts.target_directory = target.buf;
+    res = git_checkout_tree(repo, commit, &co_opts);
+    if (res != 0) {
+        const git_error *e = giterr_last();
+        fprintf(stderr, "error: unable to check out %s: %s\n", rev,
+                e != NULL ? e->message : "unknown error");
+        goto out;
+    }
+    strbuf_appendf(project, "%s%s", target.buf, prefix);
+
+out:
+    strbuf_free(&target);
+    git_object_free(commit);
+    git_repository_free(repo);
+
+    return res;
+}
+
+/**
+ * prepare_checkout gives the checked out project the
+ * config and lock file of the current one, so both are
+ * built with the same profiles and dependencies.
+ */
+static int
+prepare_checkout(const char *project)
+{
+    const char *files[] = { CONFIG_FILE, FLOTSAM_LOCK_FILE };
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        if (access(files[i], F_OK) != 0) {
+            continue;
+        }
+
+        struct strbuf dst = { 0 };
+        strbuf_appendf(&dst, "%s/%s", project, files[i]);
+        int res = copy_file(files[i], dst.buf);
+        if (res != 0) {
+            perror(dst.buf);
+        }
+        strbuf_free(&dst);
+        if (res != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * build_in builds the project in dir, running the
+ * micro-benchmarks once if there are any as they're
+ * only built by the bench target.
+ */
+static int
+build_in(const char *dir, const struct profile *profile, int harness)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+    if (chdir(dir) != 0) {
+        perror(dir);
+        return -1;
+    }
+
+    struct bench_results scratch = { 0 };
+    int res = harness ? run_harness(profile, 1, 0, 0, &scratch) : build_project(profile);
+    results_free(&scratch);
+
+    if (chdir(cwd) != 0) {
+        perror(cwd);
+        return -1;
+    }
+
+    return res == 0 ? 0 : -1;
+}
+
+/**
+ * compare_harness runs the micro-benchmarks of both
+ * projects alternately, one sample of each benchmark per
+ * run, starting with a different project every round.
+ * With a dependency given, it's switched to vers[i]
+ * before running in dirs[i] so each project is built
+ * against its own version.
+ */
+static int
+compare_harness(const struct profile *profile, const char *dirs[2], const struct bench_config *bc,
+                struct bench_results rs[2], struct dependency *dep, char *vers[2])
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+
+    for (int round = 0; round < bc->runs; round++) {
+        for (int k = 0; k < 2; k++) {
+            int i = (round + k) % 2;
+            if (dep != NULL) {
+                dep->vers = vers[i];
+            }
+            if (chdir(dirs[i]) != 0) {
+                perror(dirs[i]);
+                return -1;
+            }
+
+            struct bench_results one = { 0 };
+            int res = run_harness(profile, 1, 1, bc->counters, &one);
+            if (res == 0) {
+                res = results_merge(&rs[i], &one);
+            }
+            results_free(&one);
+
+            if (chdir(cwd) != 0) {
+                perror(cwd);
+                return -1;
+            }
+            if (res != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int
+bench_compare(const struct profile *profile, const char *rev)
+{
+    struct bench_config bc;
+    if (bench_load_config(&bc) != 0) {
+        return 1;
+    }
+
+    int harness = bc.command == NULL;
+    if (harness && !has_harness()) {
+        fprintf(stderr, "error: no benchmark command, set \"command\" in the \"bench\" section "
+                "or add benchmarks to %s\n", BENCH_DIR);
+        free(bc.command);
+        return 1;
+    }
+
+    struct bench_results rs[2] = { { 0 }, { 0 } };
+    struct strbuf project = { 0 };
+    char id[GIT_OID_HEXSZ + 1];
+    int res = 1;
+
+    printf("checking out %s into %s\n", rev, COMPARE_DIR);
+    fflush(stdout);
+    if (checkout_rev(rev, COMPARE_DIR, id, sizeof(id), &project) != 0 ||
+        prepare_checkout(project.buf) != 0) {
+        goto out;
+    }
+
+    if (config_dependency_count() > 0 && build_update(profile, 1) != 0) {
+        goto out;
+    }
+
+    const char *dirs[2] = { ".", project.buf };
+    for (int i = 0; i < 2; i++) {
+        if (build_in(dirs[i], profile, harness) != 0) {
+            fprintf(stderr, "error: unable to build %s\n", i == 0 ? "the working tree" : rev);
+            goto out;
+        }
+    }
+
+    if (harness) {
+        printf("\nthe working tree against %s (%.12s), %d samples each, interleaved\n\n", rev,
+               id, bc.runs);
+        if (compare_harness(profile, dirs, &bc, rs, NULL, NULL) != 0) {
+            goto out;
+        }
+    } else {
+        struct bench_cmd cmds[2] = { { .dir = dirs[0], .cmd = bc.command },
+                                     { .dir = dirs[1], .cmd = bc.command } };
+        double *samples[2] = { calloc(bc.runs, sizeof(double)), calloc(bc.runs, sizeof(double)) };
+
+        printf("\n%s: the working tree against %s (%.12s), %d runs each, interleaved\n\n",
+               bc.command, rev, id, bc.runs);
+        int ok = samples[0] != NULL && samples[1] != NULL &&
+                 bench_commands(cmds, 2, bc.warmup, bc.runs, samples) == 0 &&
+                 !cmds[0].failed && !cmds[1].failed;
+        for (int i = 0; ok && i < 2; i++) {
+            rs[i].unit = strdup("ms");
+            ok = results_add(&rs[i], "command", samples[i], bc.runs) == 0;
+        }
+        free(samples[0]);
+        free(samples[1]);
+        if (!ok) {
+            goto out;
+        }
+    }
+
+    res = report(&rs[0], &rs[1], rev, bc.threshold) > 0 ? 1 : 0;
+
+out:
+    remove_tree(COMPARE_DIR);
+    results_free(&rs[0]);
+    results_free(&rs[1]);
+    strbuf_free(&project);
+    free(bc.command);
+
+    return res;
+}
+
+/**
+ * find_dependency returns the project's dependency with
+ * the given name, repository name, e.g. libspinner, or
+ * library name, e.g. spinner, or NULL if there's none.
+ */
+static struct dependency*
+find_dependency(const char *name)
+{
+    struct dependencies *deps = config_get_dependencies();
+    size_t len = strlen(name);
+
+    for (int i = 0; i < deps->count; i++) {
+        struct dependency *dep = &deps->dependencies[i];
+        const char *base = strrchr(dep->name, '/');
+        base = base != NULL ? base + 1 : dep->name;
+        char *lib_name = dependency_lib_name(dep->name);
+
+        int match = strcmp(dep->name, name) == 0 ||
+                    (strncmp(base, name, len) == 0 && (base[len] == '\0' || strcmp(base + len, ".git") == 0)) ||
+                    (lib_name != NULL && strcmp(lib_name, name) == 0);
+        free(lib_name);
+        if (match) {
+            return dep;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * dep_tree copies the project to dir with the dependency
+ * set to the given version in its config. The installed
+ * libraries, headers and objects aren't copied as they're
+ * built for the version in dir.
+ */
+static int
+dep_tree(const char *dir, const struct dependency *dep, const char *vers)
+{
+    const char *skip[] = { ".git", ".flotsam", "bin", "build", "deps", FLOTSAM_LOCK_FILE };
+    if (remove_tree(dir) != 0 || copy_tree(".", dir, skip, sizeof(skip) / sizeof(skip[0])) != 0) {
+        fprintf(stderr, "error: unable to copy the project to %s\n", dir);
+        return -1;
+    }
+
+    json_error_t error;
+    json_t *root = json_load_file(CONFIG_FILE, JSON_PRESERVE_ORDER, &error);
+    if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", CONFIG_FILE, error.line, error.text);
+        return -1;
+    }
+
+    json_t *deps = json_object_get(root, "dependencies");
+    for (size_t i = 0; i < json_array_size(deps); i++) {
+        json_t *item = json_array_get(deps, i);
+        const char *name = json_string_value(json_object_get(item, "name"));
+        if (name != NULL && strcmp(name, dep->name) == 0) {
+            json_object_set_new(item, "version", json_string(vers));
+        }
+    }
+
+    struct strbuf path = { 0 };
+    strbuf_appendf(&path, "%s/%s", dir, CONFIG_FILE);
+    int res = json_dump_file(root, path.buf, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    strbuf_free(&path);
+    json_decref(root);
+
+    return res;
+}
+
+/**
+ * update_in fetches and builds the dependencies of the
+ * project in dir, installing them into its own lib and
+ * include directories.
+ */
+static int
+update_in(const char *dir, const struct profile *profile)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+    if (chdir(dir) != 0) {
+        perror(dir);
+        return -1;
+    }
+
+    int res = build_update(profile, 1);
+
+    if (chdir(cwd) != 0) {
+        perror(cwd);
+        return -1;
+    }
+
+    return res == 0 ? 0 : -1;
+}
+
+int
+bench_dep(const struct profile *profile, const char *spec)
+{
+    struct bench_config bc;
+    if (bench_load_config(&bc) != 0) {
+        return 1;
+    }
+
+    int harness = bc.command == NULL;
+    if (harness && !has_harness()) {
+        fprintf(stderr, "error: no benchmark command, set \"command\" in the \"bench\" section "
+                "or add benchmarks to %s\n", BENCH_DIR);
+        free(bc.command);
+        return 1;
+    }
+
+    char *name = strdup(spec);
+    char *vers[2] = { NULL, NULL };
+    char *eq = strchr(name, '=');
+    char *comma = eq != NULL ? strchr(eq + 1, ',') : NULL;
+    if (comma != NULL && strchr(comma + 1, ',') == NULL) {
+        *eq = *comma = '\0';
+        vers[0] = eq + 1;
+        vers[1] = comma + 1;
+    }
+    if (vers[0] == NULL || vers[0][0] == '\0' || vers[1][0] == '\0') {
+        fprintf(stderr, "error: --dep takes <name>=<version>,<version>\n");
+        free(name);
+        free(bc.command);
+        return 1;
+    }
+
+    struct dependency *dep = find_dependency(name);
+    if (dep == NULL) {
+        fprintf(stderr, "error: %s isn't a dependency of the project\n", name);
+        free(name);
+        free(bc.command);
+        return 1;
+    }
+
+    char *original = dep->vers;
+    struct bench_results rs[2] = { { 0 }, { 0 } };
+    struct strbuf trees[2] = { { 0 }, { 0 } };
+    struct strbuf label = { 0 };
+    const char *dirs[2];
+    int res = 1;
+
+    // each version gets its own copy of the project so
+    // their libraries and headers are installed side by side
+    for (int i = 0; i < 2; i++) {
+        strbuf_appendf(&trees[i], "%s/%d", DEP_DIR, i);
+        dirs[i] = trees[i].buf;
+
+        printf("building against %s@%s in %s\n", dep->name, vers[i], dirs[i]);
+        fflush(stdout);
+        dep->vers = vers[i];
+        if (dep_tree(dirs[i], dep, vers[i]) != 0 || update_in(dirs[i], profile) != 0 ||
+            build_in(dirs[i], profile, harness) != 0) {
+            fprintf(stderr, "error: unable to build against %s@%s\n", dep->name, vers[i]);
+            goto out;
+        }
+    }
+
+    if (harness) {
+        printf("\n%s@%s against %s, %d samples each, interleaved\n\n", dep->name, vers[1],
+               vers[0], bc.runs);
+        if (compare_harness(profile, dirs, &bc, rs, dep, vers) != 0) {
+            goto out;
+        }
+    } else {
+        struct bench_cmd cmds[2] = { { .dir = dirs[0], .cmd = bc.command },
+                                     { .dir = dirs[1], .cmd = bc.command } };
+        double *samples[2] = { calloc(bc.runs, sizeof(double)), calloc(bc.runs, sizeof(double)) };
+
+        printf("\n%s: %s@%s against %s, %d runs each, interleaved\n\n", bc.command, dep->name,
+               vers[1], vers[0], bc.runs);
+        int ok = samples[0] != NULL && samples[1] != NULL &&
+                 bench_commands(cmds, 2, bc.warmup, bc.runs, samples) == 0 &&
+                 !cmds[0].failed && !cmds[1].failed;
+        for (int i = 0; ok && i < 2; i++) {
+            rs[i].unit = strdup("ms");
+            ok = results_add(&rs[i], "command", samples[i], bc.runs) == 0;
+        }
+        free(samples[0]);
+        free(samples[1]);
+        if (!ok) {
+            goto out;
+        }
+    }
+
+    strbuf_appendf(&label, "%s@%s", dep->name, vers[0]);
+    res = report(&rs[1], &rs[0], label.buf, bc.threshold) > 0 ? 1 : 0;
+
+out:
+    dep->vers = original;
+    remove_tree(DEP_DIR);
+    results_free(&rs[0]);
+    results_free(&rs[1]);
+    strbuf_free(&trees[0]);
+    strbuf_free(&trees[1]);
+    strbuf_free(&label);
+    free(name);
+    free(bc.command);
+
+    return res;
+}
+
+int
+bench_run(const struct profile *profile, const char *save, const char *baseline)
+{
+    struct bench_config bc;
+    if (bench_load_config(&bc) != 0) {
+        return 1;
+    }
+
+    struct bench_results rs = { 0 };
+    struct bench_results base = { 0 };
+    int res = 1;
+
+    if (baseline != NULL && load_baseline(baseline, &base) != 0) {
+        goto out;
+    }
+
+    if (bc.command != NULL) {
+        if (run_command(profile, &bc, &rs) != 0) {
+            goto out;
+        }
+        printf("%s (%d runs)\n\n", bc.command, bc.runs);
+    } else if (has_harness()) {
+        if (run_harness(profile, bc.runs, 0, bc.counters, &rs) != 0) {
+            goto out;
+        }
+        printf("%s (%d samples, %s profile)\n\n", BENCH_DIR, bc.runs,
+               profile != NULL ? profile->name : "default");
+    } else {
+        fprintf(stderr, "error: no benchmark command, set \"command\" in the \"bench\" section "
+                "or add benchmarks to %s\n", BENCH_DIR);
+        goto out;
+    }
+
+    if (baseline != NULL && strcmp(rs.unit, base.unit) != 0) {
+        fprintf(stderr, "error: baseline %s is in %s, not %s\n", baseline, base.unit, rs.unit);
+        goto out;
+    }
+
+    int regressions = report(&rs, baseline != NULL ? &base : NULL, baseline, bc.threshold);
+    if (results_save(&rs, profile, BENCH_LATEST) != 0 ||
+        (save != NULL && results_save(&rs, profile, save) != 0)) {
+        goto out;
+    }
+    res = regressions > 0 ? 1 : 0;
+
+out:
+    results_free(&rs);
+    results_free(&base);
+    free(bc.command);
+
+    return res;
+}
+
+/**
+ * allocator_library builds the allocator if needed and
+ * stores the path of its shared library in sb.
+ */
+static int
+allocator_library(const char *name, const struct profile *profile, struct strbuf *sb)
+{
+    struct dependency dep;
+    if (config_allocator_dependency(name, &dep) != 0) {
+        fprintf(stderr, "error: unknown allocator: %s\n", name);
+        return -1;
+    }
+    // preloading needs the shared library whatever the
+    // project links
+    dep.link = LINK_DYNAMIC;
+
+    char *artifacts = dependency_artifact_path(&dep, profile);
+    char *lib_name = dependency_lib_name(dep.name);
+    struct stat s;
+    int res = 0;
+
+    if (stat(artifacts, &s) != 0) {
+        printf("building %s@%s\n", dep.name, dep.vers);
+        res = dependency_update(&dep, profile);
+    }
+    if (res == 0) {
+        strbuf_appendf(sb, "%s/lib%s%s", artifacts, lib_name, SHLIB_EXT);
+        if (stat(sb->buf, &s) != 0) {
+            fprintf(stderr, "error: %s has no shared library %s\n", name, sb->buf);
+            res = -1;
+        }
+    }
+
+    free(artifacts);
+    free(lib_name);
+    free(dep.name);
+    free(dep.vers);
+    free(dep.build);
+    free(dep.libs);
+
+    return res;
+}
+
+int
+bench_allocators(const struct profile *profile, const char *list)
+{
+    struct bench_config bc;
+    if (bench_load_config(&bc) != 0) {
+        return 1;
+    }
+    if (bc.command == NULL) {
+        fprintf(stderr, "error: no benchmark command, set \"command\" in the \"bench\" section\n");
+        return 1;
+    }
+
+    char *names = strdup(list);
+    char *original = config_get_allocator() != NULL ? strdup(config_get_allocator()) : NULL;
+    struct strbuf *libs = NULL;
+    struct bench_cmd *cmds = NULL;
+    double **samples = NULL;
+    char *allocators[32];
+    int count = 0, res = 1;
+
+    for (char *tok = strtok(names, ","); tok != NULL && count < 32; tok = strtok(NULL, ",")) {
+        allocators[count++] = tok;
+    }
+
+    libs = calloc(count, sizeof(struct strbuf));
+    cmds = calloc(count, sizeof(struct bench_cmd));
+    samples = calloc(count, sizeof(double*));
+    if (count == 0 || libs == NULL || cmds == NULL || samples == NULL) {
+        fprintf(stderr, "error: no allocators given\n");
+        goto out;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(allocators[i], SYSTEM_ALLOCATOR) != 0 &&
+            allocator_library(allocators[i], profile, &libs[i]) != 0) {
+            goto out;
+        }
+        cmds[i].dir = ".";
+        cmds[i].cmd = bc.command;
+        cmds[i].preload = libs[i].buf;
+        samples[i] = calloc(bc.runs, sizeof(double));
+        if (samples[i] == NULL) {
+            perror("unable to allocate memory for samples");
+            goto out;
+        }
+    }
+
+    // a linked in allocator would win over the preloaded
+    // one so the project is built without it
+    config_set_allocator(NULL);
+    build_clean();
+    if (build_project(profile) != 0) {
+        goto out;
+    }
+
+    printf("%s (%d runs per allocator, interleaved)\n\n", bc.command, bc.runs);
+    if (bench_commands(cmds, count, bc.warmup, bc.runs, samples) != 0) {
+        goto out;
+    }
+
+    print_header("allocator", "ms");
+    for (int i = 0; i < count; i++) {
+        if (cmds[i].failed) {
+            printf("%-16s failed\n", allocators[i]);
+            continue;
+        }
+        print_row(allocators[i], samples[i], bc.runs, cmds[0].failed ? NULL : samples[0], bc.runs);
+    }
+    res = 0;
+
+out:
+    if (original != NULL) {
+        config_set_allocator(original);
+        build_clean();
+        if (build_project(profile) != 0) {
+            res = 1;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (libs != NULL) {
+            strbuf_free(&libs[i]);
+        }
+        if (samples != NULL) {
+            free(samples[i]);
+        }
+    }
+    free(libs);
+    free(cmds);
+    free(samples);
+    free(names);
+    free(original);
+    free(bc.command);
+
+    return res;
+}
@@ -0,0 +1,163 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "config.h"
+
+#define BENCH_DEFAULT_RUNS      15
+#define BENCH_DEFAULT_WARMUP    2
+#define BENCH_DEFAULT_THRESHOLD 5.0
+
+/**
+ * BENCH_PROFILE is the profile benchmarks are built with
+ * when no other profile is selected.
+ */
+#define BENCH_PROFILE "release"
+
+/**
+ * BENCH_DIR holds the micro-benchmarks of projects made
+ * with flotsam new. Results of every run are saved to
+ * BENCH_RESULTS_DIR.
+ */
+#define BENCH_DIR         "bench"
+#define BENCH_RESULTS_DIR ".flotsam/bench"
+#define BENCH_LATEST      "latest"
+
+/**
+ * bench_cmd is a shell command to benchmark, the
+ * directory to run it from and a library to preload
+ * into it, if any.
+ */
+struct bench_cmd
+{
+    const char *dir;
+    const char *cmd;
+    const char *preload;
+    int failed;
+};
+
+/**
+ * bench_config is the "bench" section of Flotsam.json.
+ */
+struct bench_config
+{
+    char *command;
+    int runs;
+    int warmup;
+    double threshold;
+    int counters;
+};
+
+/**
+ * bench_commands runs every command warmup + runs times and stores the wall
+ * time of each measured run in milliseconds in samples[i], which must have
+ * room for runs values. Runs are interleaved round robin, starting at a
+ * different command every round, so thermal and background noise drift
+ * spreads evenly over the commands. A command that exits non-zero is marked
+ * failed and not run again. Output of the commands is discarded.
+ */
+int
+bench_commands(struct bench_cmd *cmds, int count, int warmup, int runs, double **samples);
+
+/**
+ * bench_set_counters makes the micro-benchmark harness read performance
+ * counters for the rest of the run, as with "counters": true in the "bench"
+ * section.
+ */
+void
+bench_set_counters(int counters);
+
+/**
+ * bench_load_config reads the "bench" section of Flotsam.json, filling in
+ * defaults for what isn't set. The command is NULL if none is set and needs
+ * to be freed by the caller.
+ */
+int
+bench_load_config(struct bench_config *bc);
+
+/**
+ * bench_run builds the project and runs the benchmark command, printing the
+ * median, MAD and 95% confidence interval of its wall time. Without a
+ * command, the micro-benchmarks in BENCH_DIR are built and run with make
+ * bench instead, pinned to an isolated CPU if the kernel has any. Results
+ * are saved to BENCH_RESULTS_DIR as BENCH_LATEST.json and, if save is
+ * given, as <save>.json. With a baseline, a name in BENCH_RESULTS_DIR or the
+ * path of a results file, every benchmark is compared with its baseline and
+ * 1 is returned if any is significantly slower by more than the threshold.
+ * With counters enabled the harness' performance counters are reported,
+ * saved and compared along with the timings.
+ */
+int
+bench_run(const struct profile *profile, const char *save, const char *baseline);
+
+/**
+ * bench_load_samples reads the samples of the named benchmark from results
+ * saved by bench_run. Without a name the results need to hold a single
+ * benchmark. The samples and their unit need to be freed by the caller.
+ */
+int
+bench_load_samples(const char *path, const char *name, double **samples, int *n, char **unit);
+
+/**
+ * bench_compare checks out the given revision into a temporary directory with
+ * libgit2 and builds it and the working tree with the same profile, config
+ * and lock file. The benchmark command, or the micro-benchmarks in BENCH_DIR
+ * without one, then run alternately in both trees and the speedup of the
+ * working tree over the revision is printed with its significance. Like
+ * with a baseline, 1 is returned if the working tree is significantly slower
+ * by more than the threshold.
+ */
+int
+bench_compare(const struct profile *profile, const char *rev);
+
+/**
+ * bench_dep benchmarks two versions of a dependency given as
+ * <name>=<version>,<version>. The name is the dependency's name in
+ * Flotsam.json or its library name. Both versions are fetched into the
+ * cache and the project is copied into a directory per version, where it's
+ * built against that version's own libraries and headers. The benchmarks
+ * then run alternately in both and the speedup of the second version over
+ * the first is printed. 1 is returned if the second version is
+ * significantly slower by more than the threshold.
+ */
+int
+bench_dep(const struct profile *profile, const char *spec);
+
+/**
+ * bench_allocators builds the project with the system allocator and runs the
+ * benchmark command under each allocator in the comma separated list,
+ * preloading the allocator's shared library. The allocators are built like
+ * dependencies if needed. "system" runs without a preload. Results are
+ * compared against the first allocator in the list. The project is rebuilt
+ * with its own allocator afterwards.
+ */
+int
+bench_allocators(const struct profile *profile, const char *list);
+
+#endif /* _BENCH_H */
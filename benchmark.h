@@ -0,0 +1,533 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include <stdio.h>
+
+#define BENCHMARK_HEADER_TEMPLATE                                                   \
+    "#ifndef _BENCHMARK_H\n"                                                        \
+    "#define _BENCHMARK_H\n\n"                                                      \
+    "#include <stdint.h>\n\n"                                                       \
+    "/**\n"                                                                         \
+    " * bench_state is passed to every benchmark, which runs the code being\n"      \
+    " * measured iterations times. The harness picks the count so each sample\n"    \
+    " * takes long enough to be timed accurately.\n"                                \
+    " */\n"                                                                         \
+    "struct bench_state {\n"                                                        \
+    "    uint64_t iterations;\n"                                                    \
+    "};\n\n"                                                                        \
+    "typedef void (*bench_fn)(struct bench_state *state);\n\n"                      \
+    "/**\n"                                                                         \
+    " * bench_register adds a benchmark to the ones run by the harness.\n"          \
+    " * It's called by BENCHMARK before main.\n"                                    \
+    " */\n"                                                                         \
+    "void bench_register(const char *name, bench_fn fn);\n\n"                       \
+    "/**\n"                                                                         \
+    " * BENCHMARK defines and registers a benchmark. The body is given a\n"         \
+    " * struct bench_state *state.\n"                                               \
+    " */\n"                                                                         \
+    "#define BENCHMARK(name)                                                  \\\n" \
+    "    static void bench_##name(struct bench_state *state);                 \\\n" \
+    "    __attribute__((constructor)) static void bench_register_##name(void) \\\n" \
+    "    {                                                                    \\\n" \
+    "        bench_register(#name, bench_##name);                             \\\n" \
+    "    }                                                                    \\\n" \
+    "    static void bench_##name(struct bench_state *state)\n\n"                   \
+    "/**\n"                                                                         \
+    " * bench_do_not_optimize keeps the compiler from removing the\n"               \
+    " * computation of a value that's otherwise unused.\n"                          \
+    " */\n"                                                                         \
+    "#define bench_do_not_optimize(x) \\\n"                                         \
+    "    __asm__ __volatile__(\"\" : : \"g\"(x) : \"memory\")\n\n"                  \
+    "/**\n"                                                                         \
+    " * bench_clobber makes the compiler assume all memory was read and\n"          \
+    " * written, so stores in the measured code aren't optimized away.\n"           \
+    " */\n"                                                                         \
+    "#define bench_clobber() __asm__ __volatile__(\"\" : : : \"memory\")\n\n"       \
+    "#endif /* _BENCHMARK_H */\n"
+
+#define BENCHMARK_HARNESS_TEMPLATE                                                             \
+    "#define _POSIX_C_SOURCE 200809L\n"                                                        \
+    "#define _DEFAULT_SOURCE\n\n"                                                              \
+    "#include <errno.h>\n"                                                                     \
+    "#include <stdint.h>\n"                                                                    \
+    "#include <stdio.h>\n"                                                                     \
+    "#include <stdlib.h>\n"                                                                    \
+    "#include <string.h>\n"                                                                    \
+    "#include <time.h>\n"                                                                      \
+    "#include <unistd.h>\n"                                                                    \
+    "#if defined(__x86_64__) || defined(__i386__)\n"                                           \
+    "#include <x86intrin.h>\n"                                                                 \
+    "#define HAVE_RDTSC 1\n"                                                                   \
+    "#endif\n"                                                                                 \
+    "#ifdef __linux__\n"                                                                       \
+    "#include <linux/perf_event.h>\n"                                                          \
+    "#include <sys/ioctl.h>\n"                                                                 \
+    "#include <sys/syscall.h>\n"                                                               \
+    "#define HAVE_PERF 1\n"                                                                    \
+    "#endif\n\n"                                                                               \
+    "#include \"benchmark.h\"\n\n"                                                             \
+    "// micro-benchmark harness. Every benchmark is calibrated so a sample\n"                  \
+    "// takes about the sample time, warmed up, and then timed for the given\n"                \
+    "// number of samples. Results are printed per iteration, unless -q is\n"                  \
+    "// given, and written as JSON with -j. With -c, counters are read with\n"                 \
+    "// perf_event_open around every sample.\n\n"                                              \
+    "#define MAX_BENCHMARKS 256\n"                                                             \
+    "#define MAX_SAMPLES    1000\n"                                                            \
+    "#define MAX_COUNTERS   10\n\n"                                                            \
+    "static struct {\n"                                                                        \
+    "    const char *name;\n"                                                                  \
+    "    bench_fn fn;\n"                                                                       \
+    "} benchmarks[MAX_BENCHMARKS];\n"                                                          \
+    "static int benchmark_count;\n\n"                                                          \
+    "void\n"                                                                                   \
+    "bench_register(const char *name, bench_fn fn)\n"                                          \
+    "{\n"                                                                                      \
+    "    if (benchmark_count == MAX_BENCHMARKS) {\n"                                           \
+    "        fprintf(stderr, \"error: too many benchmarks, %s ignored\\n\",\n"                 \
+    "                name);\n"                                                                 \
+    "        return;\n"                                                                        \
+    "    }\n"                                                                                  \
+    "    benchmarks[benchmark_count].name = name;\n"                                           \
+    "    benchmarks[benchmark_count].fn = fn;\n"                                               \
+    "    benchmark_count++;\n"                                                                 \
+    "}\n\n"                                                                                    \
+    "/**\n"                                                                                    \
+    " * counters are the performance counters read around every sample with\n"                 \
+    " * their samples per iteration. Derived ones have no fd.\n"                               \
+    " */\n"                                                                                    \
+    "static struct {\n"                                                                        \
+    "    const char *name;\n"                                                                  \
+    "    int fd;\n"                                                                            \
+    "    double samples[MAX_SAMPLES];\n"                                                       \
+    "} counters[MAX_COUNTERS];\n"                                                              \
+    "static int counter_count;\n\n"                                                            \
+    "#ifdef HAVE_PERF\n"                                                                       \
+    "/**\n"                                                                                    \
+    " * events are the counters opened with -c. Hardware counters that can't\n"                \
+    " * be opened, as in most VMs, are left out. Fallbacks are only opened\n"                  \
+    " * when none of the hardware counters could be.\n"                                        \
+    " */\n"                                                                                    \
+    "static const struct {\n"                                                                  \
+    "    const char *name;\n"                                                                  \
+    "    uint32_t type;\n"                                                                     \
+    "    uint64_t config;\n"                                                                   \
+    "    int fallback;\n"                                                                      \
+    "} events[] = {\n"                                                                         \
+    "    { \"cycles\", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0 },\n"                   \
+    "    { \"instructions\", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0 },\n"           \
+    "    { \"branch-misses\", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0 },\n"         \
+    "    { \"L1d-misses\", PERF_TYPE_HW_CACHE,\n"                                              \
+    "      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |\n"                   \
+    "      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 0 },\n"                                    \
+    "    { \"LLC-misses\", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 0 },\n"             \
+    "    { \"context-switches\", PERF_TYPE_SOFTWARE,\n"                                        \
+    "      PERF_COUNT_SW_CONTEXT_SWITCHES, 0 },\n"                                             \
+    "    { \"page-faults\", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, 0 },\n"             \
+    "    { \"task-clock\", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 1 },\n"               \
+    "};\n\n"                                                                                   \
+    "/**\n"                                                                                    \
+    " * open_event opens a disabled counter for this thread, counting user\n"                  \
+    " * space only if the kernel doesn't allow more.\n"                                        \
+    " */\n"                                                                                    \
+    "static int\n"                                                                             \
+    "open_event(uint32_t type, uint64_t config)\n"                                             \
+    "{\n"                                                                                      \
+    "    struct perf_event_attr attr;\n"                                                       \
+    "    memset(&attr, 0, sizeof(attr));\n"                                                    \
+    "    attr.size = sizeof(attr);\n"                                                          \
+    "    attr.type = type;\n"                                                                  \
+    "    attr.config = config;\n"                                                              \
+    "    attr.disabled = 1;\n"                                                                 \
+    "    attr.exclude_hv = 1;\n"                                                               \
+    "    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |\n"                                \
+    "                       PERF_FORMAT_TOTAL_TIME_RUNNING;\n\n"                               \
+    "    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);\n"                   \
+    "    if (fd < 0 && (errno == EACCES || errno == EPERM)) {\n"                               \
+    "        attr.exclude_kernel = 1;\n"                                                       \
+    "        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);\n"                   \
+    "    }\n"                                                                                  \
+    "    return fd;\n"                                                                         \
+    "}\n\n"                                                                                    \
+    "/**\n"                                                                                    \
+    " * counters_open opens the counters available on this machine and\n"                      \
+    " * returns how many were opened.\n"                                                       \
+    " */\n"                                                                                    \
+    "static int\n"                                                                             \
+    "counters_open(int quiet)\n"                                                               \
+    "{\n"                                                                                      \
+    "    int count = (int)(sizeof(events) / sizeof(events[0]));\n"                             \
+    "    int hardware = 0, failed = 0, err = 0;\n"                                             \
+    "    const char *missing[MAX_COUNTERS];\n\n"                                               \
+    "    for (int i = 0; i < count; i++) {\n"                                                  \
+    "        if (events[i].fallback && hardware > 0) {\n"                                      \
+    "            continue;\n"                                                                  \
+    "        }\n"                                                                              \
+    "        int fd = open_event(events[i].type, events[i].config);\n"                         \
+    "        if (fd < 0) {\n"                                                                  \
+    "            err = errno;\n"                                                               \
+    "            missing[failed++] = events[i].name;\n"                                        \
+    "            continue;\n"                                                                  \
+    "        }\n"                                                                              \
+    "        hardware += events[i].type != PERF_TYPE_SOFTWARE;\n"                              \
+    "        counters[counter_count].name = events[i].name;\n"                                 \
+    "        counters[counter_count].fd = fd;\n"                                               \
+    "        counter_count++;\n"                                                               \
+    "    }\n\n"                                                                                \
+    "    if (!quiet && counter_count == 0) {\n"                                                \
+    "        fprintf(stderr, \"warning: counters not available (%s)\\n\",\n"                   \
+    "                strerror(err));\n"                                                        \
+    "    } else if (!quiet && hardware == 0) {\n"                                              \
+    "        fprintf(stderr, \"warning: no hardware counters (%s), using software \"\n"        \
+    "                \"counters\\n\", strerror(err));\n"                                       \
+    "    } else if (!quiet) {\n"                                                               \
+    "        for (int i = 0; i < failed; i++) {\n"                                             \
+    "            fprintf(stderr, \"warning: %s not available\\n\", missing[i]);\n"             \
+    "        }\n"                                                                              \
+    "    }\n\n"                                                                                \
+    "    return counter_count;\n"                                                              \
+    "}\n\n"                                                                                    \
+    "static void\n"                                                                            \
+    "counters_start(void)\n"                                                                   \
+    "{\n"                                                                                      \
+    "    for (int i = 0; i < counter_count; i++) {\n"                                          \
+    "        if (counters[i].fd >= 0) {\n"                                                     \
+    "            ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);\n"                            \
+    "            ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);\n"                           \
+    "        }\n"                                                                              \
+    "    }\n"                                                                                  \
+    "}\n\n"                                                                                    \
+    "/**\n"                                                                                    \
+    " * counters_stop stops the counters and stores their values per\n"                        \
+    " * iteration as the given sample, scaled up if the kernel had to\n"                       \
+    " * multiplex them.\n"                                                                     \
+    " */\n"                                                                                    \
+    "static void\n"                                                                            \
+    "counters_stop(long sample, uint64_t iterations)\n"                                        \
+    "{\n"                                                                                      \
+    "    for (int i = 0; i < counter_count; i++) {\n"                                          \
+    "        if (counters[i].fd >= 0) {\n"                                                     \
+    "            ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);\n"                          \
+    "        }\n"                                                                              \
+    "    }\n"                                                                                  \
+    "    for (int i = 0; i < counter_count; i++) {\n"                                          \
+    "        if (counters[i].fd < 0) {\n"                                                      \
+    "            continue;\n"                                                                  \
+    "        }\n"                                                                              \
+    "        uint64_t v[3] = { 0, 0, 0 };\n"                                                   \
+    "        double value = 0;\n"                                                              \
+    "        if (read(counters[i].fd, v, sizeof(v)) == sizeof(v) && v[2] > 0) {\n"             \
+    "            value = (double)v[0] * v[1] / v[2];\n"                                        \
+    "        }\n"                                                                              \
+    "        counters[i].samples[sample] = value / iterations;\n"                              \
+    "    }\n"                                                                                  \
+    "}\n"                                                                                      \
+    "#else\n"                                                                                  \
+    "static int\n"                                                                             \
+    "counters_open(int quiet)\n"                                                               \
+    "{\n"                                                                                      \
+    "    if (!quiet) {\n"                                                                      \
+    "        fprintf(stderr, \"warning: counters need perf_event_open\\n\");\n"                \
+    "    }\n"                                                                                  \
+    "    return 0;\n"                                                                          \
+    "}\n\n"                                                                                    \
+    "static void\n"                                                                            \
+    "counters_start(void)\n"                                                                   \
+    "{\n"                                                                                      \
+    "}\n\n"                                                                                    \
+    "static void\n"                                                                            \
+    "counters_stop(long sample, uint64_t iterations)\n"                                        \
+    "{\n"                                                                                      \
+    "    (void)sample;\n"                                                                      \
+    "    (void)iterations;\n"                                                                  \
+    "}\n"                                                                                      \
+    "#endif\n\n"                                                                               \
+    "/**\n"                                                                                    \
+    " * counter_find returns the index of the named counter or -1 if it\n"                     \
+    " * isn't open.\n"                                                                         \
+    " */\n"                                                                                    \
+    "static int\n"                                                                             \
+    "counter_find(const char *name)\n"                                                         \
+    "{\n"                                                                                      \
+    "    for (int i = 0; i < counter_count; i++) {\n"                                          \
+    "        if (strcmp(counters[i].name, name) == 0) {\n"                                     \
+    "            return i;\n"                                                                  \
+    "        }\n"                                                                              \
+    "    }\n"                                                                                  \
+    "    return -1;\n"                                                                         \
+    "}\n\n"                                                                                    \
+    "static uint64_t\n"                                                                        \
+    "now(void)\n"                                                                              \
+    "{\n"                                                                                      \
+    "    struct timespec ts;\n"                                                                \
+    "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"                                               \
+    "    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;\n"                    \
+    "}\n\n"                                                                                    \
+    "static uint64_t\n"                                                                        \
+    "cycles(void)\n"                                                                           \
+    "{\n"                                                                                      \
+    "#ifdef HAVE_RDTSC\n"                                                                      \
+    "    return __rdtsc();\n"                                                                  \
+    "#else\n"                                                                                  \
+    "    return 0;\n"                                                                          \
+    "#endif\n"                                                                                 \
+    "}\n\n"                                                                                    \
+    "/**\n"                                                                                    \
+    " * run runs the benchmark for the given number of iterations and\n"                       \
+    " * returns the elapsed nanoseconds. The elapsed cycles are stored in cyc.\n"              \
+    " */\n"                                                                                    \
+    "static uint64_t\n"                                                                        \
+    "run(bench_fn fn, uint64_t iterations, uint64_t *cyc)\n"                                   \
+    "{\n"                                                                                      \
+    "    struct bench_state state = { iterations };\n"                                         \
+    "    uint64_t start = now();\n"                                                            \
+    "    uint64_t c = cycles();\n"                                                             \
+    "    fn(&state);\n"                                                                        \
+    "    *cyc = cycles() - c;\n"                                                               \
+    "    return now() - start;\n"                                                              \
+    "}\n\n"                                                                                    \
+    "/**\n"                                                                                    \
+    " * calibrate returns the number of iterations that take about the\n"                      \
+    " * given time, doubling the count until the runs are long enough to\n"                    \
+    " * be timed reliably.\n"                                                                  \
+    " */\n"                                                                                    \
+    "static uint64_t\n"                                                                        \
+    "calibrate(bench_fn fn, uint64_t target)\n"                                                \
+    "{\n"                                                                                      \
+    "    uint64_t iterations = 1;\n"                                                           \
+    "    uint64_t cyc;\n"                                                                      \
+    "    for (;;) {\n"                                                                         \
+    "        uint64_t elapsed = run(fn, iterations, &cyc);\n"                                  \
+    "        if (elapsed >= target / 10 || iterations >= UINT64_MAX / 2) {\n"                  \
+    "            if (elapsed == 0) {\n"                                                        \
+    "                return iterations;\n"                                                     \
+    "            }\n"                                                                          \
+    "            double n = (double)iterations * target / elapsed;\n"                          \
+    "            return n < 1 ? 1 : (uint64_t)n;\n"                                            \
+    "        }\n"                                                                              \
+    "        iterations *= 2;\n"                                                               \
+    "    }\n"                                                                                  \
+    "}\n\n"                                                                                    \
+    "static int\n"                                                                             \
+    "compare(const void *a, const void *b)\n"                                                  \
+    "{\n"                                                                                      \
+    "    double x = *(const double*)a;\n"                                                      \
+    "    double y = *(const double*)b;\n"                                                      \
+    "    return (x > y) - (x < y);\n"                                                          \
+    "}\n\n"                                                                                    \
+    "static void\n"                                                                            \
+    "usage(const char *prog)\n"                                                                \
+    "{\n"                                                                                      \
+    "    fprintf(stderr,\n"                                                                    \
+    "            \"usage: %s [-f filter] [-s samples] [-t sample ms] \"\n"                     \
+    "            \"[-w warmup ms] [-j file] [-c] [-q]\\n\", prog);\n"                          \
+    "}\n\n"                                                                                    \
+    "int\n"                                                                                    \
+    "main(int argc, char **argv)\n"                                                            \
+    "{\n"                                                                                      \
+    "    const char *filter = NULL;\n"                                                         \
+    "    const char *json = NULL;\n"                                                           \
+    "    long samples = 20;\n"                                                                 \
+    "    long sample_ms = 10;\n"                                                               \
+    "    long warmup_ms = 100;\n"                                                              \
+    "    int quiet = 0;\n"                                                                     \
+    "    int collect = 0;\n\n"                                                                 \
+    "    int opt;\n"                                                                           \
+    "    while ((opt = getopt(argc, argv, \"f:s:t:w:j:cqh\")) != -1) {\n"                      \
+    "        switch (opt) {\n"                                                                 \
+    "            case 'f': filter = optarg; break;\n"                                          \
+    "            case 's': samples = strtol(optarg, NULL, 10); break;\n"                       \
+    "            case 't': sample_ms = strtol(optarg, NULL, 10); break;\n"                     \
+    "            case 'w': warmup_ms = strtol(optarg, NULL, 10); break;\n"                     \
+    "            case 'j': json = optarg; break;\n"                                            \
+    "            case 'c': collect = 1; break;\n"                                              \
+    "            case 'q': quiet = 1; break;\n"                                                \
+    "            default:\n"                                                                   \
+    "                usage(argv[0]);\n"                                                        \
+    "                return opt == 'h' ? 0 : 1;\n"                                             \
+    "        }\n"                                                                              \
+    "    }\n"                                                                                  \
+    "    if (samples < 1 || samples > MAX_SAMPLES || sample_ms < 1 ||\n"                       \
+    "        warmup_ms < 0) {\n"                                                               \
+    "        usage(argv[0]);\n"                                                                \
+    "        return 1;\n"                                                                      \
+    "    }\n\n"                                                                                \
+    "    // instructions per cycle is derived from both counters\n"                            \
+    "    int cycles_i = -1, instructions_i = -1, ipc_i = -1;\n"                                \
+    "    if (collect && counters_open(quiet) > 0) {\n"                                         \
+    "        cycles_i = counter_find(\"cycles\");\n"                                           \
+    "        instructions_i = counter_find(\"instructions\");\n"                               \
+    "        if (cycles_i >= 0 && instructions_i >= 0) {\n"                                    \
+    "            ipc_i = counter_count++;\n"                                                   \
+    "            counters[ipc_i].name = \"ipc\";\n"                                            \
+    "            counters[ipc_i].fd = -1;\n"                                                   \
+    "        }\n"                                                                              \
+    "    }\n"                                                                                  \
+    "    FILE *out = NULL;\n"                                                                  \
+    "    if (json != NULL) {\n"                                                                \
+    "        if ((out = fopen(json, \"w\")) == NULL) {\n"                                      \
+    "            perror(json);\n"                                                              \
+    "            return 1;\n"                                                                  \
+    "        }\n"                                                                              \
+    "        fprintf(out, \"{\\\"benchmarks\\\": [\");\n"                                      \
+    "    }\n\n"                                                                                \
+    "    static double ns[MAX_SAMPLES];\n"                                                     \
+    "    static double cyc[MAX_SAMPLES];\n"                                                    \
+    "    int first = 1;\n\n"                                                                   \
+    "    if (!quiet) {\n"                                                                      \
+    "        printf(\"%-32s %14s %14s %14s %12s\\n\", \"benchmark\", \"iterations\",\n"        \
+    "               \"median ns/op\", \"min ns/op\", \"cycles/op\");\n"                        \
+    "    }\n"                                                                                  \
+    "    for (int i = 0; i < benchmark_count; i++) {\n"                                        \
+    "        if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL) {\n"            \
+    "            continue;\n"                                                                  \
+    "        }\n\n"                                                                            \
+    "        bench_fn fn = benchmarks[i].fn;\n"                                                \
+    "        uint64_t iterations = calibrate(fn, (uint64_t)sample_ms * 1000000);\n\n"          \
+    "        uint64_t c;\n"                                                                    \
+    "        uint64_t until = now() + (uint64_t)warmup_ms * 1000000;\n"                        \
+    "        while (now() < until) {\n"                                                        \
+    "            run(fn, iterations, &c);\n"                                                   \
+    "        }\n\n"                                                                            \
+    "        for (long s = 0; s < samples; s++) {\n"                                           \
+    "            counters_start();\n"                                                          \
+    "            ns[s] = (double)run(fn, iterations, &c) / iterations;\n"                      \
+    "            counters_stop(s, iterations);\n"                                              \
+    "            cyc[s] = (double)c / iterations;\n"                                           \
+    "            if (ipc_i >= 0) {\n"                                                          \
+    "                double cy = counters[cycles_i].samples[s];\n"                             \
+    "                counters[ipc_i].samples[s] =\n"                                           \
+    "                    cy > 0 ? counters[instructions_i].samples[s] / cy : 0;\n"             \
+    "            }\n"                                                                          \
+    "        }\n\n"                                                                            \
+    "        if (out != NULL) {\n"                                                             \
+    "            fprintf(out, \"%s\\n  {\\\"name\\\": \\\"%s\\\", \", first ? \"\" : \",\",\n" \
+    "                    benchmarks[i].name);\n"                                               \
+    "            fprintf(out, \"\\\"iterations\\\": %llu, \\\"ns\\\": [\",\n"                  \
+    "                    (unsigned long long)iterations);\n"                                   \
+    "            for (long s = 0; s < samples; s++) {\n"                                       \
+    "                fprintf(out, \"%s%.4f\", s == 0 ? \"\" : \", \", ns[s]);\n"               \
+    "            }\n"                                                                          \
+    "            fprintf(out, \"], \\\"cycles\\\": [\");\n"                                    \
+    "            for (long s = 0; s < samples; s++) {\n"                                       \
+    "                fprintf(out, \"%s%.4f\", s == 0 ? \"\" : \", \", cyc[s]);\n"              \
+    "            }\n"                                                                          \
+    "            fprintf(out, \"]\");\n"                                                       \
+    "            for (int k = 0; k < counter_count; k++) {\n"                                  \
+    "                const char *sep = k == 0 ? \", \\\"counters\\\": {\" : \", \";\n"         \
+    "                fprintf(out, \"%s\\\"%s\\\": [\", sep, counters[k].name);\n"              \
+    "                for (long s = 0; s < samples; s++) {\n"                                   \
+    "                    fprintf(out, \"%s%.6g\", s == 0 ? \"\" : \", \",\n"                   \
+    "                            counters[k].samples[s]);\n"                                   \
+    "                }\n"                                                                      \
+    "                fprintf(out, \"]%s\", k == counter_count - 1 ? \"}\" : \"\");\n"          \
+    "            }\n"                                                                          \
+    "            fprintf(out, \"}\");\n"                                                       \
+    "        }\n"                                                                              \
+    "        first = 0;\n\n"                                                                   \
+    "        if (quiet) {\n"                                                                   \
+    "            continue;\n"                                                                  \
+    "        }\n"                                                                              \
+    "        qsort(ns, samples, sizeof(double), compare);\n"                                   \
+    "        qsort(cyc, samples, sizeof(double), compare);\n"                                  \
+    "        printf(\"%-32s %14llu %14.2f %14.2f %12.2f\\n\", benchmarks[i].name,\n"           \
+    "               (unsigned long long)iterations, ns[samples / 2], ns[0],\n"                 \
+    "               cyc[samples / 2]);\n"                                                      \
+    "        for (int k = 0; k < counter_count; k++) {\n"                                      \
+    "            qsort(counters[k].samples, samples, sizeof(double), compare);\n"              \
+    "            printf(\"    %-28s %14.4g%s\\n\", counters[k].name,\n"                        \
+    "                   counters[k].samples[samples / 2], k == ipc_i ? \"\" : \" /op\");\n"    \
+    "        }\n"                                                                              \
+    "        fflush(stdout);\n"                                                                \
+    "    }\n\n"                                                                                \
+    "    if (out != NULL) {\n"                                                                 \
+    "        fprintf(out, \"\\n]}\\n\");\n"                                                    \
+    "        fclose(out);\n"                                                                   \
+    "    }\n\n"                                                                                \
+    "    return 0;\n"                                                                          \
+    "}\n"
+
+#define BENCHMARK_BIN_TEMPLATE                                              \
+    "#include <string.h>\n\n"                                               \
+    "#include \"benchmark.h\"\n\n"                                          \
+    "// benchmarks for %1$s. Each BENCHMARK runs the code being measured\n" \
+    "// state->iterations times. Run them with make bench.\n\n"             \
+    "BENCHMARK(memset_4k)\n"                                                \
+    "{\n"                                                                   \
+    "    static char buf[4096];\n"                                          \
+    "    for (uint64_t i = 0; i < state->iterations; i++) {\n"              \
+    "        memset(buf, (int)i, sizeof(buf));\n"                           \
+    "        bench_clobber();\n"                                            \
+    "    }\n"                                                               \
+    "}\n"
+
+#define BENCHMARK_LIB_TEMPLATE                                              \
+    "#include \"benchmark.h\"\n"                                            \
+    "#include \"%1$s.h\"\n\n"                                               \
+    "// benchmarks for %1$s. Each BENCHMARK runs the code being measured\n" \
+    "// state->iterations times. Run them with make bench.\n\n"             \
+    "BENCHMARK(version)\n"                                                  \
+    "{\n"                                                                   \
+    "    for (uint64_t i = 0; i < state->iterations; i++) {\n"              \
+    "        bench_do_not_optimize(%2$s_version());\n"                      \
+    "    }\n"                                                               \
+    "}\n"
+
+/**
+ * benchmark_harness_render renders the header and the runner of the
+ * micro-benchmark harness. They contain no placeholders and are written as
+ * is.
+ */
+void
+benchmark_harness_render(FILE *header, FILE *harness)
+{
+    fputs(BENCHMARK_HEADER_TEMPLATE, header);
+    fputs(BENCHMARK_HARNESS_TEMPLATE, harness);
+}
+
+/**
+ * benchmark_bin_render renders an example benchmark for a Flotsam application.
+ */
+void
+benchmark_bin_render(FILE *fd, const char *name)
+{
+    fprintf(fd, BENCHMARK_BIN_TEMPLATE, name);
+}
+
+/**
+ * benchmark_lib_render renders a benchmark of the version function of a
+ * Flotsam library.
+ */
+void
+benchmark_lib_render(FILE *fd, const char *name, const char *prefix)
+{
+    fprintf(fd, BENCHMARK_LIB_TEMPLATE, name, prefix);
+}
+
+#endif /* _BENCHMARK_H */
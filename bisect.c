@@ -0,0 +1,548 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include <git2.h>
+
+#include "bench.h"
+#include "bisect.h"
+#include "config.h"
+#include "stats.h"
+#include "util.h"
+
+#define RESULTS_FILE BENCH_RESULTS_DIR "/" BENCH_LATEST ".json"
+#define SHORT_ID     12
+
+/**
+ * step is a commit between good and bad and, once it's
+ * been benchmarked, how it compares to good.
+ */
+struct step
+{
+    git_oid id;
+    char hex[GIT_OID_HEXSZ + 1];
+    int measured;
+    int skipped;
+    int regressed;
+    double median;
+    double delta;
+    double p;
+};
+
+/**
+ * bisect holds the state shared by every step.
+ */
+struct bisect
+{
+    git_repository *repo;
+    git_tree *baseline;
+    const char *profile;
+    const char *bench;
+    double threshold;
+    struct strbuf tree;
+    struct strbuf project;
+    double *good;
+    int good_n;
+    char *unit;
+};
+
+/**
+ * error_print prints the last libgit2 error.
+ */
+static void
+error_print(const char *what)
+{
+    const git_error *e = giterr_last();
+    fprintf(stderr, "error: %s: %s\n", what, e != NULL ? e->message : "unknown error");
+}
+
+/**
+ * resolve stores the id of the commit the revision names.
+ */
+static int
+resolve(git_repository *repo, const char *rev, git_oid *id)
+{
+    struct strbuf spec = { 0 };
+    strbuf_appendf(&spec, "%s^{commit}", rev);
+
+    git_object *commit = NULL;
+    int res = git_revparse_single(&commit, repo, spec.buf);
+    strbuf_free(&spec);
+    if (res != 0) {
+        error_print(rev);
+        return -1;
+    }
+    git_oid_cpy(id, git_object_id(commit));
+    git_object_free(commit);
+
+    return 0;
+}
+
+/**
+ * walk collects the first-parent history after good up to
+ * and including bad, oldest first.
+ */
+static int
+walk(git_repository *repo, const git_oid *good, const git_oid *bad, struct step **steps,
+     int *count)
+{
+    git_revwalk *rw = NULL;
+    if (git_revwalk_new(&rw, repo) != 0) {
+        error_print("revwalk");
+        return -1;
+    }
+    git_revwalk_sorting(rw, GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+    git_revwalk_simplify_first_parent(rw);
+    if (git_revwalk_push(rw, bad) != 0 || git_revwalk_hide(rw, good) != 0) {
+        error_print("revwalk");
+        git_revwalk_free(rw);
+        return -1;
+    }
+
+    git_oid id;
+    int res = 0;
+    while (git_revwalk_next(&id, rw) == 0) {
+        struct step *s = realloc(*steps, (*count + 1) * sizeof(struct step));
+        if (s == NULL) {
+            perror("unable to allocate memory for commits");
+            res = -1;
+            break;
+        }
+        *steps = s;
+        memset(&s[*count], 0, sizeof(struct step));
+        git_oid_cpy(&s[*count].id, &id);
+        git_oid_tostr(s[*count].hex, sizeof(s[*count].hex), &id);
+        (*count)++;
+    }
+    git_revwalk_free(rw);
+
+    return res;
+}
+
+/**
+ * checkout updates the bisect tree to the given commit.
+ * Only the files that differ from the previous commit
+ * checked out are written, so make rebuilds no more than
+ * the commit changed.
+ */
+static int
+checkout(struct bisect *b, const git_oid *id)
+{
+    git_commit *commit = NULL;
+    git_tree *tree = NULL;
+    if (git_commit_lookup(&commit, b->repo, id) != 0 || git_commit_tree(&tree, commit) != 0) {
+        error_print("commit");
+        git_commit_free(commit);
+        return -1;
+    }
+
+    git_checkout_options co_opts = GIT_CHECKOUT_OPTIONS_INIT;
+    co_opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_DONT_UPDATE_INDEX;
+    co_opts.target_directory = b->tree.buf;
+    co_opts.baseline = b->baseline;
+
+    int res = git_checkout_tree(b->repo, (git_object *)commit, &co_opts);
+    git_commit_free(commit);
+    if (res != 0) {
+        error_print("checkout");
+        git_tree_free(tree);
+        return -1;
+    }
+    git_tree_free(b->baseline);
+    b->baseline = tree;
+
+    return 0;
+}
+
+/**
+ * flotsam_in runs flotsam with the given command, profile
+ * and option, if any, in dir with its output appended to
+ * the log.
+ */
+static int
+flotsam_in(const char *dir, const char *log, const char *command, const char *profile,
+           const char *option)
+{
+    char self[PATH_MAX];
+    self_path(self, sizeof(self));
+    char *const argv[] = { self, (char *)command, "--profile", (char *)profile, (char *)option,
+                           NULL };
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int fd = open(log, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (chdir(dir) != 0) {
+            _exit(127);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/**
+ * log_path stores the path of the log of the commit in
+ * path.
+ */
+static int
+log_path(const struct step *s, char *path, size_t len)
+{
+    if (getcwd(path, len) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+    size_t cwd_len = strlen(path);
+    snprintf(path + cwd_len, len - cwd_len, "/%s/%.*s.log", BISECT_DIR, SHORT_ID, s->hex);
+
+    return 0;
+}
+
+/**
+ * measure checks out the commit, builds it with its own
+ * dependencies and runs its benchmarks. The samples of
+ * the benchmark are stored in samples. It returns 1 if
+ * the commit doesn't build or benchmark.
+ */
+static int
+measure(struct bisect *b, const struct step *s, double **samples, int *n, char **unit)
+{
+    char log[PATH_MAX];
+    if (log_path(s, log, sizeof(log)) != 0) {
+        return -1;
+    }
+    unlink(log);
+
+    if (checkout(b, &s->id) != 0) {
+        return -1;
+    }
+
+    struct strbuf results = { 0 };
+    strbuf_appendf(&results, "%s/%s", b->project.buf, RESULTS_FILE);
+    unlink(results.buf);
+
+    int res = 1;
+    if (flotsam_in(b->project.buf, log, "update", b->profile, "--missing") == 0 &&
+        flotsam_in(b->project.buf, log, "bench", b->profile, NULL) == 0 &&
+        bench_load_samples(results.buf, b->bench, samples, n, unit) == 0) {
+        res = 0;
+    }
+    strbuf_free(&results);
+
+    return res;
+}
+
+/**
+ * skip marks the commit as untestable, like git bisect
+ * skip, and prints why.
+ */
+static void
+skip(struct step *s, const char *label, const char *reason)
+{
+    char log[PATH_MAX];
+    s->skipped = 1;
+    printf("%-6s %.*s %s, skipped, see %s\n", label, SHORT_ID, s->hex, reason,
+           log_path(s, log, sizeof(log)) == 0 ? log : BISECT_DIR);
+    fflush(stdout);
+}
+
+/**
+ * evaluate benchmarks the commit, if it hasn't been yet,
+ * and compares it with good. A commit that doesn't build
+ * or benchmark comparably to good is skipped.
+ */
+static int
+evaluate(struct bisect *b, struct step *s, const char *label)
+{
+    if (s->measured || s->skipped) {
+        return 0;
+    }
+
+    double *samples = NULL;
+    char *unit = NULL;
+    int n = 0;
+    int res = measure(b, s, &samples, &n, &unit);
+    if (res < 0) {
+        return -1;
+    }
+    if (res > 0) {
+        skip(s, label, "doesn't build or benchmark");
+        return 0;
+    }
+    if (strcmp(unit, b->unit) != 0) {
+        skip(s, label, "measures in a different unit");
+        free(samples);
+        free(unit);
+        return 0;
+    }
+
+    struct stats st, gs;
+    stats_compute(samples, n, &st);
+    stats_compute(b->good, b->good_n, &gs);
+    s->median = st.median;
+    s->delta = (st.median - gs.median) / gs.median * 100;
+    s->p = stats_mann_whitney(samples, n, b->good, b->good_n);
+    s->regressed = s->delta > b->threshold && s->p < STATS_ALPHA;
+    s->measured = 1;
+
+    printf("%-6s %.*s %12.3f %-3s %+8.1f%% %8.4f  %s\n", label, SHORT_ID, s->hex, s->median, b->unit,
+           s->delta, s->p, s->regressed ? "regressed" : "ok");
+    fflush(stdout);
+    free(samples);
+    free(unit);
+
+    return 0;
+}
+
+/**
+ * next_step returns the untested commit in [lo, hi)
+ * closest to the middle, or -1 if only skipped commits
+ * are left.
+ */
+static int
+next_step(const struct step *steps, int lo, int hi)
+{
+    int mid = lo + (hi - lo) / 2;
+    for (int d = 0; mid - d >= lo || mid + d < hi; d++) {
+        if (mid + d < hi && !steps[mid + d].skipped) {
+            return mid + d;
+        }
+        if (mid - d >= lo && !steps[mid - d].skipped) {
+            return mid - d;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * open_repo opens the repository of the project and sets
+ * up the bisect tree, with the path of the project within
+ * it, which differs if the project isn't at the root of
+ * the repository.
+ */
+static int
+open_repo(struct bisect *b)
+{
+    char cwd[PATH_MAX];
+    if (realpath(".", cwd) == NULL) {
+        perror("realpath");
+        return -1;
+    }
+
+    if (git_repository_open_ext(&b->repo, ".", 0, NULL) != 0 ||
+        git_repository_workdir(b->repo) == NULL) {
+        fprintf(stderr, "error: the project isn't in a git repository with a working tree\n");
+        return -1;
+    }
+
+    // the working directory ends in a slash, the project's
+    // path within the repository starts with one
+    const char *workdir = git_repository_workdir(b->repo);
+    size_t wlen = strlen(workdir) - 1;
+    const char *prefix = strncmp(cwd, workdir, wlen) == 0 ? cwd + wlen : "";
+
+    strbuf_appendf(&b->tree, "%s/%s", cwd, BISECT_TREE);
+    strbuf_appendf(&b->project, "%s%s", b->tree.buf, prefix);
+
+    if (remove_tree(b->tree.buf) != 0 || mkdir_p(b->tree.buf, 0755) != 0) {
+        perror(b->tree.buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * parse_threshold parses a threshold in percent with an
+ * optional percent sign, e.g. 5%. Without one the
+ * threshold of the bench section is used.
+ */
+static int
+parse_threshold(const char *value, double *threshold)
+{
+    if (value == NULL) {
+        struct bench_config bc;
+        if (bench_load_config(&bc) != 0) {
+            return -1;
+        }
+        free(bc.command);
+        *threshold = bc.threshold;
+        return 0;
+    }
+
+    char *end;
+    *threshold = strtod(value, &end);
+    if (end == value || (*end != '\0' && strcmp(end, "%") != 0) || *threshold < 0) {
+        fprintf(stderr, "error: invalid threshold: %s\n", value);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+bisect_perf(const struct profile *profile, const char *good, const char *bad, const char *bench,
+            const char *threshold)
+{
+    struct bisect b = { 0 };
+    b.profile = profile != NULL ? profile->name : BENCH_PROFILE;
+    b.bench = bench;
+    if (parse_threshold(threshold, &b.threshold) != 0) {
+        return 1;
+    }
+
+    struct step *steps = NULL;
+    struct step base = { 0 };
+    git_oid good_id, bad_id;
+    int count = 0, res = 1;
+
+    if (open_repo(&b) != 0 || resolve(b.repo, good, &good_id) != 0 ||
+        resolve(b.repo, bad, &bad_id) != 0 || walk(b.repo, &good_id, &bad_id, &steps, &count) != 0) {
+        goto out;
+    }
+    if (count == 0) {
+        fprintf(stderr, "error: %s isn't a descendant of %s\n", bad, good);
+        goto out;
+    }
+
+    printf("bisecting %d commits between %s and %s, %s profile, threshold %.1f%%\n", count, good,
+           bad, b.profile, b.threshold);
+    printf("logs: %s\n\n", BISECT_DIR);
+    fflush(stdout);
+
+    git_oid_cpy(&base.id, &good_id);
+    git_oid_tostr(base.hex, sizeof(base.hex), &good_id);
+    if (measure(&b, &base, &b.good, &b.good_n, &b.unit) != 0) {
+        char log[PATH_MAX];
+        fprintf(stderr, "error: %s doesn't build or benchmark, see %s\n", good,
+                log_path(&base, log, sizeof(log)) == 0 ? log : BISECT_DIR);
+        goto out;
+    }
+    struct stats gs;
+    stats_compute(b.good, b.good_n, &gs);
+    printf("%-6s %.*s %12.3f %-3s\n", "good", SHORT_ID, base.hex, gs.median, b.unit);
+    fflush(stdout);
+
+    if (evaluate(&b, &steps[count - 1], "bad") != 0) {
+        goto out;
+    }
+    if (steps[count - 1].skipped) {
+        fprintf(stderr, "error: %s can't be tested\n", bad);
+        goto out;
+    }
+    if (!steps[count - 1].regressed) {
+        printf("\n%s isn't significantly slower than %s by more than %.1f%%\n", bad, good,
+               b.threshold);
+        goto out;
+    }
+
+    // the last commit is known to be regressed, find the
+    // first one assuming the regression stays once it's in
+    int lo = 0, hi = count - 1, mid;
+    while (lo < hi && (mid = next_step(steps, lo, hi)) >= 0) {
+        if (evaluate(&b, &steps[mid], "step") != 0) {
+            goto out;
+        }
+        if (steps[mid].skipped) {
+            continue;
+        }
+        if (steps[mid].regressed) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    // only skipped commits are left before the first
+    // regressed one tested, any of them may be the culprit
+    if (lo < hi) {
+        printf("\nonly skipped commits are left, the first regressed commit is one of:\n");
+        for (int i = lo; i <= hi; i++) {
+            git_commit *commit = NULL;
+            const char *summary = "";
+            if (git_commit_lookup(&commit, b.repo, &steps[i].id) == 0 &&
+                git_commit_summary(commit) != NULL) {
+                summary = git_commit_summary(commit);
+            }
+            printf("%s %s\n", steps[i].hex, summary);
+            git_commit_free(commit);
+        }
+        goto out;
+    }
+
+    struct step *first = &steps[hi];
+    git_commit *commit = NULL;
+    const char *summary = "";
+    if (git_commit_lookup(&commit, b.repo, &first->id) == 0 && git_commit_summary(commit) != NULL) {
+        summary = git_commit_summary(commit);
+    }
+    printf("\nfirst regressed commit: %s %s\n", first->hex, summary);
+    printf("%s: %.3f %s -> %.3f %s, %+.1f%% (p %.4f)\n", bench != NULL ? bench : "benchmark",
+           gs.median, b.unit, first->median, b.unit, first->delta, first->p);
+    git_commit_free(commit);
+    res = 0;
+
+out:
+    remove_tree(BISECT_TREE);
+    git_tree_free(b.baseline);
+    git_repository_free(b.repo);
+    strbuf_free(&b.tree);
+    strbuf_free(&b.project);
+    free(b.good);
+    free(b.unit);
+    free(steps);
+
+    return res;
+}
@@ -0,0 +1,60 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BISECT_H
+#define _BISECT_H
+
+#include "config.h"
+
+/**
+ * BISECT_DIR holds the checkout the commits are built in
+ * and a log of the build and benchmark of every commit.
+ */
+#define BISECT_DIR  ".flotsam/bisect"
+#define BISECT_TREE ".flotsam/bisect/tree"
+
+/**
+ * bisect_perf finds the first commit between good and bad that makes the
+ * named benchmark slower than at good by more than the threshold in percent.
+ * The first-parent history is walked with libgit2 and every commit tested is
+ * checked out into BISECT_TREE, replacing the previous one in place, so
+ * make's objects and the dependency cache carry over between steps. Each
+ * commit is built with its own config and lock file and benchmarked with
+ * flotsam bench under the given profile. A commit is regressed if its median
+ * is slower by more than the threshold and the difference is significant.
+ * The first regressed commit is reported with its delta. Commits that don't
+ * build or benchmark are skipped, like git bisect skip, and if only skipped
+ * commits are left the range that may hold the regression is reported
+ * instead. The threshold may end in a percent sign and defaults to the one
+ * of the bench section. 1 is returned if bad isn't regressed, the first
+ * regressed commit can't be told apart from skipped ones or a step fails.
+ */
+int
+bisect_perf(const struct profile *profile, const char *good, const char *bad, const char *bench,
+            const char *threshold);
+
+#endif /* _BISECT_H */
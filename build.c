@@ -0,0 +1,589 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "amalgamate.h"
+#include "build.h"
+#include "config.h"
+#include "dependency.h"
+#include "lock.h"
+#include "manifest.h"
+#include "sysroot.h"
+#include "toolchain.h"
+#include "util.h"
+
+#define BINDIR            "bin"
+#define REPORT_DIR        ".flotsam/link-report"
+#define STARTUP_RUNS      51
+#define LIB_PREFIX        "lib"
+#define A_EXT             ".a"
+
+#define ALLOCATOR_STATIC_LIBS "-lpthread -lm"
+
+// MAKE_VARS_RULE is evaluated by make to print the
+// variables the project's Makefile compiles with
+#define MAKE_VARS_TARGET "__flotsam_vars"
+#define MAKE_VARS_RULE   MAKE_VARS_TARGET ": ; @$(info $(CC))$(info $(CFLAGS))$(info $(LDFLAGS)):"
+
+// binaries in bin and the micro-benchmarks in build/bench
+// both find the project's libraries
+#ifdef __APPLE__
+#define GC_SECTIONS_LDFLAGS "-Wl,-dead_strip"
+#define RPATH_LDFLAGS       "-Wl,-rpath,@loader_path/../" PROJECT_LIB_DIR \
+                            " -Wl,-rpath,@loader_path/../../" PROJECT_LIB_DIR
+#define ALLOCATOR_LINK_FMT  "-l%s"
+#else
+#define GC_SECTIONS_LDFLAGS "-Wl,--gc-sections"
+// the $ is escaped for both make and the shell running the recipe
+#define RPATH_LDFLAGS       "-Wl,-rpath,\\$$ORIGIN/../" PROJECT_LIB_DIR \
+                            " -Wl,-rpath,\\$$ORIGIN/../../" PROJECT_LIB_DIR
+#define ALLOCATOR_LINK_FMT  "-Wl,--push-state,--no-as-needed -l%s -Wl,--pop-state"
+#endif
+
+/**
+ * any_static returns 1 if the project or any of its
+ * dependencies is linked statically.
+ */
+static int
+any_static(const struct dependencies *deps)
+{
+    if (config_get_link() == LINK_STATIC) {
+        return 1;
+    }
+    for (int i = 0; i < deps->count; i++) {
+        if (config_dependency_link(&deps->dependencies[i]) == LINK_STATIC) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * flags holds the compiler flags, linker flags and
+ * libraries needed to build against the dependencies.
+ */
+struct flags
+{
+    struct strbuf cflags;
+    struct strbuf ldflags;
+    struct strbuf ldlibs;
+};
+
+/**
+ * flags_free frees the memory held by the flags.
+ */
+static void
+flags_free(struct flags *f)
+{
+    strbuf_free(&f->cflags);
+    strbuf_free(&f->ldflags);
+    strbuf_free(&f->ldlibs);
+}
+
+/**
+ * build_flags fills in the compiler and linker flags
+ * needed to build against the project's dependencies.
+ * With amalgamated set, dependencies compiled into the
+ * amalgamation aren't linked.
+ */
+static void
+build_flags(const struct profile *profile, struct flags *f, int amalgamated)
+{
+    struct dependencies *deps = config_get_dependencies();
+
+    strbuf_append(&f->cflags, profile != NULL ? profile->cflags : "");
+    strbuf_append(&f->ldflags, profile != NULL ? profile->ldflags : "");
+    strbuf_append(&f->ldlibs, "");
+    toolchain_profile_flags(profile, &f->cflags, &f->ldflags);
+
+    if (any_static(deps)) {
+        strbuf_appendf(&f->cflags, " %s", STATIC_CFLAGS);
+        strbuf_appendf(&f->ldflags, " %s", GC_SECTIONS_LDFLAGS);
+    }
+    if (deps->count > 0) {
+        strbuf_appendf(&f->cflags, " -I%s", SYSROOT_INCLUDE_DIR);
+        strbuf_appendf(&f->ldflags, " -L%s %s", PROJECT_LIB_DIR, RPATH_LDFLAGS);
+    }
+
+    for (int i = 0; i < deps->count; i++) {
+        struct dependency *dep = &deps->dependencies[i];
+        if (amalgamated && config_dependency_amalgamate(dep)) {
+            continue;
+        }
+
+        char *artifacts = dependency_artifact_path(dep, profile);
+        char *lib_name = dependency_lib_name(dep->name);
+
+        // the archive is named explicitly so the linker can't
+        // pick up a shared object of the same name instead
+        if (config_dependency_link(dep) == LINK_STATIC) {
+            strbuf_appendf(&f->ldlibs, " %s/%s%s%s", artifacts, LIB_PREFIX, lib_name, A_EXT);
+            if (dep->allocator) {
+                strbuf_append(&f->ldlibs, " " ALLOCATOR_STATIC_LIBS);
+            }
+        } else if (dep->allocator) {
+            // nothing calls into the allocator by name so it
+            // has to be kept even with --as-needed
+            strbuf_appendf(&f->ldlibs, " " ALLOCATOR_LINK_FMT, lib_name);
+        } else {
+            strbuf_appendf(&f->ldlibs, " -l%s", lib_name);
+        }
+
+        free(artifacts);
+        free(lib_name);
+    }
+}
+
+/**
+ * write_mk writes the make fragment with the resolved
+ * flags for Makefiles to include.
+ */
+static int
+write_mk(const struct profile *profile, struct flags *f)
+{
+    struct strbuf mk = { 0 };
+
+    strbuf_appendf(&mk,
+                   "# Generated by flotsam from %s. Do not edit.\n\n"
+                   "FLOTSAM_PROFILE := %s\n"
+                   "FLOTSAM_CFLAGS  := %s\n"
+                   "FLOTSAM_LDFLAGS := %s\n"
+                   "FLOTSAM_LDLIBS  := %s\n\n"
+                   "override CFLAGS  += $(FLOTSAM_CFLAGS)\n"
+                   "override LDFLAGS += $(FLOTSAM_LDFLAGS) $(FLOTSAM_LDLIBS)\n",
+                   FLOTSAM_LOCK_FILE, profile != NULL ? profile->name : "",
+                   f->cflags.buf, f->ldflags.buf, f->ldlibs.buf);
+
+    int res = write_file_if_changed(BUILD_MK_FILE, mk.buf);
+    strbuf_free(&mk);
+
+    return res;
+}
+
+/**
+ * write_pc writes a pkg-config file describing the
+ * dependencies for tools outside of make.
+ */
+static int
+write_pc(struct flags *f)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+
+    if (mkdir_p(BUILD_PC_DIR, 0755) != 0) {
+        perror(BUILD_PC_DIR);
+        return -1;
+    }
+
+    struct strbuf pc = { 0 };
+    strbuf_appendf(&pc,
+                   "prefix=%s/deps\n"
+                   "includedir=%s/%s\n"
+                   "libdir=%s/%s\n\n"
+                   "Name: %s-deps\n"
+                   "Description: Dependencies of %s resolved by flotsam\n"
+                   "Version: %s\n"
+                   "Cflags: -I${includedir}\n"
+                   "Libs: -L${libdir} -Wl,-rpath,${libdir}%s\n",
+                   cwd, cwd, SYSROOT_INCLUDE_DIR, cwd, PROJECT_LIB_DIR,
+                   config_get_name(), config_get_name(),
+                   config_get_version() != NULL ? config_get_version() : "0.0.0",
+                   f->ldlibs.buf);
+
+    int res = write_file_if_changed(BUILD_PC_DIR "/flotsam.pc", pc.buf);
+    strbuf_free(&pc);
+
+    return res;
+}
+
+int
+build_update(const struct profile *profile, int missing_only)
+{
+    struct dependencies *deps = config_get_dependencies();
+
+    if (dependency_update_all(profile, missing_only) != 0) {
+        return 1;
+    }
+    if (lock_write(deps) != 0 || sysroot_update(deps) != 0 ||
+        build_generate(profile) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int
+build_generate(const struct profile *profile)
+{
+    struct flags f = { 0 };
+
+    build_flags(profile, &f, 0);
+    int res = write_mk(profile, &f);
+    if (res == 0) {
+        res = write_pc(&f);
+    }
+    flags_free(&f);
+
+    return res;
+}
+
+/**
+ * includes_mk returns 1 if the project's Makefile already
+ * includes the generated make fragment.
+ */
+static int
+includes_mk()
+{
+    size_t len = 0;
+    char *makefile = read_file("Makefile", &len);
+    if (makefile == NULL) {
+        return 0;
+    }
+
+    int found = strstr(makefile, BUILD_MK_FILE) != NULL;
+    free(makefile);
+
+    return found;
+}
+
+/**
+ * build_prepare makes sure the installed libraries,
+ * header tree and generated files match the profile
+ * before the project's build runs.
+ */
+static int
+build_prepare(const struct profile *profile)
+{
+    // make sure the project's lib dir holds the libraries
+    // of the profile being built
+    struct dependencies *deps = config_get_dependencies();
+    for (int i = 0; i < deps->count; i++) {
+        if (dependency_install(&deps->dependencies[i], profile) != 0) {
+            return 1;
+        }
+    }
+
+    if (deps->count > 0) {
+        if (access(FLOTSAM_LOCK_FILE, F_OK) != 0 && lock_write(deps) != 0) {
+            return 1;
+        }
+        if (sysroot_update(deps) != 0) {
+            return 1;
+        }
+    }
+
+    return build_generate(profile) != 0 ? 1 : 0;
+}
+
+/**
+ * build_command fills in the project's build command
+ * with the extra make arguments, if any.
+ */
+static void
+build_command(const struct profile *profile, const char *make_args, int amalgamated,
+              struct strbuf *build_cmd)
+{
+    strbuf_append(build_cmd, config_get_build());
+    toolchain_export();
+    if (toolchain_make_args()[0] != '\0') {
+        strbuf_appendf(build_cmd, " %s", toolchain_make_args());
+    }
+    if (make_args != NULL) {
+        strbuf_appendf(build_cmd, " %s", make_args);
+    }
+
+    struct flags f = { 0 };
+    build_flags(profile, &f, amalgamated);
+
+    // Makefiles that don't include the fragment get the
+    // flags on the command line instead
+    if (!includes_mk()) {
+        strbuf_appendf(build_cmd, " CFLAGS+='%s' LDFLAGS+='%s%s'",
+                       f.cflags.buf, f.ldflags.buf, f.ldlibs.buf);
+    } else if (amalgamated) {
+        strbuf_appendf(build_cmd, " FLOTSAM_LDLIBS='%s'", f.ldlibs.buf);
+    }
+    flags_free(&f);
+}
+
+/**
+ * build_run runs the project's build command with the
+ * extra make arguments, if any, or builds the
+ * amalgamation.
+ */
+static int
+build_run(const struct profile *profile, const char *make_args)
+{
+    if (config_get_amalgamate()) {
+        return amalgamate_build(profile);
+    }
+
+    struct strbuf build_cmd = { 0 };
+    build_command(profile, make_args, 0, &build_cmd);
+
+    int res = system(build_cmd.buf) == 0 ? 0 : 1;
+    strbuf_free(&build_cmd);
+
+    return res;
+}
+
+/**
+ * read_line returns the next line of the stream without
+ * its newline or NULL at the end. The returned string
+ * needs to be freed by the caller.
+ */
+static char*
+read_line(FILE *fp)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, fp);
+    if (n < 0) {
+        free(line);
+        return NULL;
+    }
+    if (n > 0 && line[n - 1] == '\n') {
+        line[n - 1] = '\0';
+    }
+
+    return line;
+}
+
+int
+build_make_vars(const struct profile *profile, char **cc, char **cflags, char **ldflags)
+{
+    struct strbuf cmd = { 0 };
+    build_command(profile, "-s --no-print-directory --eval '" MAKE_VARS_RULE "' " MAKE_VARS_TARGET,
+                  1, &cmd);
+
+    FILE *fp = popen(cmd.buf, "r");
+    strbuf_free(&cmd);
+    if (fp == NULL) {
+        perror("popen");
+        return -1;
+    }
+
+    *cc = read_line(fp);
+    *cflags = read_line(fp);
+    *ldflags = read_line(fp);
+
+    if (pclose(fp) != 0 || *cc == NULL || *cflags == NULL || *ldflags == NULL) {
+        fprintf(stderr, "error: unable to read CC, CFLAGS and LDFLAGS from the Makefile\n");
+        free(*cc);
+        free(*cflags);
+        free(*ldflags);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+build_project(const struct profile *profile)
+{
+    return build_project_with(profile, NULL);
+}
+
+int
+build_project_with(const struct profile *profile, const char *make_args)
+{
+    if (build_prepare(profile) != 0) {
+        return 1;
+    }
+    return build_run(profile, make_args);
+}
+
+char*
+build_output()
+{
+    struct strbuf sb = { 0 };
+
+    if (config_get_type() != NULL && strcmp(config_get_type(), "bin") == 0) {
+        strbuf_appendf(&sb, "%s/%s", BINDIR, config_get_name());
+    } else {
+        strbuf_append(&sb, "");
+    }
+
+    return sb.buf;
+}
+
+int
+build_recorded(const struct profile *profile, uint64_t key)
+{
+    if (build_prepare(profile) != 0) {
+        return 1;
+    }
+
+    char *output = build_output();
+    struct manifest m;
+    int recorded = manifest_snapshot(&m, key, output) == 0;
+    free(output);
+
+    int res = build_run(profile, NULL);
+    if (res == 0 && recorded) {
+        manifest_save(&m);
+    }
+    manifest_free(&m);
+
+    return res;
+}
+
+void
+build_clean()
+{
+    struct strbuf cmd = { 0 };
+    strbuf_appendf(&cmd, "%s clean > /dev/null 2>&1", config_get_build());
+    system(cmd.buf);
+    strbuf_free(&cmd);
+}
+
+/**
+ * cmp_u64 compares 2 uint64_t values for qsort.
+ */
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * measure_startup runs the binary repeatedly and returns
+ * the median wall clock time of a run in nanoseconds, or
+ * 0 if a run fails, e.g. since a library can't be loaded.
+ */
+static uint64_t
+measure_startup(char *binary)
+{
+    uint64_t samples[STARTUP_RUNS];
+    char *argv[] = { binary, NULL };
+
+    for (int i = 0; i < STARTUP_RUNS; i++) {
+        if (run_timed(argv, &samples[i]) != 0) {
+            return 0;
+        }
+    }
+    qsort(samples, STARTUP_RUNS, sizeof(uint64_t), cmp_u64);
+
+    return samples[STARTUP_RUNS / 2];
+}
+
+int
+build_link_report(const struct profile *profile)
+{
+    static const struct {
+        enum link_mode link;
+        const char *name;
+    } modes[] = {
+        { LINK_DYNAMIC, "dynamic" },
+        { LINK_STATIC,  "static"  },
+    };
+
+    off_t sizes[2] = { 0 };
+    uint64_t startup[2] = { 0 };
+    int res = 0;
+
+    if (mkdir_p(REPORT_DIR, 0700) != 0) {
+        perror(REPORT_DIR);
+        return -1;
+    }
+
+    char binary[PATH_MAX];
+    snprintf(binary, PATH_MAX, "%s/%s", BINDIR, config_get_name());
+
+    for (int i = 0; i < 2; i++) {
+        config_set_link(modes[i].link);
+        build_clean();
+
+        if (dependency_update_all(profile, 1) != 0 || build_project(profile) != 0) {
+            fprintf(stderr, "error: %s build failed\n", modes[i].name);
+            res = 1;
+            break;
+        }
+
+        // keep a copy since the project's build may clean bin
+        char copy[PATH_MAX];
+        snprintf(copy, PATH_MAX, "%s/%s.%s", REPORT_DIR, config_get_name(), modes[i].name);
+        if (copy_file(binary, copy) != 0) {
+            perror(binary);
+            res = 1;
+            break;
+        }
+
+        struct stat s;
+        stat(copy, &s);
+        sizes[i] = s.st_size;
+        startup[i] = measure_startup(copy);
+        if (startup[i] == 0) {
+            fprintf(stderr, "warning: the %s binary exits with an error, startup isn't measured\n",
+                    modes[i].name);
+        }
+    }
+
+    config_set_link(LINK_DEFAULT);
+    if (res != 0) {
+        return res;
+    }
+
+    printf("%-10s %14s %16s\n", "link", "size (bytes)", "startup (us)");
+    for (int i = 0; i < 2; i++) {
+        if (startup[i] > 0) {
+            printf("%-10s %14lld %16.1f\n", modes[i].name, (long long)sizes[i],
+                   (double)startup[i] / 1000.0);
+        } else {
+            printf("%-10s %14lld %16s\n", modes[i].name, (long long)sizes[i], "-");
+        }
+    }
+    if (sizes[0] > 0 && startup[0] > 0 && startup[1] > 0) {
+        printf("\nstatic is %.1f%% the size and starts in %.1f%% the time of dynamic\n",
+               100.0 * (double)sizes[1] / (double)sizes[0],
+               100.0 * (double)startup[1] / (double)startup[0]);
+    }
+
+    // leave the binary for the configured link mode in place
+    char copy[PATH_MAX];
+    snprintf(copy, PATH_MAX, "%s/%s.%s", REPORT_DIR, config_get_name(),
+             config_get_link() == LINK_STATIC ? "static" : "dynamic");
+
+    return copy_file(copy, binary);
+}
@@ -0,0 +1,115 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BUILD_H
+#define _BUILD_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+/**
+ * BUILD_MK_FILE is the make fragment holding the resolved dependency flags.
+ * Makefiles include it to build without flotsam in the loop.
+ */
+#define BUILD_MK_FILE "flotsam.mk"
+
+/**
+ * BUILD_PC_DIR holds flotsam.pc, the pkg-config file describing the
+ * project's dependencies.
+ */
+#define BUILD_PC_DIR "deps/pkgconfig"
+
+/**
+ * build_generate writes BUILD_MK_FILE and the pkg-config file for the given
+ * profile. Neither is touched if its contents haven't changed.
+ */
+int
+build_generate(const struct profile *profile);
+
+/**
+ * build_update updates the project's dependencies, Flotsam.lock, the header
+ * tree and the generated files. With missing_only set, dependencies already
+ * built for the profile are left alone.
+ */
+int
+build_update(const struct profile *profile, int missing_only);
+
+/**
+ * build_project runs the project's build command with the flags of the given
+ * profile, which may be NULL, and the include and library flags of every
+ * dependency. The flags come from BUILD_MK_FILE if the project's Makefile
+ * includes it and are passed on the command line otherwise.
+ */
+int
+build_project(const struct profile *profile);
+
+/**
+ * build_project_with is build_project with extra arguments, e.g. variable
+ * overrides, appended to the build command.
+ */
+int
+build_project_with(const struct profile *profile, const char *make_args);
+
+/**
+ * build_make_vars asks the project's Makefile for the CC, CFLAGS and LDFLAGS
+ * it builds with given the profile's flags, leaving out the libraries of
+ * amalgamated dependencies. The strings need to be freed by the caller.
+ */
+int
+build_make_vars(const struct profile *profile, char **cc, char **cflags, char **ldflags);
+
+/**
+ * build_recorded runs build_project and records the build's inputs in the
+ * manifest under the given key so an unchanged project can skip the next
+ * build entirely.
+ */
+int
+build_recorded(const struct profile *profile, uint64_t key);
+
+/**
+ * build_clean runs the project's clean target so the next build starts from
+ * scratch. Its output and failure are ignored.
+ */
+void
+build_clean();
+
+/**
+ * build_output returns the path of the binary the project builds or an empty
+ * string for libraries. The returned string needs to be freed by the caller.
+ */
+char*
+build_output();
+
+/**
+ * build_link_report builds the project linked dynamically and statically and
+ * prints the binary size and startup time of each.
+ */
+int
+build_link_report(const struct profile *profile);
+
+#endif /* _BUILD_H */
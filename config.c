@@ -25,6 +25,7 @@
  * SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdlib.h> 
 #include <string.h>
 #include <sys/stat.h>
@@ -34,23 +35,423 @@
 #include <jansson.h>
 
 #include "config.h"
+#include "toolchain.h"
 
 #define FLOTSAM_CONFIG_FILE "Flotsam.json"
 
-static json_t *conf;
-static json_t *package_table;
-static json_t *dependency_table;
-static json_t *authors_key;
+/**
+ * default_profiles are always available and can be
+ * overridden by a profile of the same name in the
+ * "profiles" section of Flotsam.json.
+ */
+static const struct profile default_profiles[] = {
+    { "debug",   "-O0 -g3",                          "",                  NULL, 0, NULL },
+    { "release", "-O3 -DNDEBUG",                     "",                  NULL, 0, NULL },
+    { "native",  "-O3 -march=native -DNDEBUG",       "",                  NULL, 0, NULL },
+    { "size",    "-Os -DNDEBUG",                     "-Wl,--gc-sections", NULL, 0, NULL },
+};
+
+/**
+ * allocators are the malloc replacements that can be
+ * selected with "allocator" in the package section.
+ * They're built like any other dependency but with
+ * their own build commands.
+ */
+static const struct {
+    const char *name;
+    const char *repo;
+    const char *vers;
+    const char *build;
+    const char *libs;
+} allocators[] = {
+    { "jemalloc", "github.com/jemalloc/jemalloc.git", "5.3.0",
+      "./autogen.sh --disable-doc > /dev/null && make clean && make build_lib", "lib" },
+    { "mimalloc", "github.com/microsoft/mimalloc.git", "v2.1.7",
+      "rm -rf out && cmake -S . -B out -DCMAKE_BUILD_TYPE=Release -DMI_BUILD_TESTS=OFF && "
+      "cmake --build out", "out" },
+};
+
+// linkers can be selected with "linker" in a profile
+static const char *linkers[] = { "mold", "lld", "gold", "bfd" };
 
 static struct config *config;
 
-static const char *name = {0};
-static const char *type = {0};
-static const char *build = {0};
-static const char *repository = {0};
-static const char *version = {0};
-static const char *description = {0};
-static const char *homepage = {0};
+// link_override is set by config_set_link and wins over
+// the link mode given in Flotsam.json.
+static enum link_mode link_override = LINK_DEFAULT;
+
+// amalgamate_override is set by config_set_amalgamate.
+static int amalgamate_override = 0;
+
+// user_cc is $CC as flotsam was started with, restored
+// when a profile without its own compiler is selected.
+static char *user_cc = NULL;
+static int user_cc_saved = 0;
+
+/**
+ * json_strdup returns a copy of the string stored at
+ * key in the given object or NULL if not present.
+ */
+static char*
+json_strdup(json_t *obj, const char *key)
+{
+    json_t *val = json_object_get(obj, key);
+    if (!json_is_string(val)) {
+        return NULL;
+    }
+    return strdup(json_string_value(val));
+}
+
+/**
+ * parse_link converts the "link" value at key in the
+ * given object. It returns -1 if the value is invalid.
+ */
+static int
+parse_link(json_t *obj, enum link_mode *link)
+{
+    json_t *val = json_object_get(obj, "link");
+    if (val == NULL) {
+        *link = LINK_DEFAULT;
+        return 0;
+    }
+
+    const char *s = json_string_value(val);
+    if (s != NULL && strcmp(s, "static") == 0) {
+        *link = LINK_STATIC;
+        return 0;
+    }
+    if (s != NULL && strcmp(s, "dynamic") == 0) {
+        *link = LINK_DYNAMIC;
+        return 0;
+    }
+
+    fprintf(stderr, "error: link must be \"static\" or \"dynamic\"\n");
+    return -1;
+}
+
+/**
+ * parse_amalgamate converts the optional "amalgamate"
+ * boolean in the given object.
+ */
+static int
+parse_amalgamate(json_t *obj, enum amalgamate_mode *mode)
+{
+    json_t *val = json_object_get(obj, "amalgamate");
+    if (val == NULL) {
+        *mode = AMALGAMATE_DEFAULT;
+        return 0;
+    }
+    if (!json_is_boolean(val)) {
+        fprintf(stderr, "error: amalgamate must be true or false\n");
+        return -1;
+    }
+
+    *mode = json_is_true(val) ? AMALGAMATE_ON : AMALGAMATE_OFF;
+    return 0;
+}
+
+/**
+ * parse_lto converts the optional "lto" boolean in the
+ * given object.
+ */
+static int
+parse_lto(json_t *obj, enum lto_mode *lto)
+{
+    json_t *val = json_object_get(obj, "lto");
+    if (val == NULL) {
+        *lto = LTO_DEFAULT;
+        return 0;
+    }
+    if (!json_is_boolean(val)) {
+        fprintf(stderr, "error: lto must be true or false\n");
+        return -1;
+    }
+
+    *lto = json_is_true(val) ? LTO_ON : LTO_OFF;
+    return 0;
+}
+
+/**
+ * parse_hwcaps converts the "hwcaps" array of ISA levels
+ * in the given object to a bit set of HWCAPS_LEVELS. It
+ * returns -1 if a level is unknown.
+ */
+static int
+parse_hwcaps(json_t *obj, int *hwcaps)
+{
+    static const char *levels[] = HWCAPS_LEVELS;
+
+    *hwcaps = 0;
+
+    size_t i;
+    json_t *val;
+    json_array_foreach(json_object_get(obj, "hwcaps"), i, val) {
+        const char *s = json_string_value(val);
+        int found = 0;
+        for (int j = 0; s != NULL && j < HWCAPS_LEVEL_COUNT; j++) {
+            if (strcmp(s, levels[j]) == 0) {
+                *hwcaps |= 1 << j;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "error: hwcaps must be x86-64-v2, x86-64-v3 or x86-64-v4\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * profile_add adds a profile or replaces the settings
+ * of an existing profile with the same name.
+ */
+static int
+profile_add(const struct profile *profile)
+{
+    struct profiles *ps = config->profiles;
+    struct profile *p = NULL;
+
+    for (int i = 0; i < ps->count; i++) {
+        if (strcmp(ps->profiles[i].name, profile->name) == 0) {
+            p = &ps->profiles[i];
+            free(p->cflags);
+            free(p->ldflags);
+            free(p->linker);
+            free(p->cc);
+            break;
+        }
+    }
+
+    if (p == NULL) {
+        p = realloc(ps->profiles, (ps->count + 1) * sizeof(struct profile));
+        if (p == NULL) {
+            perror("unable to allocate memory for profile");
+            return -1;
+        }
+        ps->profiles = p;
+        p = &ps->profiles[ps->count++];
+        p->name = strdup(profile->name);
+    }
+
+    p->cflags = strdup(profile->cflags ? profile->cflags : "");
+    p->ldflags = strdup(profile->ldflags ? profile->ldflags : "");
+    p->linker = profile->linker ? strdup(profile->linker) : NULL;
+    p->split_dwarf = profile->split_dwarf;
+    p->cc = profile->cc ? strdup(profile->cc) : NULL;
+
+    return 0;
+}
+
+/**
+ * valid_linker returns 1 if the given linker is one
+ * flotsam knows how to select.
+ */
+static int
+valid_linker(const char *name)
+{
+    for (size_t i = 0; i < sizeof(linkers) / sizeof(linkers[0]); i++) {
+        if (strcmp(linkers[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * parse_profiles loads the built-in profiles followed
+ * by any defined in the "profiles" object.
+ */
+static int
+parse_profiles(json_t *root)
+{
+    config->profiles = calloc(1, sizeof(struct profiles));
+    if (config->profiles == NULL) {
+        perror("unable to allocate memory for profiles");
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(default_profiles) / sizeof(default_profiles[0]); i++) {
+        if (profile_add(&default_profiles[i]) != 0) {
+            return -1;
+        }
+    }
+
+    json_t *profiles_obj = json_object_get(root, "profiles");
+    if (profiles_obj == NULL) {
+        return 0;
+    }
+    if (!json_is_object(profiles_obj)) {
+        fprintf(stderr, "error: profiles is not an object\n");
+        return -1;
+    }
+
+    const char *key;
+    json_t *value;
+    json_object_foreach(profiles_obj, key, value) {
+        if (!json_is_object(value)) {
+            fprintf(stderr, "error: profile %s is not an object\n", key);
+            return -1;
+        }
+        struct profile p = {
+            .name = (char *)key,
+            .cflags = (char *)json_string_value(json_object_get(value, "cflags")),
+            .ldflags = (char *)json_string_value(json_object_get(value, "ldflags")),
+            .linker = (char *)json_string_value(json_object_get(value, "linker")),
+            .split_dwarf = json_is_true(json_object_get(value, "split_dwarf")),
+            .cc = (char *)json_string_value(json_object_get(value, "cc")),
+        };
+        if (p.linker != NULL && !valid_linker(p.linker)) {
+            fprintf(stderr, "error: profile %s: linker must be mold, lld, gold or bfd\n", key);
+            return -1;
+        }
+        if (profile_add(&p) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * parse_dependencies loads the "dependencies" array.
+ */
+static int
+parse_dependencies(json_t *root)
+{
+    json_t *dependencies_obj = json_object_get(root, "dependencies");
+    if (!json_is_array(dependencies_obj)) {
+        fprintf(stderr, "error: dependencies_obj is not an array\n");
+        return -1;
+    }
+
+    config->dependencies = calloc(1, sizeof(struct dependencies));
+    if (config->dependencies == NULL) {
+        perror("unable to allocate memory for dependencies");
+        return -1;
+    }
+
+    size_t array_size = json_array_size(dependencies_obj);
+    if (array_size == 0) {
+        return 0;
+    }
+
+    config->dependencies->dependencies = calloc(array_size, sizeof(struct dependency));
+    if (config->dependencies->dependencies == NULL) {
+        perror("unable to allocate memory for dependencies");
+        return -1;
+    }
+
+    for (size_t i = 0; i < array_size; i++) {
+        json_t *item = json_array_get(dependencies_obj, i);
+        if (!json_is_object(item)) {
+            fprintf(stderr, "error: dependency item is not an object\n");
+            return -1;
+        }
+
+        struct dependency *dep = &config->dependencies->dependencies[i];
+        dep->name = json_strdup(item, "name");
+        dep->vers = json_strdup(item, "version");
+        config->dependencies->count++;
+
+        if (dep->name == NULL || dep->vers == NULL) {
+            fprintf(stderr, "error: dependency requires a name and version\n");
+            return -1;
+        }
+        if (parse_link(item, &dep->link) != 0 || parse_hwcaps(item, &dep->hwcaps) != 0 ||
+            parse_lto(item, &dep->lto) != 0 || parse_amalgamate(item, &dep->amalgamate) != 0) {
+            return -1;
+        }
+        dep->build = json_strdup(item, "build");
+        dep->libs = json_strdup(item, "libs");
+        dep->profile = json_strdup(item, "profile");
+        dep->cflags = json_strdup(item, "cflags");
+        dep->ldflags = json_strdup(item, "ldflags");
+    }
+
+    return 0;
+}
+
+/**
+ * dependency_free frees the strings of a dependency.
+ */
+static void
+dependency_free(struct dependency *dep)
+{
+    free(dep->name);
+    free(dep->vers);
+    free(dep->build);
+    free(dep->libs);
+    free(dep->profile);
+    free(dep->cflags);
+    free(dep->ldflags);
+}
+
+int
+config_allocator_dependency(const char *name, struct dependency *dep)
+{
+    size_t len = strcspn(name, "@");
+
+    for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+        if (strlen(allocators[i].name) != len || strncmp(allocators[i].name, name, len) != 0) {
+            continue;
+        }
+
+        memset(dep, 0, sizeof(struct dependency));
+        dep->name = strdup(allocators[i].repo);
+        dep->vers = strdup(name[len] == '@' ? name + len + 1 : allocators[i].vers);
+        dep->build = strdup(allocators[i].build);
+        dep->libs = strdup(allocators[i].libs);
+        dep->allocator = 1;
+
+        return 0;
+    }
+
+    return -1;
+}
+
+int
+config_set_allocator(const char *name)
+{
+    struct dependencies *deps = config->dependencies;
+    struct dependency dep;
+
+    if (name != NULL && strcmp(name, SYSTEM_ALLOCATOR) != 0 &&
+        config_allocator_dependency(name, &dep) != 0) {
+        return -1;
+    }
+
+    // the allocator is always the last dependency
+    if (deps->count > 0 && deps->dependencies[deps->count - 1].allocator) {
+        dependency_free(&deps->dependencies[--deps->count]);
+    }
+    free(config->allocator);
+    config->allocator = NULL;
+
+    if (name == NULL || strcmp(name, SYSTEM_ALLOCATOR) == 0) {
+        return 0;
+    }
+
+    struct dependency *d = realloc(deps->dependencies,
+                                   (deps->count + 1) * sizeof(struct dependency));
+    if (d == NULL) {
+        perror("unable to allocate memory for dependencies");
+        dependency_free(&dep);
+        return -1;
+    }
+    deps->dependencies = d;
+    deps->dependencies[deps->count++] = dep;
+    config->allocator = strdup(name);
+
+    return 0;
+}
+
+char*
+config_get_allocator()
+{
+    return config->allocator;
+}
 
 int
 config_init()
@@ -59,10 +460,9 @@ config_init()
         return 0;
     }
 
-    config = calloc(1, sizeof(struct config));
-    if (config == NULL) {
-        perror("unable to allocate memory for config");
-        return -1;
+    if (!user_cc_saved) {
+        user_cc = getenv("CC") != NULL ? strdup(getenv("CC")) : NULL;
+        user_cc_saved = 1;
     }
 
     if (access(FLOTSAM_CONFIG_FILE, F_OK)) {
@@ -70,61 +470,78 @@ config_init()
         return -1;
     }
 
+    config = calloc(1, sizeof(struct config));
+    if (config == NULL) {
+        perror("unable to allocate memory for config");
+        return -1;
+    }
+
     json_error_t error;
 
     json_t *root = json_load_file(FLOTSAM_CONFIG_FILE, 0, &error);
     if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", FLOTSAM_CONFIG_FILE, error.line, error.text);
+        config_free();
         return 1;
     }
 
-    const char *name_obj;
-    const char *type_obj;
-    const char *build_obj;
-    const char *repository_obj;
-    const char *version_obj;
-    const char *description_obj;
-    const char *homepage_obj;
+    json_t *package = json_object_get(root, "package");
+    if (!json_is_object(package)) {
+        fprintf(stderr, "error: package is not an object\n");
+        json_decref(root);
+        config_free();
+        return 1;
+    }
 
-    json_unpack(root, "{s: {s:s, s:s, s:s, s:s, s:s, s:s, s:s}}",
-                "package",
-                "name", &name_obj, "type", &type_obj, "build", &build_obj,
-                "repository", &repository_obj, "version", &version_obj,
-                "description", &description_obj, "homepage", &homepage_obj);
+    config->name = json_strdup(package, "name");
+    config->type = json_strdup(package, "type");
+    config->build = json_strdup(package, "build");
+    config->repository = json_strdup(package, "repository");
+    config->pkg_ver = json_strdup(package, "version");
+    config->description = json_strdup(package, "description");
+    config->homepage = json_strdup(package, "homepage");
+    config->profile = json_strdup(package, "profile");
 
-    json_t *dependencies_obj = json_object_get(root, "dependencies");
-    if (!json_is_array(dependencies_obj)) {
-        fprintf(stderr, "error: dependencies_obj is not an array\n");
+    if (config->name == NULL || config->build == NULL) {
+        fprintf(stderr, "error: package requires a name and build command\n");
         json_decref(root);
+        config_free();
         return 1;
     }
 
-    size_t array_size = json_array_size(dependencies_obj);
-    for (size_t i = 0; i < array_size; i++) {
-        json_t *item = json_array_get(dependencies_obj, i);
-        if (!json_is_object(item)) {
-            fprintf(stderr, "error: dependency item is not an object\n");
+    if (parse_link(package, &config->link) != 0 ||
+        parse_dependencies(root) != 0 || parse_profiles(root) != 0) {
+        json_decref(root);
+        config_free();
+        return 1;
+    }
+
+    for (int i = 0; i < config->dependencies->count; i++) {
+        struct dependency *dep = &config->dependencies->dependencies[i];
+        if (dep->profile != NULL && config_find_profile(dep->profile) == NULL) {
+            fprintf(stderr, "error: unknown profile %s for %s\n", dep->profile, dep->name);
             json_decref(root);
+            config_free();
             return 1;
         }
-
-        const char *name;
-        const char *version;
-
-        json_unpack(item, "{s:s, s:s}", "name", &name, "version", &version);
-
-        printf("Name: %s, Version: %s\n", name, version);
     }
 
-    printf("Package:\n");
-    printf("    name:        %s\n", name_obj);
-    printf("    description: %s\n", description_obj);
-    printf("    version:     %s\n", version_obj);
-    printf("    build:       %s\n", build_obj);
-    printf("    respository: %s\n", repository_obj);
-    printf("    homepage:    %s\n", homepage_obj);
+    const char *allocator = json_string_value(json_object_get(package, "allocator"));
+    if (allocator != NULL && config_set_allocator(allocator) != 0) {
+        fprintf(stderr, "error: unknown allocator: %s\n", allocator);
+        json_decref(root);
+        config_free();
+        return 1;
+    }
 
     json_decref(root);
 
+    if (config->profile != NULL && config_set_profile(config->profile) != 0) {
+        fprintf(stderr, "error: unknown profile: %s\n", config->profile);
+        config_free();
+        return 1;
+    }
+
     return 0;
 }
 
@@ -134,6 +551,24 @@ config_get_build()
     return config->build;
 }
 
+char*
+config_get_type()
+{
+    return config->type;
+}
+
+char*
+config_get_version()
+{
+    return config->pkg_ver;
+}
+
+char*
+config_get_name()
+{
+    return config->name;
+}
+
 void
 config_free()
 {
@@ -143,18 +578,65 @@ config_free()
     if (config->dependencies != NULL) {
         if (config->dependencies->dependencies != NULL) {
             for (int i = 0; i < config->dependencies->count; i++) {
-                if (config->dependencies->dependencies[i].name != NULL) {
-                    free(config->dependencies->dependencies[i].name);
-                }
-                if (config->dependencies->dependencies[i].vers != NULL) {
-                    free(config->dependencies->dependencies[i].vers);
-                }
+                dependency_free(&config->dependencies->dependencies[i]);
             }
             free(config->dependencies->dependencies);
         }
         free(config->dependencies);
     }
+    if (config->profiles != NULL) {
+        for (int i = 0; i < config->profiles->count; i++) {
+            free(config->profiles->profiles[i].name);
+            free(config->profiles->profiles[i].cflags);
+            free(config->profiles->profiles[i].ldflags);
+            free(config->profiles->profiles[i].linker);
+            free(config->profiles->profiles[i].cc);
+        }
+        free(config->profiles->profiles);
+        free(config->profiles);
+    }
+    free(config->name);
+    free(config->type);
+    free(config->build);
+    free(config->repository);
+    free(config->pkg_ver);
+    free(config->description);
+    free(config->homepage);
+    free(config->profile);
+    free(config->allocator);
     free(config);
+    config = NULL;
+}
+
+int
+config_reload(const char *profile)
+{
+    struct config *prev = config;
+
+    config = NULL;
+    if (config_init() != 0) {
+        config = prev;
+        if (config->profile != NULL) {
+            config_set_profile(config->profile);
+        }
+        return -1;
+    }
+    if (profile != NULL && config_set_profile(profile) != 0) {
+        fprintf(stderr, "error: unknown profile: %s\n", profile);
+        config_free();
+        config = prev;
+        if (config->profile != NULL) {
+            config_set_profile(config->profile);
+        }
+        return -1;
+    }
+
+    struct config *next = config;
+    config = prev;
+    config_free();
+    config = next;
+
+    return 0;
 }
 
 struct dependencies*
@@ -163,12 +645,131 @@ config_get_dependencies()
     return config->dependencies;
 }
 
+struct profiles*
+config_get_profiles()
+{
+    return config->profiles;
+}
+
 int
 config_dependency_count()
 {
     return config->dependencies->count;
 }
 
+int
+config_set_profile(const char *name)
+{
+    for (int i = 0; i < config->profiles->count; i++) {
+        if (strcmp(config->profiles->profiles[i].name, name) == 0) {
+            if (config->profile != name) {
+                free(config->profile);
+                config->profile = strdup(name);
+            }
+            config_apply_cc(&config->profiles->profiles[i]);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void
+config_apply_cc(const struct profile *profile)
+{
+    const char *cc = profile != NULL && profile->cc != NULL ? profile->cc : user_cc;
+    const char *current = getenv("CC");
+    if ((cc == NULL && current == NULL) ||
+        (cc != NULL && current != NULL && strcmp(cc, current) == 0)) {
+        return;
+    }
+
+    if (cc != NULL) {
+        setenv("CC", cc, 1);
+    } else {
+        unsetenv("CC");
+    }
+    toolchain_reset();
+}
+
+struct profile*
+config_find_profile(const char *name)
+{
+    for (int i = 0; i < config->profiles->count; i++) {
+        if (strcmp(config->profiles->profiles[i].name, name) == 0) {
+            return &config->profiles->profiles[i];
+        }
+    }
+    return NULL;
+}
+
+struct profile*
+config_get_profile()
+{
+    if (config == NULL || config->profile == NULL) {
+        return NULL;
+    }
+    return config_find_profile(config->profile);
+}
+
+void
+config_set_link(enum link_mode link)
+{
+    link_override = link;
+}
+
+enum link_mode
+config_get_link()
+{
+    if (link_override != LINK_DEFAULT) {
+        return link_override;
+    }
+    if (config != NULL && config->link != LINK_DEFAULT) {
+        return config->link;
+    }
+    return LINK_DYNAMIC;
+}
+
+enum link_mode
+config_dependency_link(const struct dependency *dep)
+{
+    if (link_override == LINK_DEFAULT && dep->link != LINK_DEFAULT) {
+        return dep->link;
+    }
+    return config_get_link();
+}
+
+void
+config_set_amalgamate(int amalgamate)
+{
+    amalgamate_override = amalgamate;
+}
+
+int
+config_get_amalgamate()
+{
+    if (amalgamate_override) {
+        return 1;
+    }
+
+    struct dependencies *deps = config->dependencies;
+    for (int i = 0; i < deps->count; i++) {
+        if (config_dependency_amalgamate(&deps->dependencies[i])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+config_dependency_amalgamate(const struct dependency *dep)
+{
+    if (dep->allocator || dep->amalgamate == AMALGAMATE_OFF) {
+        return 0;
+    }
+    return dep->amalgamate == AMALGAMATE_ON || amalgamate_override;
+}
+
 int
 config_print()
 {
@@ -177,12 +778,15 @@ config_print()
     }
 
     printf("Package:\n");
-    printf("    name:        %s\n", name);
-    printf("    description: %s\n", description);
-    printf("    version:     %s\n", version);
-    printf("    build:       %s\n", build);
-    printf("    respository: %s\n", repository);
-    printf("    homepage:    %s\n", homepage);
+    printf("    name:        %s\n", config->name);
+    printf("    description: %s\n", config->description ? config->description : "");
+    printf("    version:     %s\n", config->pkg_ver ? config->pkg_ver : "");
+    printf("    build:       %s\n", config->build);
+    printf("    respository: %s\n", config->repository ? config->repository : "");
+    printf("    homepage:    %s\n", config->homepage ? config->homepage : "");
+    printf("    profile:     %s\n", config->profile ? config->profile : "");
+    printf("    link:        %s\n", config_get_link() == LINK_STATIC ? "static" : "dynamic");
+    printf("    allocator:   %s\n", config->allocator ? config->allocator : SYSTEM_ALLOCATOR);
     // printf("    authors:     ");
     // for (int i = 0; i < config->author_count; i++) {
     //     if (config->author_count > 1) {
@@ -209,7 +813,43 @@ config_print_dependencies()
         return -1;
     }
     for (int i = 0; i < config->dependencies->count; i++) {
-        printf("%s - %s\n", config->dependencies->dependencies[i].name, config->dependencies->dependencies[i].vers);
+        struct dependency *dep = &config->dependencies->dependencies[i];
+        printf("%s - %s\n", dep->name, dep->vers);
+        if (dep->profile != NULL) {
+            printf("    profile: %s\n", dep->profile);
+        }
+        if (dep->cflags != NULL) {
+            printf("    cflags:  %s\n", dep->cflags);
+        }
+        if (dep->ldflags != NULL) {
+            printf("    ldflags: %s\n", dep->ldflags);
+        }
+        if (dep->lto != LTO_DEFAULT) {
+            printf("    lto:     %s\n", dep->lto == LTO_ON ? "true" : "false");
+        }
+    }
+    return 0;
+}
+
+int
+config_print_profiles()
+{
+    if (config == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < config->profiles->count; i++) {
+        struct profile *p = &config->profiles->profiles[i];
+        printf("%-10s cflags: %s\n", p->name, p->cflags);
+        printf("%-10s ldflags: %s\n", "", p->ldflags);
+        if (p->cc != NULL) {
+            printf("%-10s cc:      %s\n", "", p->cc);
+        }
+        if (p->linker != NULL) {
+            printf("%-10s linker:  %s\n", "", p->linker);
+        }
+        if (p->split_dwarf) {
+            printf("%-10s split-dwarf\n", "");
+        }
     }
     return 0;
 }
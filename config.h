@@ -28,14 +28,70 @@
 #ifndef _CONFIG_H
 #define _CONFIG_H
 
+// SYSTEM_ALLOCATOR names the libc allocator
+#define SYSTEM_ALLOCATOR "system"
+
+// HWCAPS_LEVELS are the x86-64 ISA levels dependencies can
+// also be built for, named like glibc's hwcaps directories
+#define HWCAPS_LEVELS      { "x86-64-v2", "x86-64-v3", "x86-64-v4" }
+#define HWCAPS_LEVEL_COUNT 3
+
+/**
+ * link_mode is how dependencies are linked into the
+ * project's binary.
+ */
+enum link_mode {
+    LINK_DEFAULT,
+    LINK_DYNAMIC,
+    LINK_STATIC
+};
+
+/**
+ * amalgamate_mode is whether a dependency's sources are
+ * compiled into the project's amalgamation instead of
+ * being linked.
+ */
+enum amalgamate_mode {
+    AMALGAMATE_DEFAULT,
+    AMALGAMATE_ON,
+    AMALGAMATE_OFF
+};
+
+/**
+ * lto_mode is whether a dependency is built with link
+ * time optimization regardless of the profile.
+ */
+enum lto_mode {
+    LTO_DEFAULT,
+    LTO_ON,
+    LTO_OFF
+};
+
 /**
  * dependency represents a single dependency
- * containing a name and a version.
+ * containing a name and a version. build and
+ * libs, if set, replace the project's build
+ * command and the directory the libraries end
+ * up in for dependencies that aren't built
+ * with make. hwcaps has bit i set for every
+ * HWCAPS_LEVELS entry to build a variant for.
+ * profile, cflags, ldflags and lto override the
+ * project's profile for this dependency alone.
  */
 struct dependency
 {
     char* name;
     char* vers;
+    enum link_mode link;
+    char* build;
+    char* libs;
+    int hwcaps;
+    char* profile;
+    char* cflags;
+    char* ldflags;
+    enum lto_mode lto;
+    enum amalgamate_mode amalgamate;
+    int allocator;
 };
 
 /**
@@ -48,6 +104,33 @@ struct dependencies
     struct dependency *dependencies;
 };
 
+/**
+ * profile is a named set of compiler and linker flags
+ * applied to the project and every dependency build,
+ * along with the linker to use, NULL for the default,
+ * whether debug info is split out of the objects and
+ * the compiler to use, NULL for $CC.
+ */
+struct profile
+{
+    char *name;
+    char *cflags;
+    char *ldflags;
+    char *linker;
+    int split_dwarf;
+    char *cc;
+};
+
+/**
+ * profiles contains all profiles available to the
+ * project, built-in ones included.
+ */
+struct profiles
+{
+    int count;
+    struct profile *profiles;
+};
+
 /**
  * config contains all settings to run flotsam.
  */
@@ -63,6 +146,10 @@ struct config
     char *repository;
     char *homepage;
     struct dependencies *dependencies;
+    struct profiles *profiles;
+    char *profile;
+    enum link_mode link;
+    char *allocator;
 };
 
 /**
@@ -74,6 +161,25 @@ config_init();
 char*
 config_get_build();
 
+/**
+ * config_get_type returns the package type, "bin" or "lib".
+ */
+char*
+config_get_type();
+
+/**
+ * config_get_version returns the package version.
+ */
+char*
+config_get_version();
+
+/**
+ * config_get_name returns the package name which is also the name of the
+ * binary built into bin.
+ */
+char*
+config_get_name();
+
 /**
  * config_print prints the current configuration from a valid Flotsam.toml
  * file.
@@ -94,12 +200,27 @@ config_print_dependencies();
 void
 config_free();
 
+/**
+ * config_reload parses Flotsam.json again and selects the named profile, if
+ * given, in the new configuration. The current configuration is only
+ * replaced once both succeed; on failure it's kept, along with its selected
+ * profile, and -1 is returned.
+ */
+int
+config_reload(const char *profile);
+
 /**
  * config_get_dependencies
  */
 struct dependencies*
 config_get_dependencies();
 
+/**
+ * config_get_profiles returns every profile available to the project.
+ */
+struct profiles*
+config_get_profiles();
+
 /**
  * config_dependency_count returns the total number of dependencies in the
  * current project.
@@ -107,4 +228,108 @@ config_get_dependencies();
 int
 config_dependency_count();
 
+/**
+ * config_set_profile selects the named profile for the rest of the run and
+ * applies its compiler with config_apply_cc. It returns -1 if no such profile
+ * exists.
+ */
+int
+config_set_profile(const char *name);
+
+/**
+ * config_apply_cc sets CC to the profile's compiler, or back to the CC
+ * flotsam was started with if the profile doesn't name one or is NULL. The
+ * cached toolchain is dropped whenever CC changes.
+ */
+void
+config_apply_cc(const struct profile *profile);
+
+/**
+ * config_find_profile returns the named profile or NULL if there's no such
+ * profile.
+ */
+struct profile*
+config_find_profile(const char *name);
+
+/**
+ * config_get_profile returns the selected profile. Without an explicit
+ * selection the package's "profile" setting is used and if that's absent
+ * too, NULL is returned and builds use their own defaults.
+ */
+struct profile*
+config_get_profile();
+
+/**
+ * config_set_link overrides the link mode of the project and every
+ * dependency for the rest of the run. LINK_DEFAULT removes the override.
+ */
+void
+config_set_link(enum link_mode link);
+
+/**
+ * config_get_link returns the project's link mode, either LINK_DYNAMIC or
+ * LINK_STATIC.
+ */
+enum link_mode
+config_get_link();
+
+/**
+ * config_dependency_link returns the link mode of the given dependency. A
+ * dependency's own "link" setting wins over the project's.
+ */
+enum link_mode
+config_dependency_link(const struct dependency *dep);
+
+/**
+ * config_set_amalgamate makes every dependency without its own "amalgamate"
+ * setting part of the amalgamation for the rest of the run.
+ */
+void
+config_set_amalgamate(int amalgamate);
+
+/**
+ * config_get_amalgamate returns 1 if the project is built as an
+ * amalgamation, either because config_set_amalgamate was called or because
+ * a dependency asks for it.
+ */
+int
+config_get_amalgamate();
+
+/**
+ * config_dependency_amalgamate returns 1 if the dependency's sources are
+ * compiled into the amalgamation. A dependency's own "amalgamate" setting
+ * wins. Allocators are always linked.
+ */
+int
+config_dependency_amalgamate(const struct dependency *dep);
+
+/**
+ * config_get_allocator returns the name of the allocator the project links
+ * or NULL for the system allocator.
+ */
+char*
+config_get_allocator();
+
+/**
+ * config_set_allocator replaces the project's allocator for the rest of the
+ * run, NULL or "system" meaning the system allocator. It returns -1 if the
+ * allocator is unknown.
+ */
+int
+config_set_allocator(const char *name);
+
+/**
+ * config_allocator_dependency fills in dep to build the named allocator,
+ * given as <name> or <name>@<version>. The strings in dep need to be freed by
+ * the caller. It returns -1 if the allocator is unknown.
+ */
+int
+config_allocator_dependency(const char *name, struct dependency *dep);
+
+/**
+ * config_print_profiles prints the available profiles.
+ */
+int
+config_print_profiles();
+
 #endif /* _CONFIG_H */
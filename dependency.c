@@ -27,11 +27,14 @@
 
 #include <dirent.h>
 #include <git2.h>
+#include <inttypes.h>
 #include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #ifdef __linux__
 #include <linux/limits.h>
 #else
@@ -41,20 +44,37 @@
 
 #include "config.h"
 #include "dependency.h"
+#include "toolchain.h"
+#include "util.h"
 
 #define DEP_CACHE_PATH    "/.flotsam/"
+#define ARTIFACT_PATH     "/.flotsam/build/"
+#define DEFAULT_PROFILE   "default"
+#define STATIC_SUFFIX     "-static"
 #define PATH_SEPERATOR    "/"
 #define ULR_PREFIX_HTTPS  "https://"
 #define ULR_PREFIX_GIT    "git@"
 #define VERSION_SEPERATOR "@"
 #define MAX_URL_LEN       2048
 #define REFS_HEAD         "refs/heads/"
+#define LIB_PREFIX        "lib"
+#define GIT_EXT           ".git"
 
 #define GIT_ERROR_PRINT printf("error %d/%d: %s\n", res, e->klass, e->message)
 
 #define DYLIB_EXT ".dylib"
 #define SO_EXT    ".so"
-#define LIB_PATH  "/usr/local/lib/"
+#define A_EXT     ".a"
+
+// HWCAPS_DIR is where glibc's loader looks for libraries
+// built for a newer ISA level than the baseline
+#define HWCAPS_DIR "glibc-hwcaps"
+
+static const char* hwcaps_levels[] = HWCAPS_LEVELS;
+
+// hwcaps_skip aren't copied into the trees hwcaps
+// variants are built in
+static const char* hwcaps_skip[] = { ".git" };
 
 /**
  * build_dependency_path returns the full path of the
@@ -143,60 +163,806 @@ clone(const char* dep, const char* ver)
 }
 
 int
-dependency_update(const char* dep, const char* ver)
+dependency_commit(const struct dependency* dep, char* out, size_t len)
 {
-    char* path = build_dependency_path(dep, ver);
+    char* path = build_dependency_path(dep->name, dep->vers);
+    if (path == NULL) {
+        return -1;
+    }
+
+    git_repository* repo = NULL;
+    int res = git_repository_open(&repo, path);
+    free(path);
+    if (res != 0) {
+        const git_error* e = giterr_last();
+        GIT_ERROR_PRINT;
+        return -1;
+    }
+
+    char spec[300];
+    snprintf(spec, sizeof(spec), "%s^{commit}", dep->vers);
 
-    int res = clone(dep, ver);
+    git_object* commit = NULL;
+    res = git_revparse_single(&commit, repo, spec);
     if (res != 0) {
+        const git_error* e = giterr_last();
+        GIT_ERROR_PRINT;
+        git_repository_free(repo);
         return -1;
     }
-    chdir(path);
+    git_oid_tostr(out, len, git_object_id(commit));
+
+    git_object_free(commit);
+    git_repository_free(repo);
+
+    return 0;
+}
+
+char*
+dependency_path(const char* dep, const char* ver)
+{
+    return build_dependency_path(dep, ver);
+}
+
+char*
+dependency_lib_name(const char* dep)
+{
+    const char* base = strrchr(dep, '/');
+    base = base != NULL ? base + 1 : dep;
+
+    if (strncmp(base, LIB_PREFIX, strlen(LIB_PREFIX)) == 0) {
+        base += strlen(LIB_PREFIX);
+    }
+
+    char* name = strdup(base);
+    if (name == NULL) {
+        return NULL;
+    }
+
+    char* ext = strrchr(name, '.');
+    if (ext != NULL && (strcmp(ext, GIT_EXT) == 0 || strcmp(ext, ".h") == 0)) {
+        *ext = '\0';
+    }
+
+    return name;
+}
 
-    char* build_cmd = config_get_build();
-    build_cmd = realloc(build_cmd, 24);
-    strcat(build_cmd, " > /dev/null 2>&1");
-    if (system(build_cmd) != 0) {
+/**
+ * dependency_profile returns the profile the dependency
+ * is built with, its own if it names one.
+ */
+static const struct profile*
+dependency_profile(const struct dependency* dep, const struct profile* profile)
+{
+    if (dep->profile != NULL) {
+        return config_find_profile(dep->profile);
+    }
+    return profile;
+}
+
+/**
+ * has_overrides returns 1 if the dependency changes the
+ * flags of its profile.
+ */
+static int
+has_overrides(const struct dependency* dep)
+{
+    return dep->cflags != NULL || dep->ldflags != NULL || dep->lto != LTO_DEFAULT;
+}
+
+char*
+dependency_artifact_path(const struct dependency* dep, const struct profile* profile)
+{
+    struct strbuf sb = { 0 };
+
+    profile = dependency_profile(dep, profile);
+    strbuf_appendf(&sb, "%s%s%s%s%s%s%s", getenv("HOME"), ARTIFACT_PATH, dep->name,
+                   VERSION_SEPERATOR, dep->vers, PATH_SEPERATOR,
+                   profile != NULL ? profile->name : DEFAULT_PROFILE);
+
+    // projects defining a profile of the same name with
+    // other flags, like tune's candidates, each get their
+    // own artifacts
+    if (profile != NULL) {
+        uint64_t h = hash_str(HASH_SEED, profile->cflags != NULL ? profile->cflags : "");
+        h = hash_str(h, profile->ldflags != NULL ? profile->ldflags : "");
+        h = hash_str(h, profile->linker != NULL ? profile->linker : "");
+        h = hash_bytes(h, &profile->split_dwarf, sizeof(profile->split_dwarf));
+        strbuf_appendf(&sb, "-p%016" PRIx64, h);
+    }
+
+    // projects overriding the flags of the same version
+    // each get their own artifacts
+    if (has_overrides(dep)) {
+        uint64_t h = hash_str(HASH_SEED, dep->cflags != NULL ? dep->cflags : "");
+        h = hash_str(h, dep->ldflags != NULL ? dep->ldflags : "");
+        h = hash_bytes(h, &dep->lto, sizeof(dep->lto));
+        strbuf_appendf(&sb, "-x%016" PRIx64, h);
+    }
+
+    // static builds are compiled with per function sections
+    // so they can't share artifacts with dynamic ones
+    if (config_dependency_link(dep) == LINK_STATIC) {
+        strbuf_append(&sb, STATIC_SUFFIX);
+    }
+
+    // artifacts of one compiler can't be reused by another
+    const struct toolchain* tc = toolchain_get();
+    if (tc != NULL) {
+        strbuf_appendf(&sb, "-%016" PRIx64, tc->hash);
+    }
+
+    return sb.buf;
+}
+
+/**
+ * is_library returns 1 if the given file name looks like
+ * a shared object or static archive.
+ */
+static int
+is_library(const char* name)
+{
+    if (strstr(name, SO_EXT) != NULL || strstr(name, DYLIB_EXT) != NULL) {
         return 1;
     }
 
+    size_t len = strlen(name);
+    return len > strlen(A_EXT) && strcmp(name + len - strlen(A_EXT), A_EXT) == 0;
+}
+
+/**
+ * append_env appends the given flags to the environment
+ * variable, keeping whatever the user already set. The
+ * previous value is returned so it can be restored and
+ * needs to be freed by the caller.
+ */
+static char*
+append_env(const char* var, const char* flags)
+{
+    char* prev = getenv(var) != NULL ? strdup(getenv(var)) : NULL;
+    if (flags == NULL || flags[0] == '\0') {
+        return prev;
+    }
+
+    struct strbuf sb = { 0 };
+    if (prev != NULL && prev[0] != '\0') {
+        strbuf_appendf(&sb, "%s ", prev);
+    }
+    strbuf_append(&sb, flags);
+    setenv(var, sb.buf, 1);
+    strbuf_free(&sb);
+
+    return prev;
+}
+
+/**
+ * restore_env resets the environment variable to the
+ * value returned by append_env.
+ */
+static void
+restore_env(const char* var, char* prev)
+{
+    if (prev != NULL) {
+        setenv(var, prev, 1);
+        free(prev);
+        return;
+    }
+    unsetenv(var);
+}
+
+/**
+ * has_library returns 1 if a shared object or static
+ * archive exists in the given directory.
+ */
+static int
+has_library(const char* path)
+{
+    DIR* dp;
+    struct dirent* dirp;
+    int found = 0;
+
+    if ((dp = opendir(path)) == NULL) {
+        return 0;
+    }
+    while ((dirp = readdir(dp)) != NULL) {
+        if (is_library(dirp->d_name)) {
+            found = 1;
+            break;
+        }
+    }
+    closedir(dp);
+
+    return found;
+}
+
+/**
+ * has_archive returns 1 if a static archive exists in
+ * the given directory.
+ */
+static int
+has_archive(const char* path)
+{
+    DIR* dp;
+    struct dirent* dirp;
+    int found = 0;
+
+    if ((dp = opendir(path)) == NULL) {
+        return 0;
+    }
+    while ((dirp = readdir(dp)) != NULL) {
+        if (is_library(dirp->d_name) && strstr(dirp->d_name, SO_EXT) == NULL &&
+            strstr(dirp->d_name, DYLIB_EXT) == NULL) {
+            found = 1;
+            break;
+        }
+    }
+    closedir(dp);
+
+    return found;
+}
+
+/**
+ * has_objects returns 1 if an object file exists in the
+ * given directory.
+ */
+static int
+has_objects(const char* path)
+{
+    DIR* dp;
+    struct dirent* dirp;
+    int found = 0;
+
+    if ((dp = opendir(path)) == NULL) {
+        return 0;
+    }
+    while ((dirp = readdir(dp)) != NULL) {
+        size_t len = strlen(dirp->d_name);
+        if (len > 2 && strcmp(dirp->d_name + len - 2, ".o") == 0) {
+            found = 1;
+            break;
+        }
+    }
+    closedir(dp);
+
+    return found;
+}
+
+/**
+ * archive creates lib<name>.a for dependencies whose build
+ * only produces a shared object. The objects are taken
+ * from the libs directory, or the top of the checkout if
+ * there are none, and the archive is written to the libs
+ * directory, where store picks it up.
+ */
+static int
+archive(const struct dependency* dep)
+{
+    const char* libs = dep->libs != NULL ? dep->libs : ".";
+    if (has_archive(libs)) {
+        return 0;
+    }
+
+    const char* objs = has_objects(libs) ? libs : ".";
+    if (!has_objects(objs)) {
+        fprintf(stderr, "error: no static archive or objects found for %s\n", dep->name);
+        return -1;
+    }
+
+    char* lib_name = dependency_lib_name(dep->name);
+    if (lib_name == NULL) {
+        return -1;
+    }
+
+    struct strbuf cmd = { 0 };
+    strbuf_appendf(&cmd, "ar rcs '%s%s%s%s%s' '%s'%s*.o > /dev/null 2>&1", libs, PATH_SEPERATOR,
+                   LIB_PREFIX, lib_name, A_EXT, objs, PATH_SEPERATOR);
+    int res = system(cmd.buf) == 0 ? 0 : -1;
+    strbuf_free(&cmd);
+
+    if (res != 0) {
+        fprintf(stderr, "error: unable to archive the objects of %s\n", dep->name);
+    }
+    free(lib_name);
+
+    return res;
+}
+
+/**
+ * build runs the dependency's build command, or the
+ * project's if it has none, in the current directory.
+ * The profile's flags, the dependency's own and then
+ * extra_cflags, if any, are passed through the
+ * environment which Makefiles pick up with "+=" or "?="
+ * without losing the flags they need themselves.
+ */
+static int
+build(const struct dependency* dep, const struct profile* profile, const char* extra_cflags)
+{
+    struct strbuf cmd = { 0 };
+    struct strbuf cflags = { 0 };
+    struct strbuf ldflags = { 0 };
+    int res = 0;
+
+    // start from a clean tree so objects from another
+    // profile aren't linked into this one, custom build
+    // commands take care of that themselves
+    const char* build_cmd = dep->build != NULL ? dep->build : config_get_build();
+    if (dep->build == NULL) {
+        strbuf_appendf(&cmd, "%s clean > /dev/null 2>&1", build_cmd);
+        system(cmd.buf);
+        strbuf_free(&cmd);
+    }
+
+    strbuf_append(&cflags, profile != NULL ? profile->cflags : "");
+    strbuf_append(&ldflags, profile != NULL ? profile->ldflags : "");
+    toolchain_profile_flags(profile, &cflags, &ldflags);
+    if (config_dependency_link(dep) == LINK_STATIC) {
+        strbuf_appendf(&cflags, " %s", STATIC_CFLAGS);
+    }
+
+    // the dependency's own flags come last so they win
+    if (dep->cflags != NULL) {
+        strbuf_appendf(&cflags, " %s", dep->cflags);
+    }
+    if (dep->ldflags != NULL) {
+        strbuf_appendf(&ldflags, " %s", dep->ldflags);
+    }
+    if (dep->lto == LTO_ON && toolchain_supports("-flto")) {
+        strbuf_append(&cflags, " -flto");
+        strbuf_append(&ldflags, " -flto");
+    } else if (dep->lto == LTO_OFF) {
+        strbuf_append(&cflags, " -fno-lto");
+        strbuf_append(&ldflags, " -fno-lto");
+    }
+    if (extra_cflags != NULL) {
+        strbuf_appendf(&cflags, " %s", extra_cflags);
+    }
+
+    char* prev_cflags = append_env("CFLAGS", cflags.buf);
+    char* prev_ldflags = append_env("LDFLAGS", ldflags.buf);
+    strbuf_free(&cflags);
+    strbuf_free(&ldflags);
+
+    // hand the build what flotsam already knows so its
+    // Makefile doesn't have to shell out for it
+    char commit[GIT_OID_HEXSZ + 1] = "";
+    dependency_commit(dep, commit, sizeof(commit));
+    toolchain_export();
+
+    if (dep->build != NULL) {
+        strbuf_appendf(&cmd, "(%s)", build_cmd);
+    } else {
+        strbuf_appendf(&cmd, "%s %s", build_cmd, toolchain_make_args());
+        if (commit[0] != '\0') {
+            strbuf_appendf(&cmd, " GIT_SHA=%s", commit);
+        }
+    }
+    strbuf_append(&cmd, " > /dev/null 2>&1");
+    if (system(cmd.buf) != 0) {
+        res = 1;
+    }
+    strbuf_free(&cmd);
+
+    restore_env("CFLAGS", prev_cflags);
+    restore_env("LDFLAGS", prev_ldflags);
+
+    if (res == 0 && config_dependency_link(dep) == LINK_STATIC) {
+        res = archive(dep);
+    }
+
+    return res;
+}
+
+/**
+ * store copies the libraries built in the dependency's
+ * directory to the artifact directory.
+ */
+static int
+store(const char* path, const char* artifacts)
+{
     DIR* dp;
     struct dirent* dirp;
 
-    if ((dp = opendir(".")) == NULL) {
-        perror("can't open .");
+    if ((dp = opendir(path)) == NULL) {
+        perror(path);
         return -1;
     }
 
     while ((dirp = readdir(dp)) != NULL) {
-        if (strstr(dirp->d_name, DYLIB_EXT) != NULL || strstr(dirp->d_name, SO_EXT)) {
-            char sl[PATH_MAX];
-            memset(sl, 0, PATH_MAX);
-            strcpy(sl, path);
-            strcat(sl, PATH_SEPERATOR);
-            strcat(sl, dirp->d_name);
+        if (!is_library(dirp->d_name)) {
+            continue;
+        }
 
-            char dl[PATH_MAX];
-            memset(dl, 0, PATH_MAX);
-            strcpy(dl, LIB_PATH);
-            strcat(dl, dirp->d_name);
+        char sl[PATH_MAX];
+        snprintf(sl, PATH_MAX, "%s%s%s", path, PATH_SEPERATOR, dirp->d_name);
 
-            if (symlink(sl, dl) != 0) {
-                perror(dirp->d_name);
-                return -1;
-            }
+        char al[PATH_MAX];
+        snprintf(al, PATH_MAX, "%s%s%s", artifacts, PATH_SEPERATOR, dirp->d_name);
+
+        if (copy_file(sl, al) != 0) {
+            perror(dirp->d_name);
+            closedir(dp);
+            return -1;
         }
     }
 
-    free(path);
     closedir(dp);
-    chdir(getenv("OLDPWD"));
 
     return 0;
 }
 
+/**
+ * buildable_hwcaps returns the bit set of the
+ * dependency's ISA levels that can be built here,
+ * warning about the others if warn is set. hwcaps
+ * variants only exist for shared objects loaded by
+ * glibc on x86-64.
+ */
+static int
+buildable_hwcaps(const struct dependency* dep, int warn)
+{
+    if (dep->hwcaps == 0) {
+        return 0;
+    }
+
+    const struct toolchain* tc = toolchain_get();
+    if (tc == NULL || config_dependency_link(dep) == LINK_STATIC ||
+        strcmp(tc->sysname, "Linux") != 0 || strcmp(tc->machine, "x86_64") != 0) {
+        if (warn) {
+            fprintf(stderr, "warning: hwcaps variants of %s need a shared x86-64 Linux build, "
+                    "skipping them\n", dep->name);
+        }
+        return 0;
+    }
+
+    int levels = 0;
+    for (int i = 0; i < HWCAPS_LEVEL_COUNT; i++) {
+        if (!(dep->hwcaps & (1 << i))) {
+            continue;
+        }
+
+        char flag[32];
+        snprintf(flag, sizeof(flag), "-march=%s", hwcaps_levels[i]);
+        if (toolchain_supports(flag)) {
+            levels |= 1 << i;
+        } else if (warn) {
+            fprintf(stderr, "warning: %s doesn't support %s, skipping the %s variant of %s\n",
+                    tc->cc, flag, hwcaps_levels[i], dep->name);
+        }
+    }
+
+    return levels;
+}
+
+/**
+ * hwcaps_path returns the directory holding the
+ * libraries built for the given ISA level under dir.
+ * The returned string needs to be freed by the caller.
+ */
+static char*
+hwcaps_path(const char* dir, int level)
+{
+    struct strbuf sb = { 0 };
+    strbuf_appendf(&sb, "%s%s%s%s%s", dir, PATH_SEPERATOR, HWCAPS_DIR, PATH_SEPERATOR,
+                   hwcaps_levels[level]);
+    return sb.buf;
+}
+
+/**
+ * build_hwcaps builds the dependency for one ISA level
+ * in the given tree and stores its libraries in the
+ * level's directory under artifacts. It runs in a
+ * child process so every level builds in parallel.
+ */
+static int
+build_hwcaps(const struct dependency* dep, const struct profile* profile, const char* tree,
+             const char* artifacts, int level)
+{
+    struct strbuf march = { 0 };
+    strbuf_appendf(&march, "-march=%s", hwcaps_levels[level]);
+
+    char* dir = hwcaps_path(artifacts, level);
+    int res = -1;
+
+    if (chdir(tree) != 0) {
+        perror(tree);
+    } else if (build(dep, profile, march.buf) == 0 && mkdir_p(dir, 0700) == 0) {
+        if (dep->libs != NULL) {
+            struct strbuf libs = { 0 };
+            strbuf_appendf(&libs, "%s%s%s", tree, PATH_SEPERATOR, dep->libs);
+            res = store(libs.buf, dir);
+            strbuf_free(&libs);
+        } else {
+            res = store(tree, dir);
+        }
+    }
+
+    free(dir);
+    strbuf_free(&march);
+
+    return res;
+}
+
+/**
+ * start_hwcaps copies the checkout once per ISA level in
+ * levels and starts building each copy in the
+ * background. The pids of the builds are stored in pids.
+ */
+static int
+start_hwcaps(const struct dependency* dep, const struct profile* profile, const char* path,
+             const char* artifacts, int levels, pid_t pids[])
+{
+    for (int i = 0; i < HWCAPS_LEVEL_COUNT; i++) {
+        if (!(levels & (1 << i))) {
+            continue;
+        }
+
+        struct strbuf tree = { 0 };
+        strbuf_appendf(&tree, "%s-%s", path, hwcaps_levels[i]);
+
+        // the copy is made before the baseline build starts
+        // changing the checkout
+        if (remove_tree(tree.buf) != 0 ||
+            copy_tree(path, tree.buf, hwcaps_skip, sizeof(hwcaps_skip) / sizeof(hwcaps_skip[0])) != 0) {
+            fprintf(stderr, "error: unable to copy %s to %s\n", path, tree.buf);
+            strbuf_free(&tree);
+            return -1;
+        }
+
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            perror("fork");
+            strbuf_free(&tree);
+            return -1;
+        }
+        if (pids[i] == 0) {
+            _exit(build_hwcaps(dep, profile, tree.buf, artifacts, i) == 0 ? 0 : 1);
+        }
+        strbuf_free(&tree);
+    }
+
+    return 0;
+}
+
+/**
+ * wait_hwcaps waits for the builds started by
+ * start_hwcaps and removes their trees.
+ */
+static int
+wait_hwcaps(const struct dependency* dep, const char* path, pid_t pids[])
+{
+    int res = 0;
+
+    for (int i = 0; i < HWCAPS_LEVEL_COUNT; i++) {
+        if (pids[i] <= 0) {
+            continue;
+        }
+
+        int status;
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "error: failed to build %s@%s for %s\n", dep->name, dep->vers,
+                    hwcaps_levels[i]);
+            res = 1;
+        }
+
+        struct strbuf tree = { 0 };
+        strbuf_appendf(&tree, "%s-%s", path, hwcaps_levels[i]);
+        remove_tree(tree.buf);
+        strbuf_free(&tree);
+    }
+
+    return res;
+}
+
+/**
+ * install_dir links the shared libraries in src into
+ * dst.
+ */
+static int
+install_dir(const char* src, const char* dst)
+{
+    DIR* dp;
+    struct dirent* dirp;
+
+    if (mkdir_p(dst, 0755) != 0) {
+        perror(dst);
+        return -1;
+    }
+    if ((dp = opendir(src)) == NULL) {
+        perror(src);
+        return -1;
+    }
+
+    int res = 0;
+    while ((dirp = readdir(dp)) != NULL) {
+        if (strstr(dirp->d_name, DYLIB_EXT) == NULL && strstr(dirp->d_name, SO_EXT) == NULL) {
+            continue;
+        }
+
+        char al[PATH_MAX];
+        snprintf(al, PATH_MAX, "%s%s%s", src, PATH_SEPERATOR, dirp->d_name);
+
+        char dl[PATH_MAX];
+        snprintf(dl, PATH_MAX, "%s%s%s", dst, PATH_SEPERATOR, dirp->d_name);
+
+        if (link_file(al, dl) != 0) {
+            perror(dirp->d_name);
+            res = -1;
+            break;
+        }
+    }
+
+    closedir(dp);
+
+    return res;
+}
+
+int
+dependency_install(const struct dependency* dep, const struct profile* profile)
+{
+    if (config_dependency_link(dep) == LINK_STATIC) {
+        return 0;
+    }
+
+    char* artifacts = dependency_artifact_path(dep, profile);
+    if (artifacts == NULL) {
+        return -1;
+    }
+
+    struct stat s;
+    if (stat(artifacts, &s) != 0) {
+        fprintf(stderr, "error: %s@%s isn't built for this profile, run update\n",
+                dep->name, dep->vers);
+        free(artifacts);
+        return -1;
+    }
+
+    int res = install_dir(artifacts, PROJECT_LIB_DIR);
+
+    // the loader prefers PROJECT_LIB_DIR/glibc-hwcaps/<level>
+    // over PROJECT_LIB_DIR on CPUs supporting the level
+    int levels = buildable_hwcaps(dep, 0);
+    for (int i = 0; res == 0 && i < HWCAPS_LEVEL_COUNT; i++) {
+        if (!(levels & (1 << i))) {
+            continue;
+        }
+        char* src = hwcaps_path(artifacts, i);
+        char* dst = hwcaps_path(PROJECT_LIB_DIR, i);
+        if (stat(src, &s) == 0) {
+            res = install_dir(src, dst);
+        }
+        free(src);
+        free(dst);
+    }
+
+    free(artifacts);
+
+    return res;
+}
+
+int
+dependency_update(const struct dependency* dep, const struct profile* profile)
+{
+    profile = dependency_profile(dep, profile);
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+
+    int res = clone(dep->name, dep->vers);
+    if (res != 0) {
+        return -1;
+    }
+
+    pid_t pids[HWCAPS_LEVEL_COUNT] = { 0 };
+    char* path = build_dependency_path(dep->name, dep->vers);
+    char* artifacts = dependency_artifact_path(dep, profile);
+    if (path == NULL || artifacts == NULL) {
+        free(path);
+        free(artifacts);
+        return -1;
+    }
+
+    // the libraries are stored in a scratch directory and only
+    // moved into place once every build succeeded, so a failed
+    // or interrupted build never looks built
+    struct strbuf tmp = { 0 };
+    strbuf_appendf(&tmp, "%s.tmp-%d", artifacts, (int)getpid());
+
+    if (remove_tree(tmp.buf) != 0 || mkdir_p(tmp.buf, 0700) != 0) {
+        perror(tmp.buf);
+        res = -1;
+        goto out;
+    }
+
+    if (chdir(path) != 0) {
+        perror(path);
+        res = -1;
+        goto out;
+    }
+
+    // the ISA level variants build alongside the baseline
+    if (start_hwcaps(dep, profile, path, tmp.buf, buildable_hwcaps(dep, 1), pids) != 0) {
+        res = -1;
+        goto out;
+    }
+
+    if (build(dep, profile, NULL) != 0) {
+        fprintf(stderr, "error: failed to build %s@%s\n", dep->name, dep->vers);
+        res = 1;
+        goto out;
+    }
+
+    if (dep->libs != NULL) {
+        struct strbuf libs = { 0 };
+        strbuf_appendf(&libs, "%s%s%s", path, PATH_SEPERATOR, dep->libs);
+        res = store(libs.buf, tmp.buf);
+        strbuf_free(&libs);
+    } else {
+        res = store(path, tmp.buf);
+    }
+
+out:
+    if (wait_hwcaps(dep, path, pids) != 0) {
+        res = 1;
+    }
+    if (res == 0 && (remove_tree(artifacts) != 0 || rename(tmp.buf, artifacts) != 0)) {
+        perror(artifacts);
+        res = -1;
+    }
+    if (res != 0) {
+        remove_tree(tmp.buf);
+    }
+    chdir(cwd);
+    strbuf_free(&tmp);
+    free(path);
+    free(artifacts);
+
+    if (res == 0) {
+        res = dependency_install(dep, profile);
+    }
+
+    return res;
+}
+
+/**
+ * is_built returns 1 if libraries of the dependency and
+ * all of its hwcaps variants are stored for the profile.
+ */
+static int
+is_built(const struct dependency* dep, const struct profile* profile)
+{
+    char* artifacts = dependency_artifact_path(dep, profile);
+    int built = has_library(artifacts);
+
+    int levels = buildable_hwcaps(dep, 0);
+    for (int i = 0; built && i < HWCAPS_LEVEL_COUNT; i++) {
+        if (levels & (1 << i)) {
+            char* dir = hwcaps_path(artifacts, i);
+            built = has_library(dir);
+            free(dir);
+        }
+    }
+    free(artifacts);
+
+    return built;
+}
+
 int
-dependency_update_all()
+dependency_update_all(const struct profile* profile, int missing_only)
 {
+    struct dependencies* deps = config_get_dependencies();
+
+    for (int i = 0; i < deps->count; i++) {
+        if (missing_only && is_built(&deps->dependencies[i], profile)) {
+            continue;
+        }
+        if (dependency_update(&deps->dependencies[i], profile) != 0) {
+            return -1;
+        }
+    }
+
     return 0;
 }
@@ -28,16 +28,83 @@
 #ifndef _DEPENDENCY_H
 #define _DEPENDENCY_H
 
+#include <stddef.h>
+
+#include "config.h"
+
+/**
+ * STATIC_CFLAGS are added when compiling code that's linked
+ * statically so the linker can drop unused sections.
+ */
+#define STATIC_CFLAGS "-ffunction-sections -fdata-sections"
+
+/**
+ * PROJECT_LIB_DIR is where shared dependencies are installed
+ * relative to the project root. Binaries in bin find them
+ * through an $ORIGIN relative rpath.
+ */
+#define PROJECT_LIB_DIR "deps/lib"
+
+/**
+ * dependency_artifact_path returns the directory holding the artifacts of the
+ * given dependency built with the given profile and link mode. Each
+ * combination gets its own directory so builds can live side by side, keyed
+ * by the profile's flags, linker and debug info mode as well as its name so
+ * projects defining a profile of the same name don't share artifacts. The
+ * returned string needs to be freed by the caller.
+ */
+char*
+dependency_artifact_path(const struct dependency *dep,
+                         const struct profile *profile);
+
+/**
+ * dependency_path returns the directory the dependency's source is checked out
+ * to. The returned string needs to be freed by the caller.
+ */
+char*
+dependency_path(const char *dep, const char *ver);
+
+/**
+ * dependency_commit writes the hex id of the commit the dependency's version
+ * resolves to into out.
+ */
+int
+dependency_commit(const struct dependency *dep, char *out, size_t len);
+
+/**
+ * dependency_lib_name returns the name to pass to the linker's -l flag for the
+ * given dependency, e.g. "spinner" for github.com/briandowns/libspinner.git.
+ * The returned string needs to be freed by the caller.
+ */
+char*
+dependency_lib_name(const char *dep);
+
+/**
+ * dependency_install installs the shared libraries of the given dependency
+ * built with the given profile into the project's PROJECT_LIB_DIR using hard
+ * links, or reflinks and copies when the cache lives on another filesystem.
+ * Statically linked dependencies have nothing to install.
+ */
+int
+dependency_install(const struct dependency *dep,
+                   const struct profile *profile);
+
 /**
- * dependency_update
+ * dependency_update retrieves the dependency, builds it with the flags of the
+ * given profile, which may be NULL, and installs the resulting libraries into
+ * the project's PROJECT_LIB_DIR.
+ * Statically linked dependencies are built with -ffunction-sections and
+ * -fdata-sections and archived into a .a if their build doesn't produce one.
  */
 int
-dependency_update(const char *dep, const char *ver);
+dependency_update(const struct dependency *dep,
+                  const struct profile *profile);
 
 /**
- * dependency_update_all
+ * dependency_update_all updates every dependency of the project. With
+ * missing_only set, dependencies already built for the profile are skipped.
  */
 int
-dependency_update_all();
+dependency_update_all(const struct profile *profile, int missing_only);
 
 #endif /* _DEPENDENCY_H */
\ No newline at end of file
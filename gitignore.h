@@ -35,10 +35,15 @@
     "tests/unity/libunity.a\n" \
     "tests/log.c\n\n"          \
     "*.o\n"                    \
+    "*.d\n"                    \
+    "build/\n"                 \
     "*.so\n\n"                 \
     "*.dylib\n\n"              \
     ".vscode\n\n"              \
     "bin/*\n\n"                \
+    "deps/\n"                  \
+    "flotsam.mk\n"             \
+    ".flotsam/\n\n"            \
     "tmp/\n"                   \
     "%1$s\n\n"
 
@@ -0,0 +1,487 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _HEAPPROF_H
+#define _HEAPPROF_H
+
+#define HEAP_PROFILER_TEMPLATE                                                               \
+    "#define _GNU_SOURCE\n\n"                                                                \
+    "#include <dlfcn.h>\n"                                                                   \
+    "#include <errno.h>\n"                                                                   \
+    "#include <execinfo.h>\n"                                                                \
+    "#include <malloc.h>\n"                                                                  \
+    "#include <math.h>\n"                                                                    \
+    "#include <pthread.h>\n"                                                                 \
+    "#include <stdint.h>\n"                                                                  \
+    "#include <stdio.h>\n"                                                                   \
+    "#include <stdlib.h>\n"                                                                  \
+    "#include <string.h>\n"                                                                  \
+    "#include <sys/mman.h>\n"                                                                \
+    "#include <time.h>\n"                                                                    \
+    "#include <unistd.h>\n\n"                                                                \
+    "// heap profiler preloaded by flotsam profile --heap. malloc, calloc,\n"                \
+    "// realloc, free and the aligned allocators are counted and allocations\n"              \
+    "// are sampled about once every FLOTSAM_HEAP_RATE bytes. Sampled\n"                     \
+    "// allocations have their call stack recorded and are tracked until freed\n"            \
+    "// for their lifetime. Each one stands for 1 / p allocations, p being the\n"            \
+    "// chance an allocation of its size is sampled, so totals per stack are\n"              \
+    "// estimates. The results are written to FLOTSAM_HEAP_OUT/heap.<pid> when\n"            \
+    "// the process exits.\n\n"                                                              \
+    "#define MAX_FRAMES 32\n"                                                                \
+    "#define MAX_SITES  (1 << 16)\n"                                                         \
+    "#define MAX_LIVE   (1 << 20)\n"                                                         \
+    "#define SHORT_NS   1000000ULL\n"                                                        \
+    "#define BOOT_SIZE  8192\n\n"                                                            \
+    "struct site {\n"                                                                        \
+    "    uint64_t hash;\n"                                                                   \
+    "    int depth;\n"                                                                       \
+    "    void *frames[MAX_FRAMES];\n"                                                        \
+    "    double allocs;\n"                                                                   \
+    "    double bytes;\n"                                                                    \
+    "    double frees;\n"                                                                    \
+    "    double lifetime_ns;\n"                                                              \
+    "    double short_lived;\n"                                                              \
+    "    double live;\n"                                                                     \
+    "    double peak;\n"                                                                     \
+    "};\n\n"                                                                                 \
+    "struct live {\n"                                                                        \
+    "    void *ptr;\n"                                                                       \
+    "    uint32_t site;\n"                                                                   \
+    "    double weight;\n"                                                                   \
+    "    double bytes;\n"                                                                    \
+    "    uint64_t t;\n"                                                                      \
+    "};\n\n"                                                                                 \
+    "static void *(*real_malloc)(size_t);\n"                                                 \
+    "static void *(*real_calloc)(size_t, size_t);\n"                                         \
+    "static void *(*real_realloc)(void *, size_t);\n"                                        \
+    "static void (*real_free)(void *);\n"                                                    \
+    "static int (*real_posix_memalign)(void **, size_t, size_t);\n"                          \
+    "static void *(*real_aligned_alloc)(size_t, size_t);\n"                                  \
+    "static void *(*real_memalign)(size_t, size_t);\n\n"                                     \
+    "static char boot[BOOT_SIZE];\n"                                                         \
+    "static size_t boot_used;\n\n"                                                           \
+    "static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;\n"                             \
+    "static struct site *sites;\n"                                                           \
+    "static uint32_t site_count;\n"                                                          \
+    "static struct live *live;\n"                                                            \
+    "static uint64_t live_count;\n"                                                          \
+    "static double rate = 32768;\n"                                                          \
+    "static int active;\n\n"                                                                 \
+    "static uint64_t total_allocs;\n"                                                        \
+    "static uint64_t total_bytes;\n"                                                         \
+    "static uint64_t total_frees;\n"                                                         \
+    "static int64_t live_bytes;\n"                                                           \
+    "static int64_t peak_bytes;\n\n"                                                         \
+    "static __thread int in_hook;\n"                                                         \
+    "static __thread int resolving;\n"                                                       \
+    "static __thread double until_sample = -1;\n"                                            \
+    "static __thread uint64_t rng;\n\n"                                                      \
+    "static uint64_t\n"                                                                      \
+    "now(void)\n"                                                                            \
+    "{\n"                                                                                    \
+    "    struct timespec ts;\n"                                                              \
+    "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"                                             \
+    "    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;\n"               \
+    "}\n\n"                                                                                  \
+    "// next_interval draws the bytes until the next sample from an\n"                       \
+    "// exponential distribution so every byte is equally likely sampled.\n"                 \
+    "static double\n"                                                                        \
+    "next_interval(void)\n"                                                                  \
+    "{\n"                                                                                    \
+    "    if (rng == 0) {\n"                                                                  \
+    "        rng = now() ^ (uint64_t)(uintptr_t)&rng;\n"                                     \
+    "    }\n"                                                                                \
+    "    rng ^= rng << 13;\n"                                                                \
+    "    rng ^= rng >> 7;\n"                                                                 \
+    "    rng ^= rng << 17;\n"                                                                \
+    "    double u = ((rng >> 11) + 1) * (1.0 / 9007199254740993.0);\n"                       \
+    "    return -log(u) * rate;\n"                                                           \
+    "}\n\n"                                                                                  \
+    "static uint64_t\n"                                                                      \
+    "hash_ptr(const void *p)\n"                                                              \
+    "{\n"                                                                                    \
+    "    uint64_t h = (uint64_t)(uintptr_t)p;\n"                                             \
+    "    h ^= h >> 33;\n"                                                                    \
+    "    h *= 0xff51afd7ed558ccdULL;\n"                                                      \
+    "    h ^= h >> 33;\n"                                                                    \
+    "    return h;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "static uint32_t\n"                                                                      \
+    "find_site(void **frames, int depth)\n"                                                  \
+    "{\n"                                                                                    \
+    "    uint64_t h = 0xcbf29ce484222325ULL;\n"                                              \
+    "    for (int i = 0; i < depth; i++) {\n"                                                \
+    "        h = (h ^ (uint64_t)(uintptr_t)frames[i]) * 0x100000001b3ULL;\n"                 \
+    "    }\n\n"                                                                              \
+    "    uint32_t i = (uint32_t)h & (MAX_SITES - 1);\n"                                      \
+    "    for (uint32_t n = 0; n < MAX_SITES; n++, i = (i + 1) & (MAX_SITES - 1)) {\n"        \
+    "        struct site *s = &sites[i];\n"                                                  \
+    "        if (s->depth == 0) {\n"                                                         \
+    "            s->hash = h;\n"                                                             \
+    "            s->depth = depth;\n"                                                        \
+    "            memcpy(s->frames, frames, depth * sizeof(void *));\n"                       \
+    "            site_count++;\n"                                                            \
+    "            return i;\n"                                                                \
+    "        }\n"                                                                            \
+    "        if (s->hash == h && s->depth == depth &&\n"                                     \
+    "            memcmp(s->frames, frames, depth * sizeof(void *)) == 0) {\n"                \
+    "            return i;\n"                                                                \
+    "        }\n"                                                                            \
+    "    }\n\n"                                                                              \
+    "    return UINT32_MAX;\n"                                                               \
+    "}\n\n"                                                                                  \
+    "static void\n"                                                                          \
+    "live_add(void *ptr, uint32_t site, double weight, double bytes)\n"                      \
+    "{\n"                                                                                    \
+    "    if (live_count >= MAX_LIVE / 2) {\n"                                                \
+    "        return;\n"                                                                      \
+    "    }\n"                                                                                \
+    "    uint64_t i = hash_ptr(ptr) & (MAX_LIVE - 1);\n"                                     \
+    "    while (live[i].ptr != NULL) {\n"                                                    \
+    "        i = (i + 1) & (MAX_LIVE - 1);\n"                                                \
+    "    }\n"                                                                                \
+    "    live[i].ptr = ptr;\n"                                                               \
+    "    live[i].site = site;\n"                                                             \
+    "    live[i].weight = weight;\n"                                                         \
+    "    live[i].bytes = bytes;\n"                                                           \
+    "    live[i].t = now();\n"                                                               \
+    "    live_count++;\n"                                                                    \
+    "}\n\n"                                                                                  \
+    "// live_remove removes the pointer with backward shift deletion so\n"                   \
+    "// lookups never need tombstones.\n"                                                    \
+    "static int\n"                                                                           \
+    "live_remove(void *ptr, struct live *out)\n"                                             \
+    "{\n"                                                                                    \
+    "    uint64_t i = hash_ptr(ptr) & (MAX_LIVE - 1);\n"                                     \
+    "    while (live[i].ptr != ptr) {\n"                                                     \
+    "        if (live[i].ptr == NULL) {\n"                                                   \
+    "            return 0;\n"                                                                \
+    "        }\n"                                                                            \
+    "        i = (i + 1) & (MAX_LIVE - 1);\n"                                                \
+    "    }\n"                                                                                \
+    "    *out = live[i];\n"                                                                  \
+    "    live_count--;\n\n"                                                                  \
+    "    uint64_t j = i;\n"                                                                  \
+    "    for (;;) {\n"                                                                       \
+    "        j = (j + 1) & (MAX_LIVE - 1);\n"                                                \
+    "        if (live[j].ptr == NULL) {\n"                                                   \
+    "            break;\n"                                                                   \
+    "        }\n"                                                                            \
+    "        uint64_t k = hash_ptr(live[j].ptr) & (MAX_LIVE - 1);\n"                         \
+    "        if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {\n"          \
+    "            live[i] = live[j];\n"                                                       \
+    "            i = j;\n"                                                                   \
+    "        }\n"                                                                            \
+    "    }\n"                                                                                \
+    "    live[i].ptr = NULL;\n\n"                                                            \
+    "    return 1;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "// record_alloc is kept out of line so the frames it drops are always\n"                \
+    "// its own and the interposed function's.\n"                                            \
+    "__attribute__((noinline)) static void\n"                                                \
+    "record_alloc(void *ptr, size_t size)\n"                                                 \
+    "{\n"                                                                                    \
+    "    if (ptr == NULL || in_hook || !active) {\n"                                         \
+    "        return;\n"                                                                      \
+    "    }\n\n"                                                                              \
+    "    size_t usable = malloc_usable_size(ptr);\n"                                         \
+    "    __atomic_add_fetch(&total_allocs, 1, __ATOMIC_RELAXED);\n"                          \
+    "    __atomic_add_fetch(&total_bytes, size, __ATOMIC_RELAXED);\n"                        \
+    "    int64_t cur = __atomic_add_fetch(&live_bytes, (int64_t)usable,\n"                   \
+    "                                     __ATOMIC_RELAXED);\n"                              \
+    "    int64_t peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);\n"                   \
+    "    while (cur > peak &&\n"                                                             \
+    "           !__atomic_compare_exchange_n(&peak_bytes, &peak, cur, 1,\n"                  \
+    "                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {\n"       \
+    "    }\n\n"                                                                              \
+    "    if (until_sample < 0) {\n"                                                          \
+    "        until_sample = next_interval();\n"                                              \
+    "    }\n"                                                                                \
+    "    until_sample -= size;\n"                                                            \
+    "    if (until_sample > 0) {\n"                                                          \
+    "        return;\n"                                                                      \
+    "    }\n"                                                                                \
+    "    until_sample = next_interval();\n\n"                                                \
+    "    in_hook = 1;\n"                                                                     \
+    "    void *frames[MAX_FRAMES + 2];\n"                                                    \
+    "    int depth = backtrace(frames, MAX_FRAMES + 2);\n"                                   \
+    "    in_hook = 0;\n"                                                                     \
+    "    // drop record_alloc and the interposed function\n"                                 \
+    "    depth = depth > 2 ? depth - 2 : 0;\n"                                               \
+    "    if (depth == 0) {\n"                                                                \
+    "        return;\n"                                                                      \
+    "    }\n\n"                                                                              \
+    "    double p = rate > 1 ? 1 - exp(-(double)size / rate) : 1;\n"                         \
+    "    double weight = p > 0 ? 1 / p : 1;\n\n"                                             \
+    "    pthread_mutex_lock(&lock);\n"                                                       \
+    "    uint32_t i = find_site(frames + 2, depth);\n"                                       \
+    "    if (i != UINT32_MAX) {\n"                                                           \
+    "        struct site *s = &sites[i];\n"                                                  \
+    "        s->allocs += weight;\n"                                                         \
+    "        s->bytes += weight * size;\n"                                                   \
+    "        s->live += weight * size;\n"                                                    \
+    "        if (s->live > s->peak) {\n"                                                     \
+    "            s->peak = s->live;\n"                                                       \
+    "        }\n"                                                                            \
+    "        live_add(ptr, i, weight, weight * size);\n"                                     \
+    "    }\n"                                                                                \
+    "    pthread_mutex_unlock(&lock);\n"                                                     \
+    "}\n\n"                                                                                  \
+    "// record_free takes the usable size of ptr from the caller since realloc\n"            \
+    "// has to read it before the block is handed back.\n"                                   \
+    "static void\n"                                                                          \
+    "record_free(void *ptr, size_t usable)\n"                                                \
+    "{\n"                                                                                    \
+    "    if (ptr == NULL || in_hook || !active) {\n"                                         \
+    "        return;\n"                                                                      \
+    "    }\n\n"                                                                              \
+    "    __atomic_add_fetch(&total_frees, 1, __ATOMIC_RELAXED);\n"                           \
+    "    __atomic_sub_fetch(&live_bytes, (int64_t)usable, __ATOMIC_RELAXED);\n"              \
+    "    if (__atomic_load_n(&live_count, __ATOMIC_RELAXED) == 0) {\n"                       \
+    "        return;\n"                                                                      \
+    "    }\n\n"                                                                              \
+    "    struct live l;\n"                                                                   \
+    "    pthread_mutex_lock(&lock);\n"                                                       \
+    "    if (live_remove(ptr, &l)) {\n"                                                      \
+    "        struct site *s = &sites[l.site];\n"                                             \
+    "        uint64_t ns = now() - l.t;\n"                                                   \
+    "        s->frees += l.weight;\n"                                                        \
+    "        s->lifetime_ns += l.weight * ns;\n"                                             \
+    "        if (ns < SHORT_NS) {\n"                                                         \
+    "            s->short_lived += l.weight;\n"                                              \
+    "        }\n"                                                                            \
+    "        s->live -= l.bytes;\n"                                                          \
+    "    }\n"                                                                                \
+    "    pthread_mutex_unlock(&lock);\n"                                                     \
+    "}\n\n"                                                                                  \
+    "static void\n"                                                                          \
+    "write_profile(void)\n"                                                                  \
+    "{\n"                                                                                    \
+    "    const char *dir = getenv(\"FLOTSAM_HEAP_OUT\");\n"                                  \
+    "    if (dir == NULL) {\n"                                                               \
+    "        return;\n"                                                                      \
+    "    }\n\n"                                                                              \
+    "    char path[4096];\n"                                                                 \
+    "    snprintf(path, sizeof(path), \"%s/heap.%d\", dir, (int)getpid());\n"                \
+    "    FILE *fp = fopen(path, \"w\");\n"                                                   \
+    "    if (fp == NULL) {\n"                                                                \
+    "        return;\n"                                                                      \
+    "    }\n\n"                                                                              \
+    "    fprintf(fp, \"flotsam-heap 1\\nrate %.0f\\n\", rate);\n"                            \
+    "    fprintf(fp, \"totals %llu %llu %llu %lld\\n\", (unsigned long long)total_allocs,\n" \
+    "            (unsigned long long)total_bytes, (unsigned long long)total_frees,\n"        \
+    "            (long long)peak_bytes);\n\n"                                                \
+    "    FILE *maps = fopen(\"/proc/self/maps\", \"r\");\n"                                  \
+    "    if (maps != NULL) {\n"                                                              \
+    "        char line[4096 + 128];\n"                                                       \
+    "        while (fgets(line, sizeof(line), maps) != NULL) {\n"                            \
+    "            unsigned long long start, end, off;\n"                                      \
+    "            char perms[5];\n"                                                           \
+    "            int n = 0;\n"                                                               \
+    "            if (sscanf(line, \"%llx-%llx %4s %llx %*s %*s %n\", &start, &end,\n"        \
+    "                       perms, &off, &n) >= 4 &&\n"                                      \
+    "                n > 0 && perms[2] == 'x' && line[n] == '/') {\n"                        \
+    "                fprintf(fp, \"map %llx %llx %llx %s\", start, end, off, line + n);\n"   \
+    "            }\n"                                                                        \
+    "        }\n"                                                                            \
+    "        fclose(maps);\n"                                                                \
+    "    }\n\n"                                                                              \
+    "    for (uint32_t i = 0; i < MAX_SITES; i++) {\n"                                       \
+    "        const struct site *s = &sites[i];\n"                                            \
+    "        if (s->depth == 0) {\n"                                                         \
+    "            continue;\n"                                                                \
+    "        }\n"                                                                            \
+    "        fprintf(fp, \"site %.0f %.0f %.0f %.0f %.0f %.0f %d\", s->allocs,\n"            \
+    "                s->bytes, s->frees, s->lifetime_ns, s->short_lived, s->peak,\n"         \
+    "                s->depth);\n"                                                           \
+    "        for (int j = 0; j < s->depth; j++) {\n"                                         \
+    "            fprintf(fp, \" %llx\", (unsigned long long)(uintptr_t)s->frames[j]);\n"     \
+    "        }\n"                                                                            \
+    "        fprintf(fp, \"\\n\");\n"                                                        \
+    "    }\n\n"                                                                              \
+    "    fclose(fp);\n"                                                                      \
+    "}\n\n"                                                                                  \
+    "// resolve looks up the real allocator on first use since the constructors\n"           \
+    "// of the program's own libraries run before heap_init and may allocate.\n"             \
+    "// dlsym allocates too, which is served from boot while resolving. free is\n"           \
+    "// looked up first so nothing the real malloc returns is freed without it.\n"           \
+    "static void\n"                                                                          \
+    "resolve(void)\n"                                                                        \
+    "{\n"                                                                                    \
+    "    if (real_memalign != NULL || resolving) {\n"                                        \
+    "        return;\n"                                                                      \
+    "    }\n"                                                                                \
+    "    resolving = 1;\n"                                                                   \
+    "    real_free = dlsym(RTLD_NEXT, \"free\");\n"                                          \
+    "    real_malloc = dlsym(RTLD_NEXT, \"malloc\");\n"                                      \
+    "    real_calloc = dlsym(RTLD_NEXT, \"calloc\");\n"                                      \
+    "    real_realloc = dlsym(RTLD_NEXT, \"realloc\");\n"                                    \
+    "    real_posix_memalign = dlsym(RTLD_NEXT, \"posix_memalign\");\n"                      \
+    "    real_aligned_alloc = dlsym(RTLD_NEXT, \"aligned_alloc\");\n"                        \
+    "    real_memalign = dlsym(RTLD_NEXT, \"memalign\");\n"                                  \
+    "    resolving = 0;\n"                                                                   \
+    "}\n\n"                                                                                  \
+    "__attribute__((constructor)) static void\n"                                             \
+    "heap_init(void)\n"                                                                      \
+    "{\n"                                                                                    \
+    "    in_hook = 1;\n"                                                                     \
+    "    resolve();\n\n"                                                                     \
+    "    const char *r = getenv(\"FLOTSAM_HEAP_RATE\");\n"                                   \
+    "    if (r != NULL) {\n"                                                                 \
+    "        rate = strtod(r, NULL);\n"                                                      \
+    "    }\n\n"                                                                              \
+    "    sites = mmap(NULL, MAX_SITES * sizeof(struct site), PROT_READ | PROT_WRITE,\n"      \
+    "                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n"                                \
+    "    live = mmap(NULL, MAX_LIVE * sizeof(struct live), PROT_READ | PROT_WRITE,\n"        \
+    "                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n\n"                               \
+    "    // load the unwinder before anything is sampled\n"                                  \
+    "    void *frames[1];\n"                                                                 \
+    "    backtrace(frames, 1);\n"                                                            \
+    "    in_hook = 0;\n\n"                                                                   \
+    "    active = sites != MAP_FAILED && live != MAP_FAILED &&\n"                            \
+    "             real_malloc != NULL && real_calloc != NULL &&\n"                           \
+    "             real_realloc != NULL && real_free != NULL &&\n"                            \
+    "             real_posix_memalign != NULL && real_aligned_alloc != NULL &&\n"            \
+    "             real_memalign != NULL;\n"                                                  \
+    "}\n\n"                                                                                  \
+    "__attribute__((destructor)) static void\n"                                              \
+    "heap_fini(void)\n"                                                                      \
+    "{\n"                                                                                    \
+    "    if (!active) {\n"                                                                   \
+    "        return;\n"                                                                      \
+    "    }\n"                                                                                \
+    "    active = 0;\n"                                                                      \
+    "    write_profile();\n"                                                                 \
+    "}\n\n"                                                                                  \
+    "// boot_alloc serves dlsym's allocations before the real allocator\n"                   \
+    "// has been looked up.\n"                                                               \
+    "static void *\n"                                                                        \
+    "boot_alloc(size_t size)\n"                                                              \
+    "{\n"                                                                                    \
+    "    size = (size + 15) & ~(size_t)15;\n"                                                \
+    "    if (boot_used + size > BOOT_SIZE) {\n"                                              \
+    "        return NULL;\n"                                                                 \
+    "    }\n"                                                                                \
+    "    void *p = boot + boot_used;\n"                                                      \
+    "    boot_used += size;\n"                                                               \
+    "    return p;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "static int\n"                                                                           \
+    "is_boot(const void *p)\n"                                                               \
+    "{\n"                                                                                    \
+    "    return (const char *)p >= boot && (const char *)p < boot + BOOT_SIZE;\n"            \
+    "}\n\n"                                                                                  \
+    "void *\n"                                                                               \
+    "malloc(size_t size)\n"                                                                  \
+    "{\n"                                                                                    \
+    "    resolve();\n"                                                                       \
+    "    if (real_malloc == NULL) {\n"                                                       \
+    "        return boot_alloc(size);\n"                                                     \
+    "    }\n"                                                                                \
+    "    void *p = real_malloc(size);\n"                                                     \
+    "    record_alloc(p, size);\n"                                                           \
+    "    return p;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "void *\n"                                                                               \
+    "calloc(size_t n, size_t size)\n"                                                        \
+    "{\n"                                                                                    \
+    "    resolve();\n"                                                                       \
+    "    if (real_calloc == NULL) {\n"                                                       \
+    "        return n == 0 || size <= BOOT_SIZE / n ? boot_alloc(n * size) : NULL;\n"        \
+    "    }\n"                                                                                \
+    "    void *p = real_calloc(n, size);\n"                                                  \
+    "    record_alloc(p, n * size);\n"                                                       \
+    "    return p;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "void *\n"                                                                               \
+    "realloc(void *ptr, size_t size)\n"                                                      \
+    "{\n"                                                                                    \
+    "    resolve();\n"                                                                       \
+    "    if (real_realloc == NULL || is_boot(ptr)) {\n"                                      \
+    "        void *p = real_malloc != NULL ? real_malloc(size) : boot_alloc(size);\n"        \
+    "        if (p != NULL && ptr != NULL) {\n"                                              \
+    "            size_t left = (size_t)(boot + BOOT_SIZE - (char *)ptr);\n"                  \
+    "            memcpy(p, ptr, size < left ? size : left);\n"                               \
+    "        }\n"                                                                            \
+    "        return p;\n"                                                                    \
+    "    }\n"                                                                                \
+    "    // a failed realloc leaves ptr allocated, a realloc to 0 frees it\n"                \
+    "    size_t usable = ptr != NULL ? malloc_usable_size(ptr) : 0;\n"                       \
+    "    void *p = real_realloc(ptr, size);\n"                                               \
+    "    if (p != NULL || size == 0) {\n"                                                    \
+    "        record_free(ptr, usable);\n"                                                    \
+    "        record_alloc(p, size);\n"                                                       \
+    "    }\n"                                                                                \
+    "    return p;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "void\n"                                                                                 \
+    "free(void *ptr)\n"                                                                      \
+    "{\n"                                                                                    \
+    "    if (ptr == NULL || is_boot(ptr)) {\n"                                               \
+    "        return;\n"                                                                      \
+    "    }\n"                                                                                \
+    "    resolve();\n"                                                                       \
+    "    record_free(ptr, malloc_usable_size(ptr));\n"                                       \
+    "    real_free(ptr);\n"                                                                  \
+    "}\n\n"                                                                                  \
+    "int\n"                                                                                  \
+    "posix_memalign(void **ptr, size_t align, size_t size)\n"                                \
+    "{\n"                                                                                    \
+    "    resolve();\n"                                                                       \
+    "    if (real_posix_memalign == NULL) {\n"                                               \
+    "        return ENOMEM;\n"                                                               \
+    "    }\n"                                                                                \
+    "    int res = real_posix_memalign(ptr, align, size);\n"                                 \
+    "    if (res == 0) {\n"                                                                  \
+    "        record_alloc(*ptr, size);\n"                                                    \
+    "    }\n"                                                                                \
+    "    return res;\n"                                                                      \
+    "}\n\n"                                                                                  \
+    "void *\n"                                                                               \
+    "aligned_alloc(size_t align, size_t size)\n"                                             \
+    "{\n"                                                                                    \
+    "    resolve();\n"                                                                       \
+    "    if (real_aligned_alloc == NULL) {\n"                                                \
+    "        return NULL;\n"                                                                 \
+    "    }\n"                                                                                \
+    "    void *p = real_aligned_alloc(align, size);\n"                                       \
+    "    record_alloc(p, size);\n"                                                           \
+    "    return p;\n"                                                                        \
+    "}\n\n"                                                                                  \
+    "void *\n"                                                                               \
+    "memalign(size_t align, size_t size)\n"                                                  \
+    "{\n"                                                                                    \
+    "    resolve();\n"                                                                       \
+    "    if (real_memalign == NULL) {\n"                                                     \
+    "        return NULL;\n"                                                                 \
+    "    }\n"                                                                                \
+    "    void *p = real_memalign(align, size);\n"                                            \
+    "    record_alloc(p, size);\n"                                                           \
+    "    return p;\n"                                                                        \
+    "}\n"
+
+#endif /* _HEAPPROF_H */
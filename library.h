@@ -0,0 +1,99 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LIBRARY_H
+#define _LIBRARY_H
+
+#include <stdio.h>
+
+#define LIBRARY_HEADER_TEMPLATE                                   \
+    "#ifndef _%4$s_H\n"                                           \
+    "#define _%4$s_H\n\n"                                         \
+    "// public interface of %1$s. Version: %2$s\n\n"              \
+    "#if defined(__GNUC__) || defined(__clang__)\n"               \
+    "#define %4$s_API __attribute__((visibility(\"default\")))\n" \
+    "#else\n"                                                     \
+    "#define %4$s_API\n"                                          \
+    "#endif\n\n"                                                  \
+    "/**\n"                                                       \
+    " * %3$s_version returns the version of the library.\n"       \
+    " */\n"                                                       \
+    "%4$s_API const char *%3$s_version(void);\n\n"                \
+    "#endif /* _%4$s_H */\n"
+
+#define LIBRARY_SOURCE_TEMPLATE                    \
+    "#include \"%1$s.h\"\n\n"                      \
+    "// implementation of %1$s. Version: %2$s\n\n" \
+    "%4$s_API const char *\n"                      \
+    "%3$s_version(void)\n"                         \
+    "{\n"                                          \
+    "    return \"%2$s\";\n"                       \
+    "}\n"
+
+#define LIBRARY_MAP_TEMPLATE                                 \
+    "# only the symbols listed here end up in the dynamic\n" \
+    "# symbol table, everything else stays local to %1$s\n"  \
+    "%3$s_%4$s {\n"                                          \
+    "    global:\n"                                          \
+    "        %2$s_*;\n"                                      \
+    "    local:\n"                                           \
+    "        *;\n"                                           \
+    "};\n"
+
+/**
+ * library_header_render renders the public header of a Flotsam library. The
+ * prefix is used for the exported symbols and the export macro.
+ */
+void
+library_header_render(FILE *fd, const char *name, const char *version,
+                      const char *prefix, const char *upper)
+{
+    fprintf(fd, LIBRARY_HEADER_TEMPLATE, name, version, prefix, upper);
+}
+
+/**
+ * library_source_render renders the initial source file of a Flotsam library.
+ */
+void
+library_source_render(FILE *fd, const char *name, const char *version,
+                      const char *prefix, const char *upper)
+{
+    fprintf(fd, LIBRARY_SOURCE_TEMPLATE, name, version, prefix, upper);
+}
+
+/**
+ * library_map_render renders the linker version script of a Flotsam library.
+ * The version node is named after the major version.
+ */
+void
+library_map_render(FILE *fd, const char *name, const char *prefix,
+                   const char *upper, const char *major)
+{
+    fprintf(fd, LIBRARY_MAP_TEMPLATE, name, prefix, upper, major);
+}
+
+#endif /* _LIBRARY_H */
@@ -0,0 +1,95 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <git2.h>
+#include <jansson.h>
+
+#include "config.h"
+#include "dependency.h"
+#include "lock.h"
+#include "util.h"
+
+int
+lock_write(const struct dependencies *deps)
+{
+    json_t *root = json_object();
+    json_t *arr = json_array();
+    json_object_set_new(root, "dependencies", arr);
+
+    for (int i = 0; i < deps->count; i++) {
+        struct dependency *dep = &deps->dependencies[i];
+
+        char commit[GIT_OID_HEXSZ + 1] = { 0 };
+        if (dependency_commit(dep, commit, sizeof(commit)) != 0) {
+            fprintf(stderr, "error: unable to resolve %s@%s\n", dep->name, dep->vers);
+            json_decref(root);
+            return -1;
+        }
+
+        json_t *item = json_object();
+        json_object_set_new(item, "name", json_string(dep->name));
+        json_object_set_new(item, "version", json_string(dep->vers));
+        json_object_set_new(item, "commit", json_string(commit));
+        json_object_set_new(item, "link",
+                            json_string(config_dependency_link(dep) == LINK_STATIC ? "static" : "dynamic"));
+        json_array_append_new(arr, item);
+    }
+
+    char *out = json_dumps(root, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    json_decref(root);
+    if (out == NULL) {
+        return -1;
+    }
+
+    int res = write_file_if_changed(FLOTSAM_LOCK_FILE, out);
+    free(out);
+
+    return res;
+}
+
+uint64_t
+lock_hash()
+{
+    size_t len = 0;
+    char *buf = read_file(FLOTSAM_LOCK_FILE, &len);
+    if (buf == NULL) {
+        return 0;
+    }
+
+    uint64_t h = hash_bytes(HASH_SEED, buf, len);
+    free(buf);
+
+    return h;
+}
@@ -25,7 +25,9 @@
  * SUCH DAMAGE.
  */
 
+#include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
 #include <ftw.h>
 #ifdef __linux__
 #include <linux/limits.h>
@@ -42,14 +44,25 @@
 
 #include <git2.h>
 
+#include "bench.h"
+#include "benchmark.h"
+#include "bisect.h"
+#include "build.h"
 #include "config.h"
 #include "dependency.h"
 #include "dockerfile.h"
 #include "flotsam.h"
 #include "gitignore.h"
+#include "library.h"
 #include "main.h"
 #include "makefile.h"
+#include "manifest.h"
+#include "profile.h"
 #include "readme.h"
+#include "timereport.h"
+#include "tune.h"
+#include "util.h"
+#include "watch.h"
 
 #define STR1(x) #x
 #define STR(x) STR1(x)
@@ -62,14 +75,55 @@
     "  new          --bin <name> create new binary application\n"             \
     "               --lib <name> create new library\n"                        \
     "  build        builds the project with the given build constraint.\n"    \
+    "  bench        builds the project and times its benchmark command or\n"  \
+    "               runs the micro-benchmarks in bench/.\n"                   \
+    "  bisect-perf  finds the first commit that made a benchmark slower.\n"   \
+    "  profile      samples the binary and writes a flamegraph. Arguments\n"  \
+    "               after -- are passed to the binary.\n"                     \
+    "  run          builds the project if needed and runs it. Arguments\n"    \
+    "               after -- are passed to the binary.\n"                     \
     "  config       display the current project configuration.\n"             \
     "  deps         displays the project's dependencies.\n"                   \
+    "  profiles     displays the available build profiles.\n"                 \
+    "  tune         benchmarks candidate profiles and saves the fastest.\n"   \
     "  update       retrieves newly added dependencies.\n"                    \
-    "  clean        cleans the current project based on the build parameter\n"
+    "  clean        cleans the current project based on the build parameter\n\n" \
+    "options:\n"                                                              \
+    "  --profile <name>  build the project and its dependencies with the\n"   \
+    "                    flags of the named profile.\n"                       \
+    "  --link-report     build: compare size and startup time of dynamic\n"   \
+    "                    and static linking.\n"                               \
+    "  --time-report     build: report compile time per translation unit\n"   \
+    "                    and the most expensive headers.\n"                   \
+    "  --link-time       build: compare link times of every profile.\n"       \
+    "  --amalgamate      build, run: compile the project and the sources\n"   \
+    "                    of its dependencies as one translation unit.\n"      \
+    "  --allocator <list>\n"                                                  \
+    "                    bench: compare the comma separated allocators,\n"    \
+    "                    e.g. system,jemalloc,mimalloc.\n"                    \
+    "  --counters        bench: read performance counters in the\n"           \
+    "                    micro-benchmarks.\n"                                 \
+    "  --save <name>     bench: also save the results as <name>.\n"           \
+    "  --baseline <name> bench: compare with saved results and fail on\n"     \
+    "                    significant regressions.\n"                          \
+    "  --compare <rev>   bench: compare the working tree with a revision,\n"  \
+    "                    running both interleaved.\n"                         \
+    "  --dep <name>=<v1>,<v2>\n"                                              \
+    "                    bench: compare two versions of a dependency.\n"      \
+    "  --good <rev>      bisect-perf: the last revision known to be fast.\n"  \
+    "  --bad <rev>       bisect-perf: the slow revision, HEAD by default.\n"  \
+    "  --bench <name>    bisect-perf: the micro-benchmark to measure.\n"      \
+    "  --threshold <pct> bisect-perf: regression threshold, e.g. 10%%.\n"     \
+    "  --heap            profile: profile allocations instead of time.\n"     \
+    "  --rate <bytes>    profile --heap: bytes between sampled allocations,\n" \
+    "                    0 to record every allocation.\n"                     \
+    "  --force           build, run: build even if nothing changed.\n"        \
+    "  --missing         update: only build dependencies that aren't built\n" \
+    "                    for the profile yet.\n"                              \
+    "  --watch           build, test: rebuild or rerun tests on changes.\n"
 
 #define MAX_NEW_CMD_ARG_COUNT 5
 #define DEFAULT_VERSION       "0.1.0"
-#define LIB_PREFIX            "lib"
 
 /**
  * FLOTSAM_BASE_DIRECTORY initializes a the flotsam_dir variable to contain the
@@ -99,7 +153,7 @@ enum project_type {
 
 // project_directories contains the list of directories that
 // need to be generated at project creation.
-static const char *project_directories[] = { "tests" };
+static const char *project_directories[] = { "src", "tests", "bench" };
 
 // project_files contains the list of files that need to be
 // generated at project creation.
@@ -113,6 +167,30 @@ static const char *license_types[] = {"bsd2", "bsd3", "mit", "isc"};
 // with_dockerfile stores whether or not a Dockerfile should be rendered.
 static int with_dockerfile = 0;
 
+/**
+ * symbol_prefix derives the prefix used for the exported symbols of a new
+ * library from its name, dropping a leading "lib" and replacing characters
+ * that can't appear in identifiers. The returned string needs to be freed.
+ */
+static char*
+symbol_prefix(const char *name, const int upper)
+{
+    if (strncmp(name, "lib", 3) == 0 && name[3] != '\0') {
+        name += 3;
+    }
+
+    char *prefix = strdup(name);
+    for (char *c = prefix; *c != '\0'; c++) {
+        if (!isalnum((unsigned char)*c)) {
+            *c = '_';
+        } else if (upper) {
+            *c = toupper((unsigned char)*c);
+        }
+    }
+
+    return prefix;
+}
+
 /**
  * render_templates creates and populates files with the necessary contents.
  */
@@ -149,23 +227,66 @@ render_templates(const enum project_type pt, const char *name)
         if (strcmp(project_files[i], "Flotsam.toml") == 0) {
             FILE *fd2;
             switch (pt) {
-                case bin:
+                case bin: {
                     flotsam_render(fd, name, DEFAULT_VERSION,
                                    getenv("USER"), "bin");
-                    fd2 = fopen("main.c", "w");
+                    fd2 = fopen("src/main.c", "w");
                     main_render(fd2, name, DEFAULT_VERSION);
                     fclose(fd2);
+
+                    struct strbuf path = { 0 };
+                    strbuf_appendf(&path, "bench/%s.c", name);
+                    fd2 = fopen(path.buf, "w");
+                    benchmark_bin_render(fd2, name);
+                    fclose(fd2);
+                    strbuf_free(&path);
                     break;
-                case lib:
+                }
+                case lib: {
                     flotsam_render(fd, name, DEFAULT_VERSION,
                                    getenv("USER"), "lib");
-                    lib_name = realloc(lib_name, 3);
-                    strcat(lib_name, ".h");
-                    fd2 = fopen(lib_name, "w");
+                    char *prefix = symbol_prefix(lib_name, 0);
+                    char *upper = symbol_prefix(lib_name, 1);
+                    char major[16];
+                    snprintf(major, sizeof(major), "%.*s",
+                             (int)strcspn(DEFAULT_VERSION, "."), DEFAULT_VERSION);
+
+                    struct strbuf path = { 0 };
+                    strbuf_appendf(&path, "%s.h", lib_name);
+                    fd2 = fopen(path.buf, "w");
+                    library_header_render(fd2, name, DEFAULT_VERSION, prefix, upper);
+                    fclose(fd2);
+                    strbuf_free(&path);
+
+                    strbuf_appendf(&path, "src/%s.c", lib_name);
+                    fd2 = fopen(path.buf, "w");
+                    library_source_render(fd2, name, DEFAULT_VERSION, prefix, upper);
+                    fclose(fd2);
+                    strbuf_free(&path);
+
+                    strbuf_appendf(&path, "%s.map", lib_name);
+                    fd2 = fopen(path.buf, "w");
+                    library_map_render(fd2, name, prefix, upper, major);
+                    fclose(fd2);
+                    strbuf_free(&path);
+
+                    strbuf_appendf(&path, "bench/%s.c", lib_name);
+                    fd2 = fopen(path.buf, "w");
+                    benchmark_lib_render(fd2, lib_name, prefix);
                     fclose(fd2);
-                    free(lib_name);
+                    strbuf_free(&path);
+
+                    free(prefix);
+                    free(upper);
                     break;
+                }
             }
+
+            FILE *header = fopen("bench/benchmark.h", "w");
+            fd2 = fopen("bench/benchmark.c", "w");
+            benchmark_harness_render(header, fd2);
+            fclose(header);
+            fclose(fd2);
         }
 
         if (strcmp(project_files[i], "Dockerfile") == 0 && pt == bin) {
@@ -176,6 +297,7 @@ render_templates(const enum project_type pt, const char *name)
 
         fclose(fd);
     }
+    free(lib_name);
 
     return 0;
 }
@@ -196,15 +318,142 @@ create_project_dirs(const enum project_type pt)
 }
 
 /**
- * strip_lib removes the "lib" prefix from the
- * given string if it's present.
+ * get_option returns the value following the given flag
+ * in the command's arguments or NULL if it isn't present.
  */
-static void
-strip_chars(char *s, const char *sc)
+static const char*
+get_option(int argc, char **argv, const char *flag)
+{
+    for (int i = 2; i < argc - 1 && strcmp(argv[i], "--") != 0; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * parse_rate parses the sampling rate of the heap
+ * profiler, a number of bytes. Without one the default
+ * rate is used.
+ */
+static int
+parse_rate(const char *value, long *rate)
 {
-    while ((s = strstr(s, sc))) {
-        memmove(s, s + strlen(sc), 1 + strlen(s + strlen(sc)));
+    if (value == NULL) {
+        *rate = PROFILE_HEAP_RATE;
+        return 0;
+    }
+
+    char *end;
+    errno = 0;
+    *rate = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno != 0 || *rate < 0) {
+        fprintf(stderr, "error: invalid rate: %s\n", value);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * has_flag returns 1 if the given flag is present in the
+ * command's arguments.
+ */
+static int
+has_flag(int argc, char **argv, const char *flag)
+{
+    for (int i = 2; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            return 1;
+        }
     }
+    return 0;
+}
+
+/**
+ * exec_binary replaces flotsam with the project's binary
+ * passing along the arguments given after "--". The
+ * project's lib dir is added to the library path.
+ */
+static int
+exec_binary(const char *output, int argc, char **argv)
+{
+    if (output == NULL || output[0] == '\0') {
+        fprintf(stderr, "error: only bin projects can be run\n");
+        return 1;
+    }
+
+    int first = argc;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            first = i + 1;
+            break;
+        }
+    }
+
+    char **args = calloc(argc - first + 2, sizeof(char*));
+    if (args == NULL) {
+        perror("unable to allocate memory for arguments");
+        return 1;
+    }
+    args[0] = (char*)output;
+    for (int i = first; i < argc; i++) {
+        args[i - first + 1] = argv[i];
+    }
+
+#ifdef __APPLE__
+    const char *lib_path_var = "DYLD_LIBRARY_PATH";
+#else
+    const char *lib_path_var = "LD_LIBRARY_PATH";
+#endif
+    struct strbuf lib_path = { 0 };
+    strbuf_append(&lib_path, PROJECT_LIB_DIR);
+    if (getenv(lib_path_var) != NULL) {
+        strbuf_appendf(&lib_path, ":%s", getenv(lib_path_var));
+    }
+    setenv(lib_path_var, lib_path.buf, 1);
+    strbuf_free(&lib_path);
+
+    execv(output, args);
+    perror(output);
+    free(args);
+
+    return 127;
+}
+
+/**
+ * fast_path handles build and run when nothing changed
+ * since the last build without loading the config or
+ * spawning anything. It returns -1 if a build is needed.
+ */
+static int
+fast_path(int argc, char **argv, uint64_t key)
+{
+    if (strcmp(argv[1], "build") != 0 && strcmp(argv[1], "run") != 0) {
+        return -1;
+    }
+    if (has_flag(argc, argv, "--force") || has_flag(argc, argv, "--link-report") ||
+        has_flag(argc, argv, "--time-report") || has_flag(argc, argv, "--link-time") ||
+        has_flag(argc, argv, "--watch")) {
+        return -1;
+    }
+
+    char *output = NULL;
+    if (!manifest_fresh(key, &output)) {
+        return -1;
+    }
+
+    if (strcmp(argv[1], "run") == 0) {
+        int res = exec_binary(output, argc, argv);
+        free(output);
+        return res;
+    }
+
+    printf("%s is up to date\n", output[0] != '\0' ? output : "project");
+    free(output);
+
+    return 0;
 }
 
 int
@@ -215,6 +464,19 @@ main(int argc, char **argv)
         return 1;
     }
 
+    // the compiler wrapper used by build --time-report
+    if (argc > 2 && strcmp(argv[1], TIMEREPORT_WRAP_CMD) == 0) {
+        return timereport_wrap(argc - 2, argv + 2);
+    }
+
+    // taken before the config can change the environment
+    uint64_t key = manifest_key(argc, argv);
+
+    int res = fast_path(argc, argv, key);
+    if (res >= 0) {
+        return res;
+    }
+
     git_libgit2_init();
 
     for (int i = 1; i < argc; i++) {
@@ -307,55 +569,63 @@ main(int argc, char **argv)
 
         INITIALIZE_FLOTSAM_DIR;
 
-        config_init();
+        if (config_init() != 0) {
+            return 1;
+        }
 
-        struct dependencies* deps = config_get_dependencies();
+        const char *profile_name = get_option(argc, argv, "--profile");
+        if (profile_name != NULL && config_set_profile(profile_name) != 0) {
+            fprintf(stderr, "error: unknown profile: %s\n", profile_name);
+            return 1;
+        }
+        struct profile *profile = config_get_profile();
+        if (has_flag(argc, argv, "--amalgamate")) {
+            config_set_amalgamate(1);
+        }
 
         if (strcmp(argv[i], "build") == 0) {
-            char* build_cmd = config_get_build();
-            build_cmd = realloc(build_cmd, 14);
-            char* home_dir = getenv("HOME");
-
-            for (int i = 0; i < deps->count; i++) {
-                build_cmd = realloc(build_cmd,
-                                    28 + strlen(deps->dependencies[i].name) + strlen(deps->dependencies[i].vers) +
-                                      strlen(home_dir));
-                strcat(build_cmd, " CFLAGS+='-I");
-                strcat(build_cmd, home_dir);
-                strcat(build_cmd, "/.flotsam/");
-                strcat(build_cmd, deps->dependencies[i].name);
-                strcat(build_cmd, "@");
-                strcat(build_cmd, deps->dependencies[i].vers);
-                strcat(build_cmd, "'");
-                strcat(build_cmd, " LDFLAGS+='-L");
-                strcat(build_cmd, home_dir);
-                strcat(build_cmd, "/.flotsam/");
-                strcat(build_cmd, deps->dependencies[i].name);
-                strcat(build_cmd, "@");
-                strcat(build_cmd, deps->dependencies[i].vers);
-                strcat(build_cmd, "'");
-                strcat(build_cmd, " LDFLAGS+='-l");
-                strip_chars(deps->dependencies[i].name, LIB_PREFIX);
-                strip_chars(deps->dependencies[i].name, ".h");
-                strcat(build_cmd, "'");
-                char* lib_name = strrchr(deps->dependencies[i].name, '/') + 1;
-                strcat(build_cmd, lib_name);
+            if (has_flag(argc, argv, "--link-report")) {
+                if (build_link_report(profile) != 0) {
+                    return 1;
+                }
+                break;
             }
-
-            if (system(build_cmd) != 0) {
+            if (has_flag(argc, argv, "--link-time")) {
+                if (timereport_links() != 0) {
+                    return 1;
+                }
+                break;
+            }
+            if (has_flag(argc, argv, "--time-report")) {
+                if (timereport_build(profile) != 0) {
+                    return 1;
+                }
+                break;
+            }
+            if (has_flag(argc, argv, "--watch")) {
+                return watch_run(WATCH_BUILD, profile_name, key);
+            }
+            if (build_recorded(profile, key) != 0) {
                 return 1;
             }
-            free(build_cmd);
             break;
         }
+        if (strcmp(argv[i], "run") == 0) {
+            if (build_recorded(profile, key) != 0) {
+                return 1;
+            }
+            char *output = build_output();
+            int res = exec_binary(output, argc, argv);
+            free(output);
+            return res;
+        }
         if (strcmp(argv[i], "install") == 0) {
-            char* test_cmd = config_get_build();
-            test_cmd = realloc(test_cmd, 9);
-            strcat(test_cmd, " install");
-            if (system(test_cmd) != 0) {
+            struct strbuf test_cmd = { 0 };
+            strbuf_appendf(&test_cmd, "%s install", config_get_build());
+            if (system(test_cmd.buf) != 0) {
                 return 1;
             }
-            free(test_cmd);
+            strbuf_free(&test_cmd);
             break;
         }
         if (strcmp(argv[i], "config") == 0) {
@@ -370,33 +640,91 @@ main(int argc, char **argv)
             }
             break;
         }
+        if (strcmp(argv[i], "profiles") == 0) {
+            if (config_print_profiles() != 0) {
+                perror("error reading config");
+            }
+            break;
+        }
         if (strcmp(argv[i], "test") == 0) {
-            char* test_cmd = config_get_build();
-            test_cmd = realloc(test_cmd, 6);
-            strcat(test_cmd, " test");
-            if (system(test_cmd) != 0) {
+            if (has_flag(argc, argv, "--watch")) {
+                return watch_run(WATCH_TEST, profile_name, key);
+            }
+            struct strbuf test_cmd = { 0 };
+            strbuf_appendf(&test_cmd, "%s test", config_get_build());
+            if (system(test_cmd.buf) != 0) {
                 return 1;
             }
-            free(test_cmd);
+            strbuf_free(&test_cmd);
             break;
         }
-        if (strcmp(argv[i], "update") == 0) {
-            struct dependencies* deps = config_get_dependencies();
-            for (int i = 0; i < deps->count; i++) {
-                if (dependency_update(deps->dependencies[i].name, deps->dependencies[i].vers) != 0) {
+        if (strcmp(argv[i], "bench") == 0) {
+            if (has_flag(argc, argv, "--counters")) {
+                bench_set_counters(1);
+            }
+            const char *allocators = get_option(argc, argv, "--allocator");
+            if (allocators != NULL) {
+                return bench_allocators(profile, allocators);
+            }
+            if (profile_name == NULL && profile == NULL) {
+                config_set_profile(BENCH_PROFILE);
+                profile = config_get_profile();
+            }
+            const char *rev = get_option(argc, argv, "--compare");
+            if (rev != NULL) {
+                return bench_compare(profile, rev);
+            }
+            const char *dep = get_option(argc, argv, "--dep");
+            if (dep != NULL) {
+                return bench_dep(profile, dep);
+            }
+            return bench_run(profile, get_option(argc, argv, "--save"),
+                             get_option(argc, argv, "--baseline"));
+        }
+        if (strcmp(argv[i], "bisect-perf") == 0) {
+            const char *good = get_option(argc, argv, "--good");
+            const char *bad = get_option(argc, argv, "--bad");
+            if (good == NULL) {
+                fprintf(stderr, "error: bisect-perf needs a --good revision\n");
+                return 1;
+            }
+            return bisect_perf(profile, good, bad != NULL ? bad : "HEAD",
+                               get_option(argc, argv, "--bench"),
+                               get_option(argc, argv, "--threshold"));
+        }
+        if (strcmp(argv[i], "profile") == 0) {
+            int first = argc;
+            for (int j = 2; j < argc; j++) {
+                if (strcmp(argv[j], "--") == 0) {
+                    first = j + 1;
+                    break;
+                }
+            }
+            if (has_flag(argc, argv, "--heap")) {
+                long rate;
+                if (parse_rate(get_option(argc, argv, "--rate"), &rate) != 0) {
                     return 1;
                 }
+                return profile_heap(profile, argc - first, argv + first, rate);
+            }
+            return profile_run(profile, argc - first, argv + first);
+        }
+        if (strcmp(argv[i], "tune") == 0) {
+            return tune_run(profile);
+        }
+        if (strcmp(argv[i], "update") == 0) {
+            if (build_update(profile, has_flag(argc, argv, "--missing")) != 0) {
+                return 1;
             }
             break;
         }
         if (strcmp(argv[i], "clean") == 0) {
-            char* test_cmd = config_get_build();
-            test_cmd = realloc(test_cmd, 7);
-            strcat(test_cmd, " clean");
-            if (system(test_cmd) != 0) {
+            struct strbuf test_cmd = { 0 };
+            strbuf_appendf(&test_cmd, "%s clean", config_get_build());
+            if (system(test_cmd.buf) != 0) {
                 return 1;
             }
-            free(test_cmd);
+            strbuf_free(&test_cmd);
             break;
         }
 
@@ -30,51 +30,154 @@
 
 #include <stdio.h>
 
-#define MAKEFILE_BIN_TEMPLATE                                                                \
-    "CC               ?= cc\n"                                                               \
-    "DOCKER           ?= docker\n\n"                                                         \
-    "VERSION          := %2$s\n"                                                             \
-    "BINDIR           := bin\n"                                                              \
-    "BINARY           := %1$s\n"                                                             \
-    "override LDFLAGS +=\n"                                                                  \
-    "override CFLAGS  += -Dapp_name=$(BINARY) -Dgit_sha=$(shell git rev-parse HEAD) -O3\n\n" \
-    "$(BINDIR)/$(BINARY): $(BINDIR) clean\n"                                                 \
-    "\t$(CC) main.c $(CFLAGS) -o $(BINDIR)/$(BINARY) $(LDFLAGS)\n\n"                         \
-    "$(BINDIR):\n"                                                                           \
-    "\tmkdir -p $(BINDIR)\n\n"                                                               \
-    "$(DEPDIR):\n"                                                                           \
-    "\tmkdir -p $(DEPDIR)\n\n"                                                               \
-    ".PHONY: image\n"                                                                        \
-    "image:\n"                                                                               \
-    "\t$(DOCKER) build -t $(BINARY):latest .\n\n"                                            \
-    ".PHONY: push\n"                                                                         \
-    "push:\n\n"                                                                              \
-    ".PHONY: deps\n"                                                                         \
-    "deps: $(DEPDIR)\n\n"                                                                    \
-    ".PHONY: clean\n"                                                                        \
-    "clean:\n"                                                                               \
-    "\trm -f $(BINDIR)/*\n\n"
+#define MAKEFILE_BIN_TEMPLATE                                                  \
+    "CC                ?= cc\n"                                                \
+    "DOCKER            ?= docker\n\n"                                          \
+    "VERSION           := %2$s\n"                                              \
+    "BINDIR            := bin\n"                                               \
+    "OBJDIR            := build\n"                                             \
+    "SRCDIR            := src\n"                                               \
+    "BINARY            := %1$s\n"                                              \
+    "ifndef GIT_SHA\n"                                                         \
+    "GIT_SHA           := $(shell git rev-parse HEAD 2>/dev/null)\n"           \
+    "endif\n\n"                                                                \
+    "SRCS              := $(wildcard $(SRCDIR)/*.c)\n"                         \
+    "OBJS              := $(SRCS:$(SRCDIR)/%%.c=$(OBJDIR)/%%.o)\n"             \
+    "BENCHDIR          := bench\n"                                             \
+    "BENCHSRCS         := $(wildcard $(BENCHDIR)/*.c)\n"                       \
+    "BENCHOBJS         := $(BENCHSRCS:%%.c=$(OBJDIR)/%%.o)\n"                  \
+    "BENCH             := $(OBJDIR)/$(BENCHDIR)/bench\n\n"                     \
+    "override LDFLAGS  +=\n"                                                   \
+    "override CFLAGS   += -Dapp_name=$(BINARY) -Dgit_sha=$(GIT_SHA) -O3\n"     \
+    "override CPPFLAGS += -MMD -MP\n\n"                                        \
+    "-include flotsam.mk\n\n"                                                  \
+    "# objects are rebuilt when the flags change, e.g. when\n"                 \
+    "# switching profiles, but not for every new commit\n"                     \
+    "FLAGS             := $(CC) $(CPPFLAGS) $(CFLAGS) $(LDFLAGS)\n"            \
+    "FLAGS             := $(filter-out -Dgit_sha=%%,$(FLAGS))\n"               \
+    "STAMP             := $(OBJDIR)/.flags\n"                                  \
+    "# quoted for the shell as the flags may contain quotes\n"                 \
+    "FLAGS_QUOTED      := '$(subst ','\\'',$(FLAGS))'\n"                       \
+    "ifneq ($(shell cat $(STAMP) 2>/dev/null),$(FLAGS))\n"                     \
+    "$(shell mkdir -p $(OBJDIR) && printf '%%s' $(FLAGS_QUOTED) > $(STAMP))\n" \
+    "endif\n\n"                                                                \
+    "$(BINDIR)/$(BINARY): $(OBJS) $(STAMP) | $(BINDIR)\n"                      \
+    "\t$(CC) $(CFLAGS) $(OBJS) -o $@ $(LDFLAGS)\n\n"                           \
+    "$(OBJDIR)/%%.o: $(SRCDIR)/%%.c $(STAMP)\n"                                \
+    "\t$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@\n\n"                            \
+    "# benchmarks are linked against the project objects and run\n"            \
+    "# with BENCHFLAGS, see bench/benchmark.c for the options,\n"              \
+    "# and prefixed with BENCHRUN, e.g. to pin them to a CPU\n"                \
+    "$(BENCH): $(filter-out $(OBJDIR)/main.o,$(OBJS)) $(BENCHOBJS) $(STAMP)\n" \
+    "\t$(CC) $(CFLAGS) $(filter %%.o,$^) -o $@ $(LDFLAGS)\n\n"                 \
+    "$(OBJDIR)/$(BENCHDIR)/%%.o: $(BENCHDIR)/%%.c $(STAMP)\n"                  \
+    "\t@mkdir -p $(@D)\n"                                                      \
+    "\t$(CC) $(CPPFLAGS) $(CFLAGS) -I$(SRCDIR) -c $< -o $@\n\n"                \
+    ".PHONY: bench\n"                                                          \
+    "bench: $(BENCH)\n"                                                        \
+    "\t$(BENCHRUN) ./$(BENCH) $(BENCHFLAGS)\n\n"                               \
+    "$(BINDIR):\n"                                                             \
+    "\tmkdir -p $(BINDIR)\n\n"                                                 \
+    "-include $(OBJS:.o=.d) $(BENCHOBJS:.o=.d)\n\n"                            \
+    ".PHONY: image\n"                                                          \
+    "image:\n"                                                                 \
+    "\t$(DOCKER) build -t $(BINARY):latest .\n\n"                              \
+    ".PHONY: push\n"                                                           \
+    "push:\n\n"                                                                \
+    ".PHONY: clean\n"                                                          \
+    "clean:\n"                                                                 \
+    "\trm -rf $(BINDIR)/* $(OBJDIR)\n\n"
 
 #define MAKEFILE_LIB_TEMPLATE                                                \
-    "CC      ?= cc\n\n"                                                      \
-    "VERSION := %2$s\n"                                                      \
-    "NAME    := %1$s\n\n"                                                    \
-    "INCDIR  := /usr/local/include\n"                                        \
-    "LIBDIR  := /usr/local/lib\n\n"                                          \
-    "UNAME_S := $(shell uname -s)\n\n"                                       \
-    "ifeq ($(UNAME_S),Linux)\n"                                              \
-    "$(NAME).$(VERSION).so:\n"                                               \
-    "\t$(CC)  -c $(CFLAGS) -shared -o $(NAME).so %1$s.c  $(LDFLAGS)\n"       \
-    "endif\n"                                                                \
+    "CC                ?= cc\n"                                              \
+    "AR                ?= ar\n\n"                                            \
+    "VERSION           := %2$s\n"                                            \
+    "MAJOR             := $(firstword $(subst ., ,$(VERSION)))\n"            \
+    "NAME              := %1$s\n"                                            \
+    "LIBNAME           := $(patsubst lib%%,%%,$(NAME))\n"                    \
+    "OBJDIR            := build\n"                                           \
+    "SRCDIR            := src\n\n"                                           \
+    "INCDIR            := /usr/local/include\n"                              \
+    "LIBDIR            := /usr/local/lib\n\n"                                \
+    "UNAME_S           := $(shell uname -s)\n\n"                             \
+    "ifndef GIT_SHA\n"                                                       \
+    "GIT_SHA           := $(shell git rev-parse HEAD 2>/dev/null)\n"         \
+    "endif\n\n"                                                              \
+    "ARCHIVE           := lib$(LIBNAME).a\n"                                 \
     "ifeq ($(UNAME_S),Darwin)\n"                                             \
-    "$(NAME).$(VERSION).dylib:\n"                                            \
-    "\t$(CC) -c $(CFLAGS) -dynamiclib -o $(NAME).dylib %1$s.c  $(LDFLAGS)\n" \
+    "LIBRARY           := lib$(LIBNAME).dylib\n"                             \
+    "SONAME            := lib$(LIBNAME).$(MAJOR).dylib\n"                    \
+    "REALNAME          := lib$(LIBNAME).$(VERSION).dylib\n"                  \
+    "SHARED            := -dynamiclib -install_name @rpath/$(SONAME) \\\n"   \
+    "                     -compatibility_version $(MAJOR) \\\n"              \
+    "                     -current_version $(VERSION)\n"                     \
+    "else\n"                                                                 \
+    "LIBRARY           := lib$(LIBNAME).so\n"                                \
+    "SONAME            := $(LIBRARY).$(MAJOR)\n"                             \
+    "REALNAME          := $(LIBRARY).$(VERSION)\n"                           \
+    "SHARED            := -shared -Wl,-soname,$(SONAME) \\\n"                \
+    "                     -Wl,--version-script=$(NAME).map\n"                \
+    "endif\n\n"                                                              \
+    "SRCS              := $(wildcard $(SRCDIR)/*.c)\n"                       \
+    "OBJS              := $(SRCS:$(SRCDIR)/%%.c=$(OBJDIR)/%%.o)\n"           \
+    "BENCHDIR          := bench\n"                                           \
+    "BENCHSRCS         := $(wildcard $(BENCHDIR)/*.c)\n"                     \
+    "BENCHOBJS         := $(BENCHSRCS:%%.c=$(OBJDIR)/%%.o)\n"                \
+    "BENCH             := $(OBJDIR)/$(BENCHDIR)/bench\n\n"                   \
+    "# only symbols marked with the export macro in $(NAME).h are\n"         \
+    "# visible, calls within the library can be inlined and bound\n"         \
+    "# locally instead of going through the PLT\n"                           \
+    "override LDFLAGS  +=\n"                                                 \
+    "override CFLAGS   += -Dgit_sha=$(GIT_SHA) -O3 -fpic -I. \\\n"           \
+    "                     -fvisibility=hidden -fno-semantic-interposition\n" \
+    "override CPPFLAGS += -MMD -MP\n\n"                                      \
+    "-include flotsam.mk\n\n"                                                \
+    "# objects are rebuilt when the flags change, e.g. when\n"               \
+    "# switching profiles, but not for every new commit\n"                   \
+    "FLAGS             := $(CC) $(CPPFLAGS) $(CFLAGS) $(LDFLAGS)\n"          \
+    "FLAGS             := $(filter-out -Dgit_sha=%%,$(FLAGS))\n"             \
+    "STAMP             := $(OBJDIR)/.flags\n"                                \
+    "# quoted for the shell as the flags may contain quotes\n"               \
+    "FLAGS_QUOTED      := '$(subst ','\\'',$(FLAGS))'\n"                     \
+    "ifneq ($(shell cat $(STAMP) 2>/dev/null),$(FLAGS))\n"                   \
+    "$(shell mkdir -p $(OBJDIR) && printf '%%s' $(FLAGS_QUOTED) > $(STAMP))\n" \
     "endif\n\n"                                                              \
-    "override LDFLAGS +=\n"                                                  \
-    "override CFLAGS  += -Dgit_sha=$(shell git rev-parse HEAD) -O3\n\n"      \
+    ".PHONY: all\n"                                                          \
+    "all: $(LIBRARY) $(ARCHIVE)\n\n"                                         \
+    "$(REALNAME): $(OBJS) $(STAMP) $(NAME).map\n"                            \
+    "\t$(CC) $(SHARED) $(CFLAGS) $(OBJS) -o $@ $(LDFLAGS)\n\n"               \
+    "$(SONAME): $(REALNAME)\n"                                               \
+    "\tln -sf $(REALNAME) $@\n\n"                                            \
+    "$(LIBRARY): $(SONAME)\n"                                                \
+    "\tln -sf $(SONAME) $@\n\n"                                              \
+    "$(ARCHIVE): $(OBJS) $(STAMP)\n"                                         \
+    "\trm -f $@\n"                                                           \
+    "\t$(AR) rcs $@ $(OBJS)\n\n"                                             \
+    "$(OBJDIR)/%%.o: $(SRCDIR)/%%.c $(STAMP)\n"                              \
+    "\t$(CC) $(CPPFLAGS) $(CFLAGS) -c $< -o $@\n\n"                          \
+    "# benchmarks are linked against the project objects and run\n"          \
+    "# with BENCHFLAGS, see bench/benchmark.c for the options,\n"            \
+    "# and prefixed with BENCHRUN, e.g. to pin them to a CPU\n"              \
+    "$(BENCH): $(OBJS) $(BENCHOBJS) $(STAMP)\n"                              \
+    "\t$(CC) $(CFLAGS) $(filter %%.o,$^) -o $@ $(LDFLAGS)\n\n"               \
+    "$(OBJDIR)/$(BENCHDIR)/%%.o: $(BENCHDIR)/%%.c $(STAMP)\n"                \
+    "\t@mkdir -p $(@D)\n"                                                    \
+    "\t$(CC) $(CPPFLAGS) $(CFLAGS) -I$(SRCDIR) -c $< -o $@\n\n"              \
+    ".PHONY: bench\n"                                                        \
+    "bench: $(BENCH)\n"                                                      \
+    "\t$(BENCHRUN) ./$(BENCH) $(BENCHFLAGS)\n\n"                             \
+    "-include $(OBJS:.o=.d) $(BENCHOBJS:.o=.d)\n\n"                          \
+    ".PHONY: install\n"                                                      \
+    "install: all\n"                                                         \
+    "\tinstall -d $(DESTDIR)$(INCDIR) $(DESTDIR)$(LIBDIR)\n"                 \
+    "\tinstall -m 644 $(NAME).h $(DESTDIR)$(INCDIR)\n"                       \
+    "\tinstall -m 644 $(ARCHIVE) $(DESTDIR)$(LIBDIR)\n"                      \
+    "\tinstall -m 755 $(REALNAME) $(DESTDIR)$(LIBDIR)\n"                     \
+    "\tln -sf $(REALNAME) $(DESTDIR)$(LIBDIR)/$(SONAME)\n"                   \
+    "\tln -sf $(SONAME) $(DESTDIR)$(LIBDIR)/$(LIBRARY)\n\n"                  \
     ".PHONY: clean\n"                                                        \
     "clean:\n"                                                               \
-    "\trm -f $(BINDIR)/*\n\n"
+    "\trm -rf $(LIBRARY) $(SONAME) $(REALNAME) $(ARCHIVE) $(OBJDIR)\n\n"
 
 /**
  * makefile_bin_render perform the rendering for a Makefile used with 
@@ -0,0 +1,401 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "manifest.h"
+#include "toolchain.h"
+#include "util.h"
+
+#define MANIFEST_DIR     ".flotsam"
+#define MANIFEST_VERSION "flotsam-manifest 1"
+
+#ifdef __APPLE__
+#define MTIME_NSEC(s) ((s).st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(s) ((s).st_mtim.tv_nsec)
+#endif
+
+// skip_dirs aren't build inputs or are covered by another
+// input, like the header tree which follows Flotsam.lock.
+static const char *skip_dirs[] = { "bin", "build", "deps/include", "deps/pkgconfig" };
+
+// input_exts are the file extensions considered inputs.
+static const char *input_exts[] = { ".c", ".h", ".json", ".lock", ".mk", ".a", ".so", ".dylib" };
+
+// key_env are the environment variables that change the
+// output of a build.
+static const char *key_env[] = { "CC", "CFLAGS", "LDFLAGS", "CPPFLAGS" };
+
+uint64_t
+manifest_key(int argc, char **argv)
+{
+    uint64_t h = HASH_SEED;
+
+    for (int i = 2; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        if (strcmp(argv[i], "--force") == 0 || strcmp(argv[i], "--watch") == 0) {
+            continue;
+        }
+        h = hash_str(h, argv[i]);
+    }
+    for (size_t i = 0; i < sizeof(key_env) / sizeof(key_env[0]); i++) {
+        h = hash_str(h, key_env[i]);
+        h = hash_str(h, getenv(key_env[i]));
+    }
+
+    // a replaced compiler invalidates the build
+    uint64_t tc = toolchain_id();
+    h = hash_bytes(h, &tc, sizeof(tc));
+
+    return h;
+}
+
+/**
+ * is_input returns 1 if the given file name is a build
+ * input.
+ */
+static int
+is_input(const char *name)
+{
+    if (strcmp(name, "Makefile") == 0) {
+        return 1;
+    }
+
+    size_t len = strlen(name);
+    for (size_t i = 0; i < sizeof(input_exts) / sizeof(input_exts[0]); i++) {
+        size_t ext_len = strlen(input_exts[i]);
+        if (len > ext_len && strcmp(name + len - ext_len, input_exts[i]) == 0) {
+            return 1;
+        }
+    }
+
+    // versioned shared objects such as libfoo.so.1
+    return strstr(name, ".so.") != NULL;
+}
+
+/**
+ * is_skipped returns 1 if the directory isn't walked.
+ */
+static int
+is_skipped(const char *rel)
+{
+    for (size_t i = 0; i < sizeof(skip_dirs) / sizeof(skip_dirs[0]); i++) {
+        if (strcmp(rel, skip_dirs[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * add_entry appends an entry for the given file.
+ */
+static int
+add_entry(struct manifest *m, const char *rel, const struct stat *s)
+{
+    struct manifest_entry *e = realloc(m->entries, (m->count + 1) * sizeof(struct manifest_entry));
+    if (e == NULL) {
+        perror("unable to allocate memory for manifest");
+        return -1;
+    }
+    m->entries = e;
+
+    e = &m->entries[m->count++];
+    e->path = strdup(rel);
+    e->hash = 0;
+    e->size = (int64_t)s->st_size;
+    e->mtime_sec = (int64_t)s->st_mtime;
+    e->mtime_nsec = (int64_t)MTIME_NSEC(*s);
+    e->ino = (uint64_t)s->st_ino;
+
+    return 0;
+}
+
+/**
+ * walk adds every input below the given directory
+ * without hashing them. Hidden files and directories,
+ * .git and .flotsam included, are skipped.
+ */
+static int
+walk(struct manifest *m, const char *rel)
+{
+    DIR *dp = opendir(rel[0] ? rel : ".");
+    if (dp == NULL) {
+        return -1;
+    }
+
+    int res = 0;
+    struct dirent *dirp;
+    while (res == 0 && (dirp = readdir(dp)) != NULL) {
+        if (dirp->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        if (snprintf(path, PATH_MAX, "%s%s%s", rel, rel[0] ? "/" : "", dirp->d_name) >= PATH_MAX) {
+            continue;
+        }
+
+        struct stat s;
+        if (stat(path, &s) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(s.st_mode)) {
+            if (!is_skipped(path)) {
+                res = walk(m, path);
+            }
+        } else if (S_ISREG(s.st_mode) && is_input(dirp->d_name)) {
+            res = add_entry(m, path, &s);
+        }
+    }
+    closedir(dp);
+
+    return res;
+}
+
+/**
+ * cmp_entry orders entries by path.
+ */
+static int
+cmp_entry(const void *a, const void *b)
+{
+    return strcmp(((const struct manifest_entry *)a)->path,
+                  ((const struct manifest_entry *)b)->path);
+}
+
+/**
+ * hash_file returns the content hash of the given file.
+ */
+static int
+hash_file(const char *path, uint64_t *hash)
+{
+    size_t len = 0;
+    char *buf = read_file(path, &len);
+    if (buf == NULL) {
+        return -1;
+    }
+    *hash = hash_bytes(HASH_SEED, buf, len);
+    free(buf);
+
+    return 0;
+}
+
+/**
+ * scan collects the current inputs sorted by path.
+ */
+static int
+scan(struct manifest *m)
+{
+    if (walk(m, "") != 0) {
+        return -1;
+    }
+    qsort(m->entries, m->count, sizeof(struct manifest_entry), cmp_entry);
+
+    return 0;
+}
+
+int
+manifest_snapshot(struct manifest *m, uint64_t key, const char *output)
+{
+    memset(m, 0, sizeof(struct manifest));
+    m->key = key;
+    m->output = strdup(output != NULL ? output : "");
+
+    if (scan(m) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < m->count; i++) {
+        if (hash_file(m->entries[i].path, &m->entries[i].hash) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+manifest_save(const struct manifest *m)
+{
+    if (mkdir_p(MANIFEST_DIR, 0700) != 0) {
+        perror(MANIFEST_DIR);
+        return -1;
+    }
+
+    FILE *fd = fopen(MANIFEST_FILE, "w");
+    if (fd == NULL) {
+        perror(MANIFEST_FILE);
+        return -1;
+    }
+
+    fprintf(fd, "%s\nkey %016" PRIx64 "\noutput %s\n", MANIFEST_VERSION, m->key, m->output);
+    for (int i = 0; i < m->count; i++) {
+        struct manifest_entry *e = &m->entries[i];
+        fprintf(fd, "%016" PRIx64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRIu64 " %s\n",
+                e->hash, e->size, e->mtime_sec, e->mtime_nsec, e->ino, e->path);
+    }
+
+    return fclose(fd) == 0 ? 0 : -1;
+}
+
+/**
+ * load reads MANIFEST_FILE.
+ */
+static int
+load(struct manifest *m)
+{
+    memset(m, 0, sizeof(struct manifest));
+
+    FILE *fd = fopen(MANIFEST_FILE, "r");
+    if (fd == NULL) {
+        return -1;
+    }
+
+    char line[PATH_MAX + 128];
+    int res = -1;
+
+    if (fgets(line, sizeof(line), fd) == NULL ||
+        strncmp(line, MANIFEST_VERSION, strlen(MANIFEST_VERSION)) != 0) {
+        goto out;
+    }
+    if (fgets(line, sizeof(line), fd) == NULL ||
+        sscanf(line, "key %" SCNx64, &m->key) != 1) {
+        goto out;
+    }
+    if (fgets(line, sizeof(line), fd) == NULL || strncmp(line, "output ", 7) != 0) {
+        goto out;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    m->output = strdup(line + 7);
+
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        struct manifest_entry e;
+        int off = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%" SCNx64 " %" SCNd64 " %" SCNd64 " %" SCNd64 " %" SCNu64 " %n",
+                   &e.hash, &e.size, &e.mtime_sec, &e.mtime_nsec, &e.ino, &off) != 5 || off == 0) {
+            goto out;
+        }
+
+        struct manifest_entry *entries = realloc(m->entries, (m->count + 1) * sizeof(struct manifest_entry));
+        if (entries == NULL) {
+            goto out;
+        }
+        m->entries = entries;
+        e.path = strdup(line + off);
+        m->entries[m->count++] = e;
+    }
+    res = 0;
+
+out:
+    fclose(fd);
+
+    return res;
+}
+
+int
+manifest_fresh(uint64_t key, char **output)
+{
+    struct manifest prev;
+    struct manifest cur = { 0 };
+    int fresh = 0;
+    int touched = 0;
+
+    if (load(&prev) != 0 || prev.key != key) {
+        goto out;
+    }
+    if (prev.output[0] != '\0' && access(prev.output, X_OK) != 0) {
+        goto out;
+    }
+    if (scan(&cur) != 0 || cur.count != prev.count) {
+        goto out;
+    }
+
+    for (int i = 0; i < cur.count; i++) {
+        struct manifest_entry *c = &cur.entries[i];
+        struct manifest_entry *p = &prev.entries[i];
+
+        if (strcmp(c->path, p->path) != 0) {
+            goto out;
+        }
+        if (c->size == p->size && c->mtime_sec == p->mtime_sec &&
+            c->mtime_nsec == p->mtime_nsec && c->ino == p->ino) {
+            continue;
+        }
+
+        // touched but possibly unchanged, e.g. after a checkout
+        if (c->size != p->size || hash_file(c->path, &c->hash) != 0 || c->hash != p->hash) {
+            goto out;
+        }
+        p->size = c->size;
+        p->mtime_sec = c->mtime_sec;
+        p->mtime_nsec = c->mtime_nsec;
+        p->ino = c->ino;
+        touched = 1;
+    }
+    fresh = 1;
+
+    // record the new stat data so the next check doesn't
+    // have to hash again
+    if (touched) {
+        manifest_save(&prev);
+    }
+    if (output != NULL) {
+        *output = strdup(prev.output);
+    }
+
+out:
+    manifest_free(&prev);
+    manifest_free(&cur);
+
+    return fresh;
+}
+
+void
+manifest_free(struct manifest *m)
+{
+    for (int i = 0; i < m->count; i++) {
+        free(m->entries[i].path);
+    }
+    free(m->entries);
+    free(m->output);
+    memset(m, 0, sizeof(struct manifest));
+}
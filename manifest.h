@@ -0,0 +1,103 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _MANIFEST_H
+#define _MANIFEST_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define MANIFEST_FILE ".flotsam/build.manifest"
+
+/**
+ * manifest_entry is a single build input with the stat
+ * metadata and content hash it had at build time.
+ */
+struct manifest_entry
+{
+    char *path;
+    uint64_t hash;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+};
+
+/**
+ * manifest records the inputs of the last successful
+ * build along with a key covering the options and
+ * environment it was built with.
+ */
+struct manifest
+{
+    uint64_t key;
+    char *output;
+    int count;
+    struct manifest_entry *entries;
+};
+
+/**
+ * manifest_key returns a key for the options given to the command, everything
+ * before a "--" besides the command itself, --force and --watch, the
+ * environment variables that change what the build produces and the identity
+ * of the compiler.
+ */
+uint64_t
+manifest_key(int argc, char **argv);
+
+/**
+ * manifest_snapshot records the current state of the project's build inputs:
+ * sources, headers, Makefiles, Flotsam.json, Flotsam.lock and the installed
+ * dependency libraries. Take it before building so edits made during the
+ * build aren't missed.
+ */
+int
+manifest_snapshot(struct manifest *m, uint64_t key, const char *output);
+
+/**
+ * manifest_save writes the manifest to MANIFEST_FILE.
+ */
+int
+manifest_save(const struct manifest *m);
+
+/**
+ * manifest_fresh returns 1 if nothing changed since the build recorded in
+ * MANIFEST_FILE with the same key and its output still exists, 0 otherwise.
+ * Inputs are compared by stat first and only hashed when that differs. On
+ * success the output path is stored in output and needs to be freed by the
+ * caller.
+ */
+int
+manifest_fresh(uint64_t key, char **output);
+
+/**
+ * manifest_free frees the memory held by the manifest.
+ */
+void
+manifest_free(struct manifest *m);
+
+#endif /* _MANIFEST_H */
@@ -0,0 +1,2016 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "build.h"
+#include "config.h"
+#include "dependency.h"
+#include "heapprof.h"
+#include "profile.h"
+#include "toolchain.h"
+#include "util.h"
+
+#ifdef __linux__
+
+#define FP_CFLAGS     "-g -fno-omit-frame-pointer"
+#define LEAF_FP_FLAG  "-mno-omit-leaf-frame-pointer"
+#define SAMPLE_FREQ   999
+#define RING_PAGES    64
+#define POLL_MS       100
+#define MAX_FRAMES    128
+#define TOP_FUNCTIONS 15
+
+// heap profiler
+#define HEAP_SOURCE       PROFILE_DIR "/heapprof.c"
+#define HEAP_LIBRARY      PROFILE_DIR "/libheapprof.so"
+#define HEAP_DIR          PROFILE_DIR "/heap"
+#define HEAP_CFLAGS       "-shared -fPIC -O2 -g -fno-omit-frame-pointer -fno-optimize-sibling-calls"
+#define HEAP_LIBS         "-ldl -lpthread -lm"
+#define HEAP_OUT_ENV      "FLOTSAM_HEAP_OUT"
+#define HEAP_RATE_ENV     "FLOTSAM_HEAP_RATE"
+#define HEAP_FRAMES       32
+#define HEAP_LABEL_FRAMES 3
+#define HEAP_TOP          15
+#define HEAP_SHORT_NS     1000000 // SHORT_NS of the heap profiler
+#define HEAP_SHORT_SHARE  0.5
+
+// flamegraph layout in pixels
+#define SVG_WIDTH    1200
+#define SVG_PAD      10
+#define SVG_TOP      48
+#define FRAME_HEIGHT 16
+#define CHAR_WIDTH   7
+
+/**
+ * module_kind tells where the code of a module comes
+ * from, which is what time is attributed to.
+ */
+enum module_kind
+{
+    MODULE_PROJECT,
+    MODULE_DEPENDENCY,
+    MODULE_SYSTEM,
+    MODULE_KERNEL,
+};
+
+static const char *module_kinds[] = { "project", "dependency", "system", "kernel" };
+
+/**
+ * symbol is a function in a module's symbol table.
+ */
+struct symbol
+{
+    uint64_t addr;
+    uint64_t size;
+    const char *name;
+};
+
+/**
+ * segment is a loadable part of an ELF file, used to turn
+ * file offsets into the addresses symbols are given in.
+ */
+struct segment
+{
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t size;
+};
+
+/**
+ * module is a file mapped into the profiled process with
+ * its symbols, read when first needed, and the samples
+ * attributed to it. self counts samples with the module
+ * at the top of the stack and total those with it
+ * anywhere on the stack.
+ */
+struct module
+{
+    char *path;
+    char *label;
+    char *unresolved;
+    enum module_kind kind;
+    int loaded;
+    void *image;
+    size_t image_len;
+    struct symbol *syms;
+    int sym_count;
+    struct segment *segs;
+    int seg_count;
+    uint64_t self;
+    uint64_t total;
+    uint64_t seen;
+};
+
+/**
+ * mapping is an executable mapping of a module in one of
+ * the profiled processes.
+ */
+struct mapping
+{
+    uint32_t pid;
+    uint64_t start;
+    uint64_t end;
+    uint64_t pgoff;
+    struct module *mod;
+};
+
+/**
+ * node is a frame in the call tree, counting the samples
+ * passing through it and those ending in it.
+ */
+struct node
+{
+    const char *name;
+    struct module *mod;
+    uint64_t count;
+    uint64_t self;
+    struct node *children;
+    struct node *next;
+};
+
+/**
+ * frame is a symbolized entry of a sampled stack.
+ */
+struct frame
+{
+    const char *name;
+    struct module *mod;
+};
+
+/**
+ * profiler holds everything learned from the samples.
+ */
+struct profiler
+{
+    const struct profile *profile;
+    char binary[PATH_MAX];
+    struct mapping *maps;
+    int map_count;
+    struct module **mods;
+    int mod_count;
+    struct module kernel;
+    struct module unknown;
+    struct node root;
+    uint64_t *raw;
+    size_t raw_len;
+    size_t raw_cap;
+    uint64_t samples;
+    uint64_t lost;
+};
+
+/**
+ * dependency_of returns the dependency whose shared
+ * library the file is or NULL if it's none of them.
+ */
+static const struct dependency*
+dependency_of(const char *path)
+{
+    const char *base = strrchr(path, '/');
+    base = base != NULL ? base + 1 : path;
+
+    struct dependencies *deps = config_get_dependencies();
+    for (int i = 0; i < deps->count; i++) {
+        char *lib_name = dependency_lib_name(deps->dependencies[i].name);
+        if (lib_name == NULL) {
+            continue;
+        }
+        size_t len = strlen(lib_name);
+        int match = strncmp(base, "lib", 3) == 0 && strncmp(base + 3, lib_name, len) == 0 &&
+                    base[3 + len] == '.';
+        free(lib_name);
+        if (match) {
+            return &deps->dependencies[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * module_get returns the module for the mapped file,
+ * classifying it the first time it's seen. Dependencies
+ * are symbolized against their libraries in the cache.
+ */
+static struct module*
+module_get(struct profiler *p, const char *path)
+{
+    for (int i = 0; i < p->mod_count; i++) {
+        if (strcmp(p->mods[i]->path, path) == 0) {
+            return p->mods[i];
+        }
+    }
+
+    struct module **mods = realloc(p->mods, (p->mod_count + 1) * sizeof(struct module*));
+    struct module *m = calloc(1, sizeof(struct module));
+    if (mods == NULL || m == NULL) {
+        perror("unable to allocate memory for modules");
+        free(m);
+        return NULL;
+    }
+    p->mods = mods;
+    p->mods[p->mod_count++] = m;
+
+    const char *base = strrchr(path, '/');
+    base = base != NULL ? base + 1 : path;
+    const struct dependency *dep = dependency_of(path);
+    struct strbuf sb = { 0 };
+
+    m->path = strdup(path);
+    if (strcmp(path, p->binary) == 0) {
+        m->kind = MODULE_PROJECT;
+        m->label = strdup(config_get_name());
+    } else if (dep != NULL) {
+        m->kind = MODULE_DEPENDENCY;
+        m->label = strdup(dep->name);
+
+        char *artifacts = dependency_artifact_path(dep, p->profile);
+        struct strbuf cached = { 0 };
+        strbuf_appendf(&cached, "%s/%s", artifacts, base);
+        if (access(cached.buf, R_OK) == 0) {
+            free(m->path);
+            m->path = strdup(cached.buf);
+        }
+        strbuf_free(&cached);
+        free(artifacts);
+    } else {
+        m->kind = MODULE_SYSTEM;
+        m->label = strdup(base);
+    }
+    strbuf_appendf(&sb, "[%s]", base);
+    m->unresolved = sb.buf;
+
+    return m;
+}
+
+/**
+ * cmp_symbol orders symbols by address.
+ */
+static int
+cmp_symbol(const void *a, const void *b)
+{
+    const struct symbol *x = a;
+    const struct symbol *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/**
+ * module_load reads the function symbols and loadable
+ * segments of the module's ELF file, preferring the full
+ * symbol table over the dynamic one. Files that can't be
+ * read leave the module without symbols.
+ */
+static void
+module_load(struct module *m)
+{
+    m->loaded = 1;
+
+    int fd = open(m->path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat s;
+    if (fstat(fd, &s) != 0 || (size_t)s.st_size < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return;
+    }
+    void *image = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return;
+    }
+    m->image = image;
+    m->image_len = s.st_size;
+
+    const unsigned char *base = image;
+    const Elf64_Ehdr *eh = image;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) > m->image_len ||
+        eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > m->image_len) {
+        return;
+    }
+
+    const Elf64_Phdr *ph = (const Elf64_Phdr*)(base + eh->e_phoff);
+    m->segs = calloc(eh->e_phnum, sizeof(struct segment));
+    for (int i = 0; m->segs != NULL && i < eh->e_phnum; i++) {
+        if (ph[i].p_type == PT_LOAD) {
+            m->segs[m->seg_count].offset = ph[i].p_offset;
+            m->segs[m->seg_count].vaddr = ph[i].p_vaddr;
+            m->segs[m->seg_count].size = ph[i].p_filesz;
+            m->seg_count++;
+        }
+    }
+
+    const Elf64_Shdr *sh = (const Elf64_Shdr*)(base + eh->e_shoff);
+    const Elf64_Shdr *symtab = NULL;
+    for (int i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type == SHT_SYMTAB || (sh[i].sh_type == SHT_DYNSYM && symtab == NULL)) {
+            symtab = &sh[i];
+        }
+    }
+    if (symtab == NULL || symtab->sh_link >= eh->e_shnum ||
+        symtab->sh_offset + symtab->sh_size > m->image_len) {
+        return;
+    }
+    const Elf64_Shdr *strtab = &sh[symtab->sh_link];
+    if (strtab->sh_offset + strtab->sh_size > m->image_len) {
+        return;
+    }
+
+    size_t count = symtab->sh_size / sizeof(Elf64_Sym);
+    const Elf64_Sym *syms = (const Elf64_Sym*)(base + symtab->sh_offset);
+    const char *names = (const char*)(base + strtab->sh_offset);
+    m->syms = calloc(count, sizeof(struct symbol));
+    for (size_t i = 0; m->syms != NULL && i < count; i++) {
+        int type = ELF64_ST_TYPE(syms[i].st_info);
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || syms[i].st_shndx == SHN_UNDEF ||
+            syms[i].st_value == 0 || syms[i].st_name >= strtab->sh_size) {
+            continue;
+        }
+        m->syms[m->sym_count].addr = syms[i].st_value;
+        m->syms[m->sym_count].size = syms[i].st_size;
+        m->syms[m->sym_count].name = names + syms[i].st_name;
+        m->sym_count++;
+    }
+    if (m->sym_count > 0) {
+        qsort(m->syms, m->sym_count, sizeof(struct symbol), cmp_symbol);
+    }
+}
+
+/**
+ * module_symbol returns the name of the function at the
+ * given offset into the module's file.
+ */
+static const char*
+module_symbol(struct module *m, uint64_t offset)
+{
+    if (!m->loaded) {
+        module_load(m);
+    }
+
+    uint64_t addr = 0;
+    int found = 0;
+    for (int i = 0; i < m->seg_count && !found; i++) {
+        const struct segment *s = &m->segs[i];
+        if (offset >= s->offset && offset < s->offset + s->size) {
+            addr = offset - s->offset + s->vaddr;
+            found = 1;
+        }
+    }
+    if (!found || m->sym_count == 0) {
+        return m->unresolved;
+    }
+
+    // the last symbol starting at or before the address
+    int lo = 0, hi = m->sym_count - 1, best = -1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (m->syms[mid].addr <= addr) {
+            best = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (best < 0) {
+        return m->unresolved;
+    }
+
+    const struct symbol *s = &m->syms[best];
+    if (s->size > 0 && addr >= s->addr + s->size) {
+        return m->unresolved;
+    }
+    return s->name;
+}
+
+/**
+ * add_mapping records an executable mapping of a process.
+ */
+static void
+add_mapping(struct profiler *p, uint32_t pid, uint64_t start, uint64_t len, uint64_t pgoff,
+            const char *path)
+{
+    struct module *m = module_get(p, path);
+    struct mapping *maps = realloc(p->maps, (p->map_count + 1) * sizeof(struct mapping));
+    if (m == NULL || maps == NULL) {
+        perror("unable to allocate memory for mappings");
+        return;
+    }
+    p->maps = maps;
+
+    struct mapping *map = &p->maps[p->map_count++];
+    map->pid = pid;
+    map->start = start;
+    map->end = start + len;
+    map->pgoff = pgoff;
+    map->mod = m;
+}
+
+/**
+ * read_maps records the executable mappings the process
+ * already has. Mappings made by exec itself come before
+ * the samplers are enabled so there are no records for
+ * the binary and the dynamic loader.
+ */
+static void
+read_maps(struct profiler *p, pid_t pid)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return;
+    }
+
+    char line[PATH_MAX + 128];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        unsigned long long start, end, pgoff;
+        char perms[5];
+        int n = 0;
+        if (sscanf(line, "%llx-%llx %4s %llx %*s %*s %n", &start, &end, perms, &pgoff, &n) < 4 ||
+            n == 0 || perms[2] != 'x') {
+            continue;
+        }
+        char *file = line + n;
+        file[strcspn(file, "\n")] = '\0';
+        if (file[0] != '\0') {
+            add_mapping(p, (uint32_t)pid, start, end - start, pgoff, file);
+        }
+    }
+
+    fclose(fp);
+}
+
+/**
+ * symbolize fills in the frame for the address in the
+ * given process. The newest mapping wins if addresses
+ * were reused.
+ */
+static void
+symbolize(struct profiler *p, uint32_t pid, uint64_t ip, struct frame *f)
+{
+    for (int i = p->map_count - 1; i >= 0; i--) {
+        const struct mapping *map = &p->maps[i];
+        if (map->pid == pid && ip >= map->start && ip < map->end) {
+            f->mod = map->mod;
+            f->name = module_symbol(map->mod, ip - map->start + map->pgoff);
+            return;
+        }
+    }
+
+    f->mod = &p->unknown;
+    f->name = p->unknown.unresolved;
+}
+
+/**
+ * node_child returns the child of the node for the frame,
+ * adding it if it isn't there yet.
+ */
+static struct node*
+node_child(struct node *parent, const struct frame *f)
+{
+    for (struct node *n = parent->children; n != NULL; n = n->next) {
+        if (n->mod == f->mod && strcmp(n->name, f->name) == 0) {
+            return n;
+        }
+    }
+
+    struct node *n = calloc(1, sizeof(struct node));
+    if (n == NULL) {
+        return NULL;
+    }
+    n->name = f->name;
+    n->mod = f->mod;
+    n->next = parent->children;
+    parent->children = n;
+
+    return n;
+}
+
+/**
+ * add_frames adds a symbolized stack, newest frame first,
+ * to the call tree with the given weight and counts it
+ * for the modules it went through.
+ */
+static void
+add_frames(struct profiler *p, const struct frame *frames, int n, uint64_t weight)
+{
+    p->samples++;
+    frames[0].mod->self += weight;
+    for (int i = 0; i < n; i++) {
+        if (frames[i].mod->seen != p->samples) {
+            frames[i].mod->seen = p->samples;
+            frames[i].mod->total += weight;
+        }
+    }
+
+    struct node *node = &p->root;
+    node->count += weight;
+    for (int i = n - 1; i >= 0 && node != NULL; i--) {
+        node = node_child(node, &frames[i]);
+        if (node != NULL) {
+            node->count += weight;
+        }
+    }
+    if (node != NULL) {
+        node->self += weight;
+    }
+}
+
+/**
+ * add_sample symbolizes a sampled call chain, newest
+ * frame first, and adds it to the call tree. Kernel
+ * frames are collapsed into one.
+ */
+static void
+add_sample(struct profiler *p, uint32_t pid, const uint64_t *ips, uint64_t nr)
+{
+    struct frame frames[MAX_FRAMES];
+    int n = 0, kernel = 0, first = 1;
+
+    for (uint64_t i = 0; i < nr && n < MAX_FRAMES; i++) {
+        if (ips[i] >= PERF_CONTEXT_MAX) {
+            kernel = ips[i] == PERF_CONTEXT_KERNEL;
+            first = 1;
+            continue;
+        }
+        if (kernel) {
+            if (n == 0 || frames[n - 1].mod != &p->kernel) {
+                frames[n].mod = &p->kernel;
+                frames[n].name = p->kernel.unresolved;
+                n++;
+            }
+            continue;
+        }
+
+        // return addresses point after the call, which may
+        // already be the next function
+        symbolize(p, pid, first ? ips[i] : ips[i] - 1, &frames[n++]);
+        first = 0;
+    }
+    if (n == 0) {
+        frames[n].mod = &p->unknown;
+        frames[n].name = p->unknown.unresolved;
+        n++;
+    }
+
+    add_frames(p, frames, n, 1);
+}
+
+/**
+ * keep_sample stores a sampled call chain as the pid, the
+ * number of frames and the frames. Samples are symbolized
+ * once the run is over as the mappings they need may be
+ * recorded by another CPU's buffer after them.
+ */
+static void
+keep_sample(struct profiler *p, uint32_t pid, const uint64_t *ips, uint64_t nr)
+{
+    if (p->raw_len + nr + 2 > p->raw_cap) {
+        size_t cap = p->raw_cap == 0 ? 65536 : p->raw_cap * 2;
+        while (cap < p->raw_len + nr + 2) {
+            cap *= 2;
+        }
+        uint64_t *raw = realloc(p->raw, cap * sizeof(uint64_t));
+        if (raw == NULL) {
+            p->lost++;
+            return;
+        }
+        p->raw = raw;
+        p->raw_cap = cap;
+    }
+
+    p->raw[p->raw_len++] = pid;
+    p->raw[p->raw_len++] = nr;
+    memcpy(p->raw + p->raw_len, ips, nr * sizeof(uint64_t));
+    p->raw_len += nr;
+}
+
+/**
+ * add_samples symbolizes the stored samples and adds them
+ * to the call tree.
+ */
+static void
+add_samples(struct profiler *p)
+{
+    size_t i = 0;
+    while (i + 2 <= p->raw_len) {
+        uint32_t pid = (uint32_t)p->raw[i];
+        uint64_t nr = p->raw[i + 1];
+        add_sample(p, pid, p->raw + i + 2, nr);
+        i += nr + 2;
+    }
+}
+
+/**
+ * handle_record processes one record from a ring buffer.
+ */
+static void
+handle_record(struct profiler *p, const char *rec)
+{
+    const struct perf_event_header *h = (const struct perf_event_header*)rec;
+    const char *body = rec + sizeof(struct perf_event_header);
+
+    if (h->type == PERF_RECORD_SAMPLE) {
+        // PERF_SAMPLE_TID then PERF_SAMPLE_CALLCHAIN
+        uint32_t pid;
+        uint64_t nr;
+        memcpy(&pid, body, sizeof(pid));
+        memcpy(&nr, body + 8, sizeof(nr));
+        if (16 + nr * sizeof(uint64_t) <= h->size - sizeof(struct perf_event_header)) {
+            keep_sample(p, pid, (const uint64_t*)(body + 16), nr);
+        }
+    } else if (h->type == PERF_RECORD_MMAP) {
+        uint32_t pid;
+        uint64_t addr, len, pgoff;
+        memcpy(&pid, body, sizeof(pid));
+        memcpy(&addr, body + 8, sizeof(addr));
+        memcpy(&len, body + 16, sizeof(len));
+        memcpy(&pgoff, body + 24, sizeof(pgoff));
+        add_mapping(p, pid, addr, len, pgoff, body + 32);
+    } else if (h->type == PERF_RECORD_LOST) {
+        uint64_t lost;
+        memcpy(&lost, body + 8, sizeof(lost));
+        p->lost += lost;
+    }
+}
+
+/**
+ * ring is the buffer a CPU's sampler writes records to.
+ */
+struct ring
+{
+    int fd;
+    struct perf_event_mmap_page *meta;
+    const char *data;
+};
+
+/**
+ * drain processes the records in the ring buffer and
+ * hands the space back to the kernel. Records wrapping
+ * around the end of the buffer are copied out first.
+ */
+static void
+drain(struct profiler *p, const struct ring *r, uint64_t size)
+{
+    static uint64_t words[(UINT16_MAX + 1) / sizeof(uint64_t) + 1];
+    char *rec = (char*)words;
+
+    uint64_t head = __atomic_load_n(&r->meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = r->meta->data_tail;
+
+    while (tail < head) {
+        uint64_t off = tail % size;
+        const struct perf_event_header *h = (const struct perf_event_header*)(r->data + off);
+        uint64_t len = h->size;
+        if (len < sizeof(struct perf_event_header)) {
+            break;
+        }
+
+        if (off + len <= size) {
+            memcpy(rec, r->data + off, len);
+        } else {
+            memcpy(rec, r->data + off, size - off);
+            memcpy(rec + size - off, r->data, len - (size - off));
+        }
+        rec[len] = '\0';
+        handle_record(p, rec);
+        tail += len;
+    }
+
+    __atomic_store_n(&r->meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * open_samplers opens a sampling counter on the process
+ * for every CPU, as inherited counters can only be mapped
+ * per CPU. They start counting once the process execs and
+ * follow its threads and children. CPU cycles are sampled
+ * if the machine has the counter, the cpu-clock otherwise,
+ * and user space only if the kernel doesn't allow more.
+ * It returns the number of counters opened.
+ */
+static int
+open_samplers(pid_t pid, struct ring *rings, int cpus, const char **event)
+{
+    const struct
+    {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+    } events[] = {
+        { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { "cpu-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK },
+    };
+
+    struct perf_event_attr attr;
+    int fd = -1, cpu = 0;
+
+    // settle on an event with the first CPU that takes one
+    for (; cpu < cpus && fd < 0; cpu++) {
+        for (size_t i = 0; i < sizeof(events) / sizeof(events[0]) && fd < 0; i++) {
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].type;
+            attr.config = events[i].config;
+            attr.freq = 1;
+            attr.sample_freq = SAMPLE_FREQ;
+            attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+            attr.disabled = 1;
+            attr.enable_on_exec = 1;
+            attr.inherit = 1;
+            attr.mmap = 1;
+            attr.exclude_hv = 1;
+
+            fd = (int)syscall(SYS_perf_event_open, &attr, pid, cpu, -1, 0);
+            if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+                attr.exclude_kernel = 1;
+                fd = (int)syscall(SYS_perf_event_open, &attr, pid, cpu, -1, 0);
+            }
+            if (fd >= 0) {
+                *event = events[i].name;
+            }
+        }
+    }
+    if (fd < 0) {
+        return 0;
+    }
+
+    int count = 0;
+    rings[count++].fd = fd;
+    for (; cpu < cpus; cpu++) {
+        // offline CPUs can't be sampled
+        fd = (int)syscall(SYS_perf_event_open, &attr, pid, cpu, -1, 0);
+        if (fd >= 0) {
+            rings[count++].fd = fd;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * exec_profiled replaces the forked child with the binary
+ * and the given arguments, finding the project's shared
+ * libraries the way run does.
+ */
+static void
+exec_profiled(const char *binary, int argc, char **argv)
+{
+    struct strbuf lib_path = { 0 };
+    strbuf_append(&lib_path, PROJECT_LIB_DIR);
+    if (getenv("LD_LIBRARY_PATH") != NULL) {
+        strbuf_appendf(&lib_path, ":%s", getenv("LD_LIBRARY_PATH"));
+    }
+    setenv("LD_LIBRARY_PATH", lib_path.buf, 1);
+    strbuf_free(&lib_path);
+
+    char **args = calloc(argc + 2, sizeof(char*));
+    if (args == NULL) {
+        _exit(127);
+    }
+    args[0] = (char*)binary;
+    for (int i = 0; i < argc; i++) {
+        args[i + 1] = argv[i];
+    }
+    execv(binary, args);
+    perror(binary);
+    _exit(127);
+}
+
+/**
+ * sample runs the binary with the given arguments and
+ * collects samples until it exits. The exit status of the
+ * binary is stored in status.
+ */
+static int
+sample(struct profiler *p, const char *binary, int argc, char **argv, const char **event,
+       int *status)
+{
+    int cpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+    struct ring *rings = calloc(cpus > 0 ? cpus : 1, sizeof(struct ring));
+    if (rings == NULL) {
+        perror("unable to allocate memory for samplers");
+        return -1;
+    }
+
+    // go starts the binary, exec closes ready
+    int go[2], ready[2];
+    if (pipe(go) != 0 || pipe(ready) != 0 || fcntl(ready[1], F_SETFD, FD_CLOEXEC) != 0) {
+        perror("pipe");
+        free(rings);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        free(rings);
+        return -1;
+    }
+    if (pid == 0) {
+        // wait until the samplers are attached
+        char c;
+        close(go[1]);
+        close(ready[0]);
+        if (read(go[0], &c, 1) != 1) {
+            _exit(127);
+        }
+        close(go[0]);
+        exec_profiled(binary, argc, argv);
+    }
+    close(go[0]);
+    close(ready[1]);
+
+    int res = -1;
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t size = (uint64_t)RING_PAGES * page;
+    struct pollfd *pfds = NULL;
+    void (*prev)(int) = SIG_DFL;
+
+    int count = open_samplers(pid, rings, cpus, event);
+    if (count == 0) {
+        fprintf(stderr, "error: unable to open a sampling counter: %s\n", strerror(errno));
+        if (errno == EACCES || errno == EPERM) {
+            fprintf(stderr, "check /proc/sys/kernel/perf_event_paranoid\n");
+        }
+        goto out;
+    }
+    for (int i = 0; i < count; i++) {
+        void *m = mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_SHARED, rings[i].fd, 0);
+        if (m == MAP_FAILED) {
+            perror("unable to map the sample buffer");
+            goto out;
+        }
+        rings[i].meta = m;
+        rings[i].data = (const char*)m + page;
+    }
+    pfds = calloc(count, sizeof(struct pollfd));
+    if (pfds == NULL) {
+        perror("unable to allocate memory for samplers");
+        goto out;
+    }
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = rings[i].fd;
+        pfds[i].events = POLLIN;
+    }
+
+    // the profile is still written when the binary is
+    // interrupted
+    prev = signal(SIGINT, SIG_IGN);
+
+    if (write(go[1], "g", 1) != 1) {
+        perror("unable to start the binary");
+    }
+    close(go[1]);
+    go[1] = -1;
+
+    char c;
+    while (read(ready[0], &c, 1) > 0) {
+    }
+    read_maps(p, pid);
+
+    for (;;) {
+        poll(pfds, count, POLL_MS);
+        for (int i = 0; i < count; i++) {
+            drain(p, &rings[i], size);
+        }
+        if (waitpid(pid, status, WNOHANG) == pid) {
+            for (int i = 0; i < count; i++) {
+                drain(p, &rings[i], size);
+            }
+            break;
+        }
+    }
+    signal(SIGINT, prev);
+    pid = -1;
+    res = 0;
+
+out:
+    if (go[1] >= 0) {
+        close(go[1]);
+    }
+    close(ready[0]);
+    if (pid > 0) {
+        waitpid(pid, status, 0);
+    }
+    for (int i = 0; i < count; i++) {
+        if (rings[i].meta != NULL) {
+            munmap(rings[i].meta, size + page);
+        }
+        close(rings[i].fd);
+    }
+    free(pfds);
+    free(rings);
+
+    return res;
+}
+
+/**
+ * cmp_node orders nodes by name, as flamegraphs do.
+ */
+static int
+cmp_node(const void *a, const void *b)
+{
+    const struct node *x = *(const struct node* const*)a;
+    const struct node *y = *(const struct node* const*)b;
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * sort_children sorts the children of every node by name.
+ */
+static void
+sort_children(struct node *node)
+{
+    int count = 0;
+    for (struct node *n = node->children; n != NULL; n = n->next) {
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    struct node **list = calloc(count, sizeof(struct node*));
+    if (list == NULL) {
+        return;
+    }
+    int i = 0;
+    for (struct node *n = node->children; n != NULL; n = n->next) {
+        list[i++] = n;
+    }
+    qsort(list, count, sizeof(struct node*), cmp_node);
+
+    node->children = list[0];
+    for (i = 0; i < count; i++) {
+        list[i]->next = i + 1 < count ? list[i + 1] : NULL;
+        sort_children(list[i]);
+    }
+    free(list);
+}
+
+/**
+ * node_free frees the children of the node.
+ */
+static void
+node_free(struct node *node)
+{
+    struct node *n = node->children;
+    while (n != NULL) {
+        struct node *next = n->next;
+        node_free(n);
+        free(n);
+        n = next;
+    }
+}
+
+/**
+ * write_folded writes a line of semicolon separated frames
+ * with the number of samples ending there for every stack
+ * below the node.
+ */
+static void
+write_folded(FILE *fp, const struct node *node, const char **stack, int depth)
+{
+    if (node->self > 0) {
+        for (int i = 0; i < depth; i++) {
+            fprintf(fp, "%s%s", i > 0 ? ";" : "", stack[i]);
+        }
+        fprintf(fp, " %llu\n", (unsigned long long)node->self);
+    }
+    if (depth == MAX_FRAMES) {
+        return;
+    }
+    for (const struct node *n = node->children; n != NULL; n = n->next) {
+        stack[depth] = n->name;
+        write_folded(fp, n, stack, depth + 1);
+    }
+}
+
+/**
+ * max_depth returns the depth of the deepest frame below
+ * the node.
+ */
+static int
+max_depth(const struct node *node)
+{
+    int depth = 0;
+    for (const struct node *n = node->children; n != NULL; n = n->next) {
+        int d = max_depth(n) + 1;
+        if (d > depth) {
+            depth = d;
+        }
+    }
+    return depth;
+}
+
+/**
+ * write_escaped writes at most len bytes of the string
+ * escaped for XML.
+ */
+static void
+write_escaped(FILE *fp, const char *s, size_t len)
+{
+    for (size_t i = 0; s[i] != '\0' && i < len; i++) {
+        switch (s[i]) {
+            case '&': fputs("&amp;", fp); break;
+            case '<': fputs("&lt;", fp); break;
+            case '>': fputs("&gt;", fp); break;
+            case '"': fputs("&quot;", fp); break;
+            default: fputc(s[i], fp); break;
+        }
+    }
+}
+
+/**
+ * frame_color picks the fill of a frame: warm colors for
+ * the project, a hue per dependency, and grays for the
+ * system, varied a little by name so neighbors differ.
+ */
+static void
+frame_color(const struct node *n, char *buf, size_t len)
+{
+    static const int dep_colors[][3] = {
+        { 80, 160, 220 }, { 90, 190, 120 }, { 150, 120, 220 }, { 60, 180, 180 }, { 200, 120, 190 },
+    };
+    double v = (double)(hash_str(HASH_SEED, n->name) % 1000) / 1000.0;
+
+    switch (n->mod->kind) {
+        case MODULE_PROJECT:
+            snprintf(buf, len, "rgb(%d,%d,%d)", 205 + (int)(50 * v), (int)(200 * v),
+                     (int)(55 * v));
+            break;
+        case MODULE_DEPENDENCY: {
+            const int *c = dep_colors[hash_str(HASH_SEED, n->mod->label) %
+                                      (sizeof(dep_colors) / sizeof(dep_colors[0]))];
+            int d = (int)(30 * v) - 15;
+            snprintf(buf, len, "rgb(%d,%d,%d)", c[0] + d, c[1] + d, c[2] + d);
+            break;
+        }
+        case MODULE_KERNEL:
+            snprintf(buf, len, "rgb(230,%d,60)", 140 + (int)(40 * v));
+            break;
+        default:
+            snprintf(buf, len, "rgb(%d,%d,%d)", 170 + (int)(40 * v), 170 + (int)(40 * v),
+                     180 + (int)(40 * v));
+            break;
+    }
+}
+
+/**
+ * write_frames writes the node and everything above it
+ * as rectangles starting x units from the left.
+ */
+static void
+write_frames(FILE *fp, const struct node *node, uint64_t x, int depth, uint64_t total, int height,
+             const char *unit)
+{
+    double scale = (double)(SVG_WIDTH - 2 * SVG_PAD) / total;
+    double w = node->count * scale;
+    if (w < 0.1) {
+        return;
+    }
+    double left = SVG_PAD + x * scale;
+    double y = height - SVG_PAD - (depth + 1) * FRAME_HEIGHT;
+    char fill[32];
+    frame_color(node, fill, sizeof(fill));
+
+    fprintf(fp, "<g><title>");
+    write_escaped(fp, node->name, SIZE_MAX);
+    if (depth > 0) {
+        fprintf(fp, " (");
+        write_escaped(fp, node->mod->label, SIZE_MAX);
+        fprintf(fp, ")");
+    }
+    fprintf(fp, ": %llu %s, %.2f%%</title>", (unsigned long long)node->count, unit,
+            100.0 * node->count / total);
+    fprintf(fp, "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%d\" fill=\"%s\" rx=\"2\"/>",
+            left, y, w, FRAME_HEIGHT - 1, fill);
+
+    size_t fits = w > 2 * CHAR_WIDTH ? (size_t)((w - 6) / CHAR_WIDTH) : 0;
+    if (fits >= 3) {
+        size_t len = strlen(node->name);
+        fprintf(fp, "<text x=\"%.1f\" y=\"%.1f\">", left + 3, y + FRAME_HEIGHT - 4);
+        write_escaped(fp, node->name, len > fits ? fits - 2 : len);
+        fprintf(fp, "%s</text>", len > fits ? ".." : "");
+    }
+    fprintf(fp, "</g>\n");
+
+    for (const struct node *n = node->children; n != NULL; n = n->next) {
+        write_frames(fp, n, x, depth + 1, total, height, unit);
+        x += n->count;
+    }
+}
+
+/**
+ * write_svg writes the call tree as a flamegraph whose
+ * widths are in the given unit.
+ */
+static int
+write_svg(const struct profiler *p, const char *path, const char *title, const char *unit)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int height = SVG_TOP + (max_depth(&p->root) + 1) * FRAME_HEIGHT + SVG_PAD;
+    fprintf(fp, "<?xml version=\"1.0\" standalone=\"no\"?>\n"
+            "<svg version=\"1.1\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\" "
+            "xmlns=\"http://www.w3.org/2000/svg\" font-family=\"Verdana, sans-serif\" "
+            "font-size=\"12\">\n"
+            "<rect width=\"100%%\" height=\"100%%\" fill=\"#f8f8f8\"/>\n"
+            "<text x=\"%d\" y=\"24\" font-size=\"17\" text-anchor=\"middle\">",
+            SVG_WIDTH, height, SVG_WIDTH, height, SVG_WIDTH / 2);
+    write_escaped(fp, title, SIZE_MAX);
+    fprintf(fp, "</text>\n"
+            "<text x=\"%d\" y=\"40\" fill=\"#666\">warm: project, cool: dependencies, "
+            "gray: system, orange: kernel</text>\n", SVG_PAD);
+
+    write_frames(fp, &p->root, 0, 0, p->root.count, height, unit);
+    fprintf(fp, "</svg>\n");
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/**
+ * write_outputs writes the folded stacks and the
+ * flamegraph to the given paths.
+ */
+static int
+write_outputs(const struct profiler *p, const char *folded, const char *svg, const char *title,
+              const char *unit)
+{
+    if (mkdir_p(PROFILE_DIR, 0755) != 0) {
+        perror(PROFILE_DIR);
+        return -1;
+    }
+
+    FILE *fp = fopen(folded, "w");
+    if (fp == NULL) {
+        perror(folded);
+        return -1;
+    }
+    const char *stack[MAX_FRAMES];
+    write_folded(fp, &p->root, stack, 0);
+    if (fclose(fp) != 0) {
+        perror(folded);
+        return -1;
+    }
+
+    return write_svg(p, svg, title, unit);
+}
+
+/**
+ * prepare builds the dependencies missing from the cache
+ * and installs every one of them so the project links and
+ * runs against the given profile's libraries.
+ */
+static int
+prepare(const struct profile *profile)
+{
+    if (dependency_update_all(profile, 1) != 0) {
+        return -1;
+    }
+
+    struct dependencies *deps = config_get_dependencies();
+    for (int i = 0; i < deps->count; i++) {
+        if (dependency_install(&deps->dependencies[i], profile) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * function is a function's share of the samples.
+ */
+struct function
+{
+    const char *name;
+    const struct module *mod;
+    uint64_t self;
+};
+
+/**
+ * collect_functions adds up the samples ending in every
+ * function below the node.
+ */
+static void
+collect_functions(const struct node *node, struct function **fns, int *count)
+{
+    for (const struct node *n = node->children; n != NULL; n = n->next) {
+        collect_functions(n, fns, count);
+        if (n->self == 0) {
+            continue;
+        }
+
+        int i = 0;
+        while (i < *count && ((*fns)[i].mod != n->mod || strcmp((*fns)[i].name, n->name) != 0)) {
+            i++;
+        }
+        if (i == *count) {
+            struct function *f = realloc(*fns, (*count + 1) * sizeof(struct function));
+            if (f == NULL) {
+                continue;
+            }
+            *fns = f;
+            (*fns)[i].name = n->name;
+            (*fns)[i].mod = n->mod;
+            (*fns)[i].self = 0;
+            (*count)++;
+        }
+        (*fns)[i].self += n->self;
+    }
+}
+
+static int
+cmp_function(const void *a, const void *b)
+{
+    const struct function *x = a;
+    const struct function *y = b;
+    return (x->self < y->self) - (x->self > y->self);
+}
+
+static int
+cmp_module(const void *a, const void *b)
+{
+    const struct module *x = *(const struct module* const*)a;
+    const struct module *y = *(const struct module* const*)b;
+    if (x->self != y->self) {
+        return (x->self < y->self) - (x->self > y->self);
+    }
+    return (x->total < y->total) - (x->total > y->total);
+}
+
+/**
+ * print_report prints the share of the samples spent in
+ * every module and the hottest functions.
+ */
+static void
+print_report(struct profiler *p)
+{
+    double total = p->samples;
+
+    struct module **mods = calloc(p->mod_count + 2, sizeof(struct module*));
+    if (mods == NULL) {
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < p->mod_count; i++) {
+        if (p->mods[i]->total > 0) {
+            mods[count++] = p->mods[i];
+        }
+    }
+    if (p->kernel.total > 0) {
+        mods[count++] = &p->kernel;
+    }
+    if (p->unknown.total > 0) {
+        mods[count++] = &p->unknown;
+    }
+    qsort(mods, count, sizeof(struct module*), cmp_module);
+
+    printf("\n%-36s %-10s %8s %8s\n", "module", "kind", "self", "total");
+    for (int i = 0; i < count; i++) {
+        printf("%-36s %-10s %7.1f%% %7.1f%%\n", mods[i]->label, module_kinds[mods[i]->kind],
+               100 * mods[i]->self / total, 100 * mods[i]->total / total);
+    }
+    free(mods);
+
+    struct function *fns = NULL;
+    int fn_count = 0;
+    collect_functions(&p->root, &fns, &fn_count);
+    qsort(fns, fn_count, sizeof(struct function), cmp_function);
+
+    printf("\n%-36s %-24s %8s\n", "function", "module", "self");
+    for (int i = 0; i < fn_count && i < TOP_FUNCTIONS; i++) {
+        printf("%-36s %-24s %7.1f%%\n", fns[i].name, fns[i].mod->label,
+               100 * fns[i].self / total);
+    }
+    free(fns);
+}
+
+/**
+ * profiler_free frees the call tree, modules and
+ * mappings.
+ */
+static void
+profiler_free(struct profiler *p)
+{
+    node_free(&p->root);
+    for (int i = 0; i < p->mod_count; i++) {
+        struct module *m = p->mods[i];
+        if (m->image != NULL) {
+            munmap(m->image, m->image_len);
+        }
+        free(m->syms);
+        free(m->segs);
+        free(m->path);
+        free(m->label);
+        free(m->unresolved);
+        free(m);
+    }
+    free(p->mods);
+    free(p->maps);
+    free(p->raw);
+}
+
+/**
+ * fp_profile derives the profile the binary is profiled
+ * with: the selected one's flags, or those of PROFILE_BASE,
+ * with frame pointers for the stacks to be unwound with
+ * and debug info. name and cflags hold its strings.
+ */
+static void
+fp_profile(const struct profile *profile, struct profile *fp, struct strbuf *name,
+           struct strbuf *cflags)
+{
+    const struct profile *base = profile != NULL ? profile : config_find_profile(PROFILE_BASE);
+    if (base != NULL) {
+        *fp = *base;
+    }
+    strbuf_appendf(name, "%s-fp", base != NULL ? base->name : PROFILE_BASE);
+    strbuf_appendf(cflags, "%s %s", base != NULL ? base->cflags : "", FP_CFLAGS);
+    if (toolchain_supports(LEAF_FP_FLAG)) {
+        strbuf_appendf(cflags, " %s", LEAF_FP_FLAG);
+    }
+    fp->name = name->buf;
+    fp->cflags = cflags->buf;
+    fp->ldflags = base != NULL ? base->ldflags : "";
+}
+
+/**
+ * profiler_init sets up the modules frames are attributed
+ * to when they aren't in a mapped file.
+ */
+static void
+profiler_init(struct profiler *p, const struct profile *fp)
+{
+    p->profile = fp;
+    p->kernel.kind = MODULE_KERNEL;
+    p->kernel.label = "[kernel]";
+    p->kernel.unresolved = "[kernel]";
+    p->unknown.kind = MODULE_SYSTEM;
+    p->unknown.label = "[unknown]";
+    p->unknown.unresolved = "[unknown]";
+    p->root.name = "all";
+    p->root.mod = &p->unknown;
+}
+
+/**
+ * build_profiled cleans and builds the project and its
+ * dependencies with the given profile and stores the real
+ * path of the binary output in binary.
+ */
+static int
+build_profiled(const struct profile *fp, const char *output, char *binary)
+{
+    printf("building %s with frame pointers and debug info\n", output);
+    fflush(stdout);
+    build_clean();
+    if (prepare(fp) != 0 || build_project(fp) != 0) {
+        fprintf(stderr, "error: unable to build %s for profiling\n", output);
+        return -1;
+    }
+    if (realpath(output, binary) == NULL) {
+        perror(output);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+profile_run(const struct profile *profile, int argc, char **argv)
+{
+    char *output = build_output();
+    if (output[0] == '\0') {
+        fprintf(stderr, "error: only bin projects can be profiled\n");
+        free(output);
+        return 1;
+    }
+
+    struct profile fp = { 0 };
+    struct strbuf name = { 0 };
+    struct strbuf cflags = { 0 };
+    struct profiler p = { 0 };
+    fp_profile(profile, &fp, &name, &cflags);
+    profiler_init(&p, &fp);
+
+    const char *event = NULL;
+    int status = 0, res = 1;
+
+    if (build_profiled(&fp, output, p.binary) != 0) {
+        goto out;
+    }
+
+    printf("profiling %s\n", output);
+    fflush(stdout);
+    if (sample(&p, p.binary, argc, argv, &event, &status) != 0) {
+        goto out;
+    }
+    add_samples(&p);
+    if (p.samples == 0) {
+        fprintf(stderr, "error: no samples, %s exited too quickly\n", output);
+        goto out;
+    }
+
+    struct strbuf title = { 0 };
+    strbuf_appendf(&title, "%s: %llu %s samples", output, (unsigned long long)p.samples, event);
+    sort_children(&p.root);
+    res = write_outputs(&p, PROFILE_FOLDED, PROFILE_SVG, title.buf, "samples") == 0 ? 0 : 1;
+    strbuf_free(&title);
+
+out:
+    // leave a build of the selected profile behind
+    build_clean();
+    if (prepare(profile) != 0 || build_project(profile) != 0) {
+        res = 1;
+    }
+
+    if (res == 0) {
+        printf("\n%s: %llu samples of %s at %d Hz", output, (unsigned long long)p.samples, event,
+               SAMPLE_FREQ);
+        if (p.lost > 0) {
+            printf(", %llu lost", (unsigned long long)p.lost);
+        }
+        printf("\n");
+        print_report(&p);
+        printf("\nfolded stacks: %s\nflamegraph: %s\n", PROFILE_FOLDED, PROFILE_SVG);
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "warning: %s exited with status %d\n", output, WEXITSTATUS(status));
+        }
+    }
+
+    profiler_free(&p);
+    strbuf_free(&name);
+    strbuf_free(&cflags);
+    free(output);
+
+    return res;
+}
+
+/**
+ * heap_site is an allocating call stack with the
+ * estimated allocations made there, their bytes, how
+ * many were freed, their total lifetime, how many of
+ * those lived less than HEAP_SHORT_NS and the most bytes
+ * in use at once.
+ */
+struct heap_site
+{
+    struct frame frames[HEAP_FRAMES];
+    int depth;
+    double allocs;
+    double bytes;
+    double frees;
+    double lifetime_ns;
+    double short_lived;
+    double peak;
+};
+
+/**
+ * heap_profile is what the preloaded library recorded in
+ * every process it ran in.
+ */
+struct heap_profile
+{
+    uint64_t allocs;
+    uint64_t bytes;
+    uint64_t frees;
+    uint64_t peak;
+    double rate;
+    struct heap_site *sites;
+    int count;
+};
+
+/**
+ * heap_library writes the heap profiler's source to
+ * HEAP_SOURCE and compiles it into HEAP_LIBRARY unless the
+ * library is newer than the source.
+ */
+static int
+heap_library(char *path)
+{
+    if (mkdir_p(PROFILE_DIR, 0755) != 0) {
+        perror(PROFILE_DIR);
+        return -1;
+    }
+    if (write_file_if_changed(HEAP_SOURCE, HEAP_PROFILER_TEMPLATE) != 0) {
+        return -1;
+    }
+
+    struct stat src, lib;
+    if (stat(HEAP_SOURCE, &src) != 0) {
+        perror(HEAP_SOURCE);
+        return -1;
+    }
+    if (stat(HEAP_LIBRARY, &lib) != 0 || lib.st_mtime < src.st_mtime) {
+        const struct toolchain *tc = toolchain_get();
+        struct strbuf cmd = { 0 };
+        strbuf_appendf(&cmd, "'%s' %s -o %s %s %s", tc != NULL ? tc->cc : "cc", HEAP_CFLAGS,
+                       HEAP_LIBRARY, HEAP_SOURCE, HEAP_LIBS);
+        int res = system(cmd.buf);
+        strbuf_free(&cmd);
+        if (res != 0) {
+            fprintf(stderr, "error: unable to build the heap profiler\n");
+            return -1;
+        }
+    }
+
+    if (realpath(HEAP_LIBRARY, path) == NULL) {
+        perror(HEAP_LIBRARY);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * run_heap runs the binary with the heap profiler
+ * preloaded, writing its results to HEAP_DIR.
+ */
+static int
+run_heap(const char *binary, const char *library, long rate, int argc, char **argv, int *status)
+{
+    char dir[PATH_MAX];
+    remove_tree(HEAP_DIR);
+    if (mkdir_p(HEAP_DIR, 0755) != 0 || realpath(HEAP_DIR, dir) == NULL) {
+        perror(HEAP_DIR);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        struct strbuf preload = { 0 };
+        struct strbuf rate_env = { 0 };
+        strbuf_append(&preload, library);
+        if (getenv("LD_PRELOAD") != NULL) {
+            strbuf_appendf(&preload, ":%s", getenv("LD_PRELOAD"));
+        }
+        strbuf_appendf(&rate_env, "%ld", rate);
+        setenv("LD_PRELOAD", preload.buf, 1);
+        setenv(HEAP_OUT_ENV, dir, 1);
+        setenv(HEAP_RATE_ENV, rate_env.buf, 1);
+        exec_profiled(binary, argc, argv);
+    }
+
+    // the profile is still written when the binary is
+    // interrupted
+    void (*prev)(int) = signal(SIGINT, SIG_IGN);
+    waitpid(pid, status, 0);
+    signal(SIGINT, prev);
+
+    return 0;
+}
+
+/**
+ * same_stack returns 1 if the site's frames are the given
+ * ones.
+ */
+static int
+same_stack(const struct heap_site *site, const struct frame *frames, int depth)
+{
+    if (site->depth != depth) {
+        return 0;
+    }
+    for (int i = 0; i < depth; i++) {
+        if (site->frames[i].mod != frames[i].mod ||
+            strcmp(site->frames[i].name, frames[i].name) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * add_site symbolizes an allocating call stack of the
+ * given process and merges its counts into the site with
+ * the same functions, as addresses within a function
+ * differ. The stack is also added to the call tree by
+ * bytes allocated.
+ */
+static void
+add_site(struct profiler *p, struct heap_profile *hp, uint32_t pid, const uint64_t *ips,
+         int depth, const struct heap_site *counts)
+{
+    struct frame frames[HEAP_FRAMES];
+    int n = 0;
+    for (int i = 0; i < depth && n < HEAP_FRAMES; i++) {
+        // every frame is a return address
+        symbolize(p, pid, ips[i] - 1, &frames[n++]);
+    }
+    if (n == 0) {
+        return;
+    }
+    add_frames(p, frames, n, (uint64_t)(counts->bytes + 0.5));
+
+    int i = 0;
+    while (i < hp->count && !same_stack(&hp->sites[i], frames, n)) {
+        i++;
+    }
+    if (i == hp->count) {
+        struct heap_site *sites = realloc(hp->sites, (hp->count + 1) * sizeof(struct heap_site));
+        if (sites == NULL) {
+            perror("unable to allocate memory for allocation sites");
+            return;
+        }
+        hp->sites = sites;
+        memset(&hp->sites[i], 0, sizeof(struct heap_site));
+        memcpy(hp->sites[i].frames, frames, n * sizeof(struct frame));
+        hp->sites[i].depth = n;
+        hp->count++;
+    }
+
+    struct heap_site *site = &hp->sites[i];
+    site->allocs += counts->allocs;
+    site->bytes += counts->bytes;
+    site->frees += counts->frees;
+    site->lifetime_ns += counts->lifetime_ns;
+    site->short_lived += counts->short_lived;
+    site->peak += counts->peak;
+}
+
+/**
+ * read_heap reads the results the heap profiler wrote for
+ * one process.
+ */
+static int
+read_heap(struct profiler *p, struct heap_profile *hp, const char *path, uint32_t pid)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) > 0) {
+        line[strcspn(line, "\n")] = '\0';
+
+        unsigned long long a, b, c, d;
+        int n = 0;
+        if (strncmp(line, "rate ", 5) == 0) {
+            hp->rate = strtod(line + 5, NULL);
+        } else if (sscanf(line, "totals %llu %llu %llu %llu", &a, &b, &c, &d) == 4) {
+            hp->allocs += a;
+            hp->bytes += b;
+            hp->frees += c;
+            hp->peak = d > hp->peak ? d : hp->peak;
+        } else if (sscanf(line, "map %llx %llx %llx %n", &a, &b, &c, &n) == 3 && n > 0) {
+            add_mapping(p, pid, a, b - a, c, line + n);
+        } else if (strncmp(line, "site ", 5) == 0) {
+            struct heap_site counts = { 0 };
+            uint64_t ips[HEAP_FRAMES];
+            int depth = 0;
+            char *cur = line + 5, *end;
+            double *fields[] = { &counts.allocs, &counts.bytes, &counts.frees,
+                                 &counts.lifetime_ns, &counts.short_lived, &counts.peak };
+            for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+                *fields[i] = strtod(cur, &end);
+                cur = end;
+            }
+            long frames = strtol(cur, &end, 10);
+            cur = end;
+            while (depth < frames && depth < HEAP_FRAMES) {
+                ips[depth] = strtoull(cur, &end, 16);
+                if (end == cur) {
+                    break;
+                }
+                cur = end;
+                depth++;
+            }
+            add_site(p, hp, pid, ips, depth, &counts);
+        }
+    }
+
+    free(line);
+    fclose(fp);
+
+    return 0;
+}
+
+/**
+ * read_heaps reads the results of every process the heap
+ * profiler ran in, named heap.<pid>.
+ */
+static int
+read_heaps(struct profiler *p, struct heap_profile *hp)
+{
+    DIR *dp = opendir(HEAP_DIR);
+    if (dp == NULL) {
+        perror(HEAP_DIR);
+        return -1;
+    }
+
+    int count = 0;
+    struct dirent *dirp;
+    while ((dirp = readdir(dp)) != NULL) {
+        if (strncmp(dirp->d_name, "heap.", 5) != 0) {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", HEAP_DIR, dirp->d_name);
+        if (read_heap(p, hp, path, (uint32_t)strtoul(dirp->d_name + 5, NULL, 10)) == 0) {
+            count++;
+        }
+    }
+    closedir(dp);
+
+    return count;
+}
+
+/**
+ * format_count formats a count with a K, M or G suffix.
+ */
+static const char*
+format_count(double n, char *buf, size_t len)
+{
+    if (n >= 1e9) {
+        snprintf(buf, len, "%.2fG", n / 1e9);
+    } else if (n >= 1e6) {
+        snprintf(buf, len, "%.2fM", n / 1e6);
+    } else if (n >= 1e4) {
+        snprintf(buf, len, "%.1fK", n / 1e3);
+    } else {
+        snprintf(buf, len, "%.0f", n);
+    }
+    return buf;
+}
+
+/**
+ * format_bytes formats a size in binary units.
+ */
+static const char*
+format_bytes(double n, char *buf, size_t len)
+{
+    static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    size_t u = 0;
+    while (n >= 1024 && u < sizeof(units) / sizeof(units[0]) - 1) {
+        n /= 1024;
+        u++;
+    }
+    snprintf(buf, len, u == 0 ? "%.0f %s" : "%.1f %s", n, units[u]);
+    return buf;
+}
+
+/**
+ * format_ns formats a duration in the largest unit that
+ * keeps it above 1.
+ */
+static const char*
+format_ns(double ns, char *buf, size_t len)
+{
+    if (ns >= 1e9) {
+        snprintf(buf, len, "%.2f s", ns / 1e9);
+    } else if (ns >= 1e6) {
+        snprintf(buf, len, "%.1f ms", ns / 1e6);
+    } else if (ns >= 1e3) {
+        snprintf(buf, len, "%.1f us", ns / 1e3);
+    } else {
+        snprintf(buf, len, "%.0f ns", ns);
+    }
+    return buf;
+}
+
+/**
+ * site_label describes the site by its innermost frames,
+ * the allocating function first.
+ */
+static const char*
+site_label(const struct heap_site *site, char *buf, size_t len)
+{
+    size_t used = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < site->depth && i < HEAP_LABEL_FRAMES && used < len; i++) {
+        used += snprintf(buf + used, len - used, "%s%s", i > 0 ? " < " : "",
+                         site->frames[i].name);
+    }
+    return buf;
+}
+
+static int
+cmp_site_bytes(const void *a, const void *b)
+{
+    const struct heap_site *x = a;
+    const struct heap_site *y = b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+static int
+cmp_site_short(const void *a, const void *b)
+{
+    const struct heap_site *x = a;
+    const struct heap_site *y = b;
+    return (x->short_lived < y->short_lived) - (x->short_lived > y->short_lived);
+}
+
+/**
+ * print_heap_report prints the totals, the sites that
+ * allocate the most bytes and those allocating the most
+ * short-lived objects, which are good candidates for an
+ * arena or reusing a buffer.
+ */
+static void
+print_heap_report(const char *output, struct heap_profile *hp)
+{
+    char a[32], b[32], c[32], d[32];
+
+    printf("\n%s: %s allocations, %s allocated, %s frees, %s peak in use\n", output,
+           format_count(hp->allocs, a, sizeof(a)), format_bytes(hp->bytes, b, sizeof(b)),
+           format_count(hp->frees, c, sizeof(c)), format_bytes(hp->peak, d, sizeof(d)));
+    if (hp->rate > 1) {
+        printf("sites sampled about every %s allocated, their counts are estimates\n",
+               format_bytes(hp->rate, a, sizeof(a)));
+    } else {
+        printf("every allocation recorded\n");
+    }
+
+    char label[256];
+    qsort(hp->sites, hp->count, sizeof(struct heap_site), cmp_site_bytes);
+    printf("\ntop allocation sites\n%10s %12s %12s %10s  %s\n", "allocs", "bytes", "peak",
+           "lifetime", "site");
+    for (int i = 0; i < hp->count && i < HEAP_TOP; i++) {
+        const struct heap_site *s = &hp->sites[i];
+        printf("%10s %12s %12s %10s  %s\n", format_count(s->allocs, a, sizeof(a)),
+               format_bytes(s->bytes, b, sizeof(b)), format_bytes(s->peak, c, sizeof(c)),
+               s->frees > 0 ? format_ns(s->lifetime_ns / s->frees, d, sizeof(d)) : "-",
+               site_label(s, label, sizeof(label)));
+    }
+    if (hp->count == 0) {
+        printf("none\n");
+    }
+
+    qsort(hp->sites, hp->count, sizeof(struct heap_site), cmp_site_short);
+    printf("\nshort-lived allocations, freed within %s, arena candidates\n%10s %8s %10s  %s\n",
+           format_ns(HEAP_SHORT_NS, a, sizeof(a)), "short", "share", "lifetime", "site");
+    int shown = 0;
+    for (int i = 0; i < hp->count && shown < HEAP_TOP; i++) {
+        const struct heap_site *s = &hp->sites[i];
+        if (s->short_lived < 1 || s->short_lived < s->allocs * HEAP_SHORT_SHARE) {
+            continue;
+        }
+        printf("%10s %7.1f%% %10s  %s\n", format_count(s->short_lived, a, sizeof(a)),
+               100 * s->short_lived / s->allocs, format_ns(s->lifetime_ns / s->frees, d, sizeof(d)),
+               site_label(s, label, sizeof(label)));
+        shown++;
+    }
+    if (shown == 0) {
+        printf("none\n");
+    }
+}
+
+int
+profile_heap(const struct profile *profile, int argc, char **argv, long rate)
+{
+    char *output = build_output();
+    if (output[0] == '\0') {
+        fprintf(stderr, "error: only bin projects can be profiled\n");
+        free(output);
+        return 1;
+    }
+
+    struct profile fp = { 0 };
+    struct strbuf name = { 0 };
+    struct strbuf cflags = { 0 };
+    struct profiler p = { 0 };
+    struct heap_profile hp = { 0 };
+    fp_profile(profile, &fp, &name, &cflags);
+    profiler_init(&p, &fp);
+
+    char library[PATH_MAX];
+    int status = 0, res = 1;
+
+    if (heap_library(library) != 0 || build_profiled(&fp, output, p.binary) != 0) {
+        goto out;
+    }
+
+    printf("profiling allocations of %s\n", output);
+    fflush(stdout);
+    if (run_heap(p.binary, library, rate, argc, argv, &status) != 0) {
+        goto out;
+    }
+    if (read_heaps(&p, &hp) <= 0) {
+        fprintf(stderr, "error: %s didn't write a heap profile\n", output);
+        goto out;
+    }
+
+    struct strbuf title = { 0 };
+    char bytes[32];
+    strbuf_appendf(&title, "%s: %s allocated", output,
+                   format_bytes(hp.bytes, bytes, sizeof(bytes)));
+    sort_children(&p.root);
+    res = 0;
+    if (p.root.count > 0 &&
+        write_outputs(&p, PROFILE_HEAP_FOLDED, PROFILE_HEAP_SVG, title.buf, "bytes") != 0) {
+        res = 1;
+    }
+    strbuf_free(&title);
+
+out:
+    // leave a build of the selected profile behind
+    build_clean();
+    if (prepare(profile) != 0 || build_project(profile) != 0) {
+        res = 1;
+    }
+
+    if (res == 0) {
+        print_heap_report(output, &hp);
+        if (p.root.count > 0) {
+            printf("\nfolded stacks: %s\nflamegraph: %s\n", PROFILE_HEAP_FOLDED, PROFILE_HEAP_SVG);
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "warning: %s exited with status %d\n", output, WEXITSTATUS(status));
+        }
+    }
+
+    free(hp.sites);
+    profiler_free(&p);
+    strbuf_free(&name);
+    strbuf_free(&cflags);
+    free(output);
+
+    return res;
+}
+
+
+#else
+
+int
+profile_run(const struct profile *profile, int argc, char **argv)
+{
+    (void)profile;
+    (void)argc;
+    (void)argv;
+
+    fprintf(stderr, "error: profile requires perf_event_open which is only available on Linux\n");
+
+    return 1;
+}
+
+int
+profile_heap(const struct profile *profile, int argc, char **argv, long rate)
+{
+    (void)profile;
+    (void)argc;
+    (void)argv;
+    (void)rate;
+
+    fprintf(stderr, "error: profile --heap is only available on Linux\n");
+
+    return 1;
+}
+
+#endif
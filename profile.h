@@ -0,0 +1,91 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "config.h"
+
+/**
+ * PROFILE_DIR holds the folded stacks and the flamegraph
+ * of the last profile.
+ */
+#define PROFILE_DIR     ".flotsam/profile"
+#define PROFILE_FOLDED  PROFILE_DIR "/stacks.folded"
+#define PROFILE_SVG     PROFILE_DIR "/flamegraph.svg"
+
+/**
+ * PROFILE_HEAP_FOLDED and PROFILE_HEAP_SVG hold the bytes
+ * allocated by call stack of the last heap profile.
+ */
+#define PROFILE_HEAP_FOLDED PROFILE_DIR "/heap.folded"
+#define PROFILE_HEAP_SVG    PROFILE_DIR "/heap.svg"
+
+/**
+ * PROFILE_HEAP_RATE is the default average number of bytes
+ * allocated between two sampled allocations.
+ */
+#define PROFILE_HEAP_RATE 32768
+
+/**
+ * PROFILE_BASE is the profile the binary is built with for
+ * profiling when no other profile is selected.
+ */
+#define PROFILE_BASE "release"
+
+/**
+ * profile_run builds the project's binary and its dependencies with the
+ * flags of the given profile plus debug info and frame pointers, and runs
+ * it with the given arguments under a sampling profiler built on
+ * perf_event_open. CPU cycles are sampled, or the cpu-clock where there are
+ * no hardware counters, with the kernel unwinding the user stack through the
+ * frame pointers. Samples are symbolized against the binary and the cached
+ * libraries of the dependencies and written as folded stacks to
+ * PROFILE_FOLDED and as a flamegraph to PROFILE_SVG. The share of samples
+ * spent in the project, each dependency and the system libraries is
+ * printed along with the hottest functions. The project is rebuilt with the
+ * given profile afterwards. Linux only.
+ */
+int
+profile_run(const struct profile *profile, int argc, char **argv);
+
+/**
+ * profile_heap builds the project's binary like profile_run and runs it with
+ * the given arguments and flotsam's heap profiler preloaded. The profiler
+ * counts every allocation and free and samples allocations about once every
+ * rate bytes, recording their call stack and, once freed, their lifetime;
+ * a rate of 0 records every allocation. Stacks are symbolized like
+ * profile_run's and the top allocation sites by bytes are printed with
+ * their estimated allocation count, peak bytes in use and average
+ * lifetime, followed by the sites whose allocations are mostly short-lived,
+ * the candidates for an arena. Bytes allocated by stack are written to
+ * PROFILE_HEAP_FOLDED and PROFILE_HEAP_SVG. Linux with glibc only.
+ */
+int
+profile_heap(const struct profile *profile, int argc, char **argv, long rate);
+
+#endif /* _PROFILE_H */
@@ -0,0 +1,227 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+// Z_95 is the two-sided 95% quantile of the normal
+// distribution.
+#define Z_95 1.959963984540054
+
+// MAD_SCALE makes the MAD estimate the standard deviation
+// of normally distributed samples.
+#define MAD_SCALE 1.4826
+
+/**
+ * cmp_double orders doubles ascending.
+ */
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * median returns the median of the sorted samples.
+ */
+static double
+median(const double *sorted, int n)
+{
+    if (n % 2 == 1) {
+        return sorted[n / 2];
+    }
+    return (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+}
+
+void
+stats_compute(const double *samples, int n, struct stats *s)
+{
+    memset(s, 0, sizeof(struct stats));
+    s->n = n;
+    if (n <= 0) {
+        return;
+    }
+
+    double *sorted = malloc(n * sizeof(double));
+    double *dev = malloc(n * sizeof(double));
+    if (sorted == NULL || dev == NULL) {
+        perror("unable to allocate memory for samples");
+        free(sorted);
+        free(dev);
+        return;
+    }
+    memcpy(sorted, samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+
+    s->min = sorted[0];
+    s->max = sorted[n - 1];
+    s->median = median(sorted, n);
+
+    for (int i = 0; i < n; i++) {
+        dev[i] = fabs(sorted[i] - s->median);
+    }
+    qsort(dev, n, sizeof(double), cmp_double);
+    s->mad = MAD_SCALE * median(dev, n);
+
+    // the ranks bounding the median with 95% confidence
+    // under the normal approximation of the binomial
+    double half = Z_95 * sqrt((double)n) / 2.0;
+    int lo = (int)floor((double)n / 2.0 - half);
+    int hi = (int)ceil((double)n / 2.0 + half);
+    if (lo < 0) {
+        lo = 0;
+    }
+    if (hi > n - 1) {
+        hi = n - 1;
+    }
+    s->ci_low = sorted[lo];
+    s->ci_high = sorted[hi];
+
+    free(sorted);
+    free(dev);
+}
+
+/**
+ * ranked is a sample tagged with the set it came from.
+ */
+struct ranked
+{
+    double value;
+    int set;
+};
+
+/**
+ * cmp_ranked orders ranked samples by value.
+ */
+static int
+cmp_ranked(const void *a, const void *b)
+{
+    return cmp_double(&((const struct ranked *)a)->value, &((const struct ranked *)b)->value);
+}
+
+double
+stats_mann_whitney(const double *a, int na, const double *b, int nb)
+{
+    if (na <= 0 || nb <= 0) {
+        return 1.0;
+    }
+
+    int n = na + nb;
+    struct ranked *all = malloc(n * sizeof(struct ranked));
+    if (all == NULL) {
+        perror("unable to allocate memory for samples");
+        return 1.0;
+    }
+    for (int i = 0; i < na; i++) {
+        all[i] = (struct ranked){ a[i], 0 };
+    }
+    for (int i = 0; i < nb; i++) {
+        all[na + i] = (struct ranked){ b[i], 1 };
+    }
+    qsort(all, n, sizeof(struct ranked), cmp_ranked);
+
+    // ties share the average of the ranks they span
+    double rank_sum_a = 0, ties = 0;
+    for (int i = 0; i < n;) {
+        int j = i;
+        while (j < n && all[j].value == all[i].value) {
+            j++;
+        }
+        double rank = (double)(i + j + 1) / 2.0;
+        for (int k = i; k < j; k++) {
+            if (all[k].set == 0) {
+                rank_sum_a += rank;
+            }
+        }
+        double t = (double)(j - i);
+        ties += t * t * t - t;
+        i = j;
+    }
+    free(all);
+
+    double u = rank_sum_a - (double)na * (na + 1) / 2.0;
+    double mean = (double)na * nb / 2.0;
+    double var = (double)na * nb / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0) {
+        return 1.0;
+    }
+
+    // continuity correction toward the mean
+    double z = (fabs(u - mean) - 0.5) / sqrt(var);
+    if (z < 0) {
+        z = 0;
+    }
+
+    return erfc(z / sqrt(2.0));
+}
+
+/**
+ * cmp_double_ptr orders pointers to doubles by the values
+ * they point to.
+ */
+static int
+cmp_double_ptr(const void *a, const void *b)
+{
+    return cmp_double(*(const double *const *)a, *(const double *const *)b);
+}
+
+void
+stats_holm(const double *p, int n, double *adjusted)
+{
+    const double **order = malloc(n * sizeof(double *));
+    if (order == NULL) {
+        // Bonferroni is never less conservative
+        for (int i = 0; i < n; i++) {
+            adjusted[i] = fmin(1.0, p[i] * n);
+        }
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        order[i] = &p[i];
+    }
+    qsort(order, n, sizeof(double *), cmp_double_ptr);
+
+    double prev = 0;
+    for (int k = 0; k < n; k++) {
+        double adj = fmin(1.0, *order[k] * (n - k));
+        prev = fmax(prev, adj);
+        adjusted[order[k] - p] = prev;
+    }
+    free(order);
+}
+
+int
+stats_significant(const double *a, int na, const double *b, int nb)
+{
+    return stats_mann_whitney(a, na, b, nb) < STATS_ALPHA;
+}
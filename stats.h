@@ -0,0 +1,80 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#define STATS_ALPHA 0.05
+
+/**
+ * stats summarizes a set of samples with robust
+ * statistics that aren't thrown off by outliers.
+ */
+struct stats
+{
+    int n;
+    double median;
+    double mad;
+    double ci_low;
+    double ci_high;
+    double min;
+    double max;
+};
+
+/**
+ * stats_compute fills in s from the n samples. The confidence interval is a
+ * distribution free 95% interval for the median taken from the order
+ * statistics. The samples are left untouched.
+ */
+void
+stats_compute(const double *samples, int n, struct stats *s);
+
+/**
+ * stats_mann_whitney returns the two-sided p-value of the Mann-Whitney U test
+ * of the 2 sets of samples having the same distribution, using the normal
+ * approximation with tie correction. It returns 1 if either set is empty.
+ */
+double
+stats_mann_whitney(const double *a, int na, const double *b, int nb);
+
+/**
+ * stats_holm stores in adjusted the n p-values adjusted for being tested
+ * together with the Holm-Bonferroni method, so comparing each with
+ * STATS_ALPHA keeps the chance of any false positive at STATS_ALPHA. The
+ * smallest p-value is multiplied by n, the next by n - 1 and so on, keeping
+ * the adjusted values in the same order and at most 1.
+ */
+void
+stats_holm(const double *p, int n, double *adjusted);
+
+/**
+ * stats_significant returns 1 if a and b differ at the STATS_ALPHA level.
+ */
+int
+stats_significant(const double *a, int na, const double *b, int nb);
+
+#endif /* _STATS_H */
@@ -0,0 +1,309 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "config.h"
+#include "dependency.h"
+#include "lock.h"
+#include "sysroot.h"
+#include "util.h"
+
+#define STAMP_FILE SYSROOT_INCLUDE_DIR "/.flotsam-lock"
+#define HEADER_EXT ".h"
+
+// skip_dirs hold tests, examples and build output rather
+// than public headers, and commonly ship headers at the
+// same paths in unrelated dependencies, e.g. tests/unity.h
+static const char *skip_dirs[] = { "bench", "benchmarks", "build", "example", "examples",
+                                   "test", "tests" };
+
+/**
+ * header_owner records which dependency provided a
+ * header so conflicts can name both sides.
+ */
+struct header_owner
+{
+    char *rel;
+    const char *dep;
+};
+
+static struct header_owner *owners;
+static int owner_count;
+static int conflicts;
+
+/**
+ * is_header returns 1 if the file name ends in .h.
+ */
+static int
+is_header(const char *name)
+{
+    size_t len = strlen(name);
+    return len > strlen(HEADER_EXT) && strcmp(name + len - strlen(HEADER_EXT), HEADER_EXT) == 0;
+}
+
+/**
+ * is_skipped returns 1 if the directory name is one of
+ * skip_dirs.
+ */
+static int
+is_skipped(const char *name)
+{
+    for (size_t i = 0; i < sizeof(skip_dirs) / sizeof(skip_dirs[0]); i++) {
+        if (strcmp(name, skip_dirs[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * same_content returns 1 if the 2 files hold the same
+ * bytes.
+ */
+static int
+same_content(const char *a, const char *b)
+{
+    struct stat sa, sb;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0 || sa.st_size != sb.st_size) {
+        return 0;
+    }
+
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int same = fa != NULL && fb != NULL;
+    char ba[4096], bb[4096];
+    size_t na;
+    while (same && (na = fread(ba, 1, sizeof(ba), fa)) > 0) {
+        same = fread(bb, 1, na, fb) == na && memcmp(ba, bb, na) == 0;
+    }
+    if (fa != NULL) {
+        fclose(fa);
+    }
+    if (fb != NULL) {
+        fclose(fb);
+    }
+
+    return same;
+}
+
+/**
+ * owner_of returns the dependency that provided the
+ * header at the given relative path.
+ */
+static const char*
+owner_of(const char *rel)
+{
+    for (int i = 0; i < owner_count; i++) {
+        if (strcmp(owners[i].rel, rel) == 0) {
+            return owners[i].dep;
+        }
+    }
+    return "unknown";
+}
+
+/**
+ * add_header links a single header into the tree. A
+ * header already provided by another dependency is only
+ * a conflict if its contents differ.
+ */
+static int
+add_header(const char *src, const char *rel, const char *dep)
+{
+    char dst[PATH_MAX];
+    snprintf(dst, PATH_MAX, "%s/%s", SYSROOT_INCLUDE_DIR, rel);
+
+    struct stat s;
+    if (lstat(dst, &s) == 0) {
+        if (same_content(src, dst)) {
+            return 0;
+        }
+        fprintf(stderr, "warning: header conflict: %s provided by %s and %s, using %s\n",
+                rel, owner_of(rel), dep, owner_of(rel));
+        conflicts++;
+        return 0;
+    }
+
+    char *slash = strrchr(dst, '/');
+    *slash = '\0';
+    if (mkdir_p(dst, 0755) != 0) {
+        perror(dst);
+        return -1;
+    }
+    *slash = '/';
+
+    if (link_file(src, dst) != 0) {
+        perror(src);
+        return -1;
+    }
+
+    struct header_owner *o = realloc(owners, (owner_count + 1) * sizeof(struct header_owner));
+    if (o == NULL) {
+        perror("unable to allocate memory for headers");
+        return -1;
+    }
+    owners = o;
+    owners[owner_count].rel = strdup(rel);
+    owners[owner_count].dep = dep;
+    owner_count++;
+
+    return 0;
+}
+
+/**
+ * add_dir walks the given directory of a dependency and
+ * adds every header found. Hidden directories such as
+ * .git and those in skip_dirs are skipped.
+ */
+static int
+add_dir(const char *root, const char *rel, const char *dep)
+{
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s%s%s", root, rel[0] ? "/" : "", rel);
+
+    DIR *dp = opendir(path);
+    if (dp == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    int res = 0;
+    struct dirent *dirp;
+    while (res == 0 && (dirp = readdir(dp)) != NULL) {
+        if (dirp->d_name[0] == '.') {
+            continue;
+        }
+
+        char child_rel[PATH_MAX];
+        snprintf(child_rel, PATH_MAX, "%s%s%s", rel, rel[0] ? "/" : "", dirp->d_name);
+
+        char child[PATH_MAX];
+        if (snprintf(child, PATH_MAX, "%s/%s", root, child_rel) >= PATH_MAX) {
+            continue;
+        }
+
+        struct stat s;
+        if (lstat(child, &s) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(s.st_mode)) {
+            if (!is_skipped(dirp->d_name)) {
+                res = add_dir(root, child_rel, dep);
+            }
+        } else if (S_ISREG(s.st_mode) && is_header(dirp->d_name)) {
+            res = add_header(child, child_rel, dep);
+        }
+    }
+    closedir(dp);
+
+    return res;
+}
+
+/**
+ * stamp_matches returns 1 if the tree was built from the
+ * lock file with the given hash.
+ */
+static int
+stamp_matches(uint64_t hash)
+{
+    FILE *fd = fopen(STAMP_FILE, "r");
+    if (fd == NULL) {
+        return 0;
+    }
+
+    uint64_t stamp = 0;
+    int n = fscanf(fd, "%" SCNx64, &stamp);
+    fclose(fd);
+
+    return n == 1 && stamp == hash;
+}
+
+int
+sysroot_update(const struct dependencies *deps)
+{
+    uint64_t hash = lock_hash();
+    if (hash != 0 && stamp_matches(hash)) {
+        return 0;
+    }
+
+    if (remove_tree(SYSROOT_INCLUDE_DIR) != 0 || mkdir_p(SYSROOT_INCLUDE_DIR, 0755) != 0) {
+        perror(SYSROOT_INCLUDE_DIR);
+        return -1;
+    }
+
+    int res = 0;
+    conflicts = 0;
+    for (int i = 0; i < deps->count && res == 0; i++) {
+        char *src = dependency_path(deps->dependencies[i].name, deps->dependencies[i].vers);
+        res = add_dir(src, "", deps->dependencies[i].name);
+        free(src);
+    }
+
+    for (int i = 0; i < owner_count; i++) {
+        free(owners[i].rel);
+    }
+    free(owners);
+    owners = NULL;
+    owner_count = 0;
+
+    if (res != 0) {
+        return res;
+    }
+    if (conflicts > 0) {
+        fprintf(stderr, "warning: %d conflicting headers in %s\n", conflicts, SYSROOT_INCLUDE_DIR);
+    }
+
+    // without a lock there's nothing to key the tree on so
+    // it's rebuilt next time
+    if (hash == 0) {
+        return 0;
+    }
+
+    FILE *fd = fopen(STAMP_FILE, "w");
+    if (fd == NULL) {
+        perror(STAMP_FILE);
+        return -1;
+    }
+    fprintf(fd, "%016" PRIx64 "\n", hash);
+
+    return fclose(fd) == 0 ? 0 : -1;
+}
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <strings.h>
 
+#include "../stats.h"
 #include "unity/unity.h"
 
 /*
@@ -40,12 +41,166 @@ test(void)
     return;
 }
 
+/*
+ * test_stats_odd takes the middle sample as the median.
+ */
+void
+test_stats_odd(void)
+{
+    const double samples[] = { 5, 1, 3, 2, 4 };
+    struct stats s;
+    stats_compute(samples, 5, &s);
+
+    TEST_ASSERT_EQUAL_INT(5, s.n);
+    TEST_ASSERT_EQUAL_DOUBLE(3, s.median);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 1.4826, s.mad);
+    TEST_ASSERT_EQUAL_DOUBLE(1, s.min);
+    TEST_ASSERT_EQUAL_DOUBLE(5, s.max);
+    TEST_ASSERT_EQUAL_DOUBLE(5, samples[0]);
+}
+
+/*
+ * test_stats_even averages the 2 middle samples and isn't
+ * moved by the outlier.
+ */
+void
+test_stats_even(void)
+{
+    const double samples[] = { 10, 2, 6, 1, 4, 3 };
+    struct stats s;
+    stats_compute(samples, 6, &s);
+
+    TEST_ASSERT_EQUAL_DOUBLE(3.5, s.median);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, 2 * 1.4826, s.mad);
+}
+
+/*
+ * test_stats_ci_small clamps the interval to the samples
+ * when there are too few for 95% confidence.
+ */
+void
+test_stats_ci_small(void)
+{
+    const double one[] = { 7 };
+    const double five[] = { 5, 1, 3, 2, 4 };
+    struct stats s;
+
+    stats_compute(one, 1, &s);
+    TEST_ASSERT_EQUAL_DOUBLE(7, s.ci_low);
+    TEST_ASSERT_EQUAL_DOUBLE(7, s.ci_high);
+
+    stats_compute(five, 5, &s);
+    TEST_ASSERT_EQUAL_DOUBLE(1, s.ci_low);
+    TEST_ASSERT_EQUAL_DOUBLE(5, s.ci_high);
+
+    stats_compute(NULL, 0, &s);
+    TEST_ASSERT_EQUAL_INT(0, s.n);
+    TEST_ASSERT_EQUAL_DOUBLE(0, s.median);
+}
+
+/*
+ * test_stats_ci takes the interval from the order
+ * statistics around the median.
+ */
+void
+test_stats_ci(void)
+{
+    double samples[20];
+    for (int i = 0; i < 20; i++) {
+        samples[i] = 20 - i;
+    }
+    struct stats s;
+    stats_compute(samples, 20, &s);
+
+    TEST_ASSERT_EQUAL_DOUBLE(10.5, s.median);
+    TEST_ASSERT_EQUAL_DOUBLE(6, s.ci_low);
+    TEST_ASSERT_EQUAL_DOUBLE(16, s.ci_high);
+}
+
+/*
+ * test_mann_whitney_identical finds no difference between
+ * the same samples, all tied or not.
+ */
+void
+test_mann_whitney_identical(void)
+{
+    const double a[] = { 1, 2, 3, 4, 5 };
+    const double tied[] = { 5, 5, 5 };
+
+    TEST_ASSERT_EQUAL_DOUBLE(1, stats_mann_whitney(a, 5, a, 5));
+    TEST_ASSERT_EQUAL_DOUBLE(1, stats_mann_whitney(tied, 3, tied, 3));
+    TEST_ASSERT_EQUAL_DOUBLE(1, stats_mann_whitney(a, 5, NULL, 0));
+    TEST_ASSERT_FALSE(stats_significant(a, 5, a, 5));
+}
+
+/*
+ * test_mann_whitney_ties shares ranks between tied samples
+ * and corrects the variance for them.
+ */
+void
+test_mann_whitney_ties(void)
+{
+    const double a[] = { 1, 2, 2, 3, 3 };
+    const double b[] = { 3, 3, 4, 4, 5 };
+
+    double p = stats_mann_whitney(a, 5, b, 5);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.0300596, p);
+    TEST_ASSERT_EQUAL_DOUBLE(p, stats_mann_whitney(b, 5, a, 5));
+}
+
+/*
+ * test_mann_whitney_shifted finds samples that don't
+ * overlap significantly different.
+ */
+void
+test_mann_whitney_shifted(void)
+{
+    double a[10], b[10];
+    for (int i = 0; i < 10; i++) {
+        a[i] = i + 1;
+        b[i] = i + 101;
+    }
+
+    TEST_ASSERT_DOUBLE_WITHIN(1e-7, 0.0001827, stats_mann_whitney(a, 10, b, 10));
+    TEST_ASSERT_TRUE(stats_significant(a, 10, b, 10));
+}
+
+/*
+ * test_holm multiplies the sorted p-values by the number
+ * of hypotheses left and keeps them in order.
+ */
+void
+test_holm(void)
+{
+    const double p[] = { 0.01, 0.04, 0.03, 0.5 };
+    double adjusted[4];
+    stats_holm(p, 4, adjusted);
+
+    TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.04, adjusted[0]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.09, adjusted[1]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.09, adjusted[2]);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.5, adjusted[3]);
+
+    const double high[] = { 0.7, 0.6 };
+    stats_holm(high, 2, adjusted);
+    TEST_ASSERT_EQUAL_DOUBLE(1, adjusted[0]);
+    TEST_ASSERT_EQUAL_DOUBLE(1, adjusted[1]);
+}
+
 int
 main(void)
 {
     UNITY_BEGIN();
 
     RUN_TEST(test);
+    RUN_TEST(test_stats_odd);
+    RUN_TEST(test_stats_even);
+    RUN_TEST(test_stats_ci_small);
+    RUN_TEST(test_stats_ci);
+    RUN_TEST(test_mann_whitney_identical);
+    RUN_TEST(test_mann_whitney_ties);
+    RUN_TEST(test_mann_whitney_shifted);
+    RUN_TEST(test_holm);
 
     return UNITY_END();
 }
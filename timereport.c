@@ -0,0 +1,872 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "build.h"
+#include "config.h"
+#include "dependency.h"
+#include "sysroot.h"
+#include "timereport.h"
+#include "toolchain.h"
+#include "util.h"
+
+#define ENV_DIR          "FLOTSAM_TIME_REPORT_DIR"
+#define ENV_KIND         "FLOTSAM_TIME_REPORT_KIND"
+#define REPORT_DIR       ".flotsam/time-report"
+#define REPORT_FILE      ".flotsam/time-report.json"
+#define REPORT_TOP       20
+#define LINK_RUNS        3
+#define KIND_CLANG       "clang"
+#define KIND_GCC         "gcc"
+#define GUARDS_LINE      "Multiple include guards may be useful for:"
+#define TIME_VAR_LINE    "Time variable"
+#define PARSING_LINE     " phase parsing"
+#define TOTAL_LINE       " TOTAL"
+
+/**
+ * header_cost is the time spent including a header,
+ * nested includes included, within one or more TUs.
+ */
+struct header_cost
+{
+    char *path;
+    double us;
+    int count;
+};
+
+/**
+ * header_costs is a growable list of header costs.
+ */
+struct header_costs
+{
+    int count;
+    struct header_cost *items;
+};
+
+/**
+ * costs_add appends a header cost to the list.
+ */
+static int
+costs_add(struct header_costs *hc, const char *path, double us)
+{
+    struct header_cost *items = realloc(hc->items, (hc->count + 1) * sizeof(struct header_cost));
+    if (items == NULL) {
+        perror("unable to allocate memory for headers");
+        return -1;
+    }
+    hc->items = items;
+    hc->items[hc->count].path = strdup(path);
+    hc->items[hc->count].us = us;
+    hc->items[hc->count].count = 1;
+    hc->count++;
+
+    return 0;
+}
+
+/**
+ * costs_free frees the list.
+ */
+static void
+costs_free(struct header_costs *hc)
+{
+    for (int i = 0; i < hc->count; i++) {
+        free(hc->items[i].path);
+    }
+    free(hc->items);
+    hc->items = NULL;
+    hc->count = 0;
+}
+
+/**
+ * cmp_cost_path orders header costs by path.
+ */
+static int
+cmp_cost_path(const void *a, const void *b)
+{
+    return strcmp(((const struct header_cost *)a)->path, ((const struct header_cost *)b)->path);
+}
+
+/**
+ * cmp_cost_us orders header costs by time, most
+ * expensive first.
+ */
+static int
+cmp_cost_us(const void *a, const void *b)
+{
+    double x = ((const struct header_cost *)a)->us;
+    double y = ((const struct header_cost *)b)->us;
+    return (x < y) - (x > y);
+}
+
+/**
+ * costs_merge sums the costs of entries with the same
+ * path, leaving the list sorted by path.
+ */
+static void
+costs_merge(struct header_costs *hc)
+{
+    if (hc->count == 0) {
+        return;
+    }
+    qsort(hc->items, hc->count, sizeof(struct header_cost), cmp_cost_path);
+
+    int out = 0;
+    for (int i = 1; i < hc->count; i++) {
+        if (strcmp(hc->items[out].path, hc->items[i].path) == 0) {
+            hc->items[out].us += hc->items[i].us;
+            hc->items[out].count += hc->items[i].count;
+            free(hc->items[i].path);
+            continue;
+        }
+        hc->items[++out] = hc->items[i];
+    }
+    hc->count = out + 1;
+}
+
+/**
+ * ends_with returns 1 if s ends with suffix.
+ */
+static int
+ends_with(const char *s, const char *suffix)
+{
+    size_t len = strlen(s);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+/**
+ * parse_clang_trace reads the headers and their
+ * inclusive parse time from a -ftime-trace file.
+ */
+static int
+parse_clang_trace(const char *path, struct header_costs *hc)
+{
+    json_error_t error;
+    json_t *root = json_load_file(path, 0, &error);
+    if (root == NULL) {
+        return -1;
+    }
+
+    json_t *events = json_object_get(root, "traceEvents");
+    size_t i;
+    json_t *ev;
+    json_array_foreach(events, i, ev) {
+        const char *name = json_string_value(json_object_get(ev, "name"));
+        if (name == NULL || strcmp(name, "Source") != 0) {
+            continue;
+        }
+        const char *detail = json_string_value(json_object_get(json_object_get(ev, "args"), "detail"));
+        json_t *dur = json_object_get(ev, "dur");
+        if (detail != NULL && json_is_number(dur)) {
+            costs_add(hc, detail, json_number_value(dur));
+        }
+    }
+    json_decref(root);
+    costs_merge(hc);
+
+    return 0;
+}
+
+/**
+ * gcc_include is an entry of gcc's -H include tree.
+ */
+struct gcc_include
+{
+    char *path;
+    int depth;
+    off_t size;
+    off_t inclusive;
+};
+
+/**
+ * parse_gcc_output splits what gcc wrote to stderr with
+ * -H and -ftime-report. Regular diagnostics are written
+ * back to stderr. gcc doesn't time headers so the parse
+ * time of the TU is spread over its headers by their
+ * inclusive size, which makes the result an estimate.
+ */
+static int
+parse_gcc_output(const char *path, const char *source, double wall_us, struct header_costs *hc)
+{
+    FILE *fd = fopen(path, "r");
+    if (fd == NULL) {
+        return -1;
+    }
+
+    struct gcc_include *incs = NULL;
+    int inc_count = 0;
+    double parsing = -1, total = -1;
+    int in_guards = 0, in_times = 0;
+    char line[PATH_MAX + 64];
+
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+
+        if (line[0] == '.') {
+            int depth = (int)strspn(line, ".");
+            if (line[depth] != ' ') {
+                fprintf(stderr, "%s\n", line);
+                continue;
+            }
+
+            struct gcc_include *n = realloc(incs, (inc_count + 1) * sizeof(struct gcc_include));
+            if (n == NULL) {
+                break;
+            }
+            incs = n;
+
+            struct stat s;
+            incs[inc_count].path = strdup(line + depth + 1);
+            incs[inc_count].depth = depth;
+            incs[inc_count].size = stat(line + depth + 1, &s) == 0 ? s.st_size : 0;
+            incs[inc_count].inclusive = incs[inc_count].size;
+            inc_count++;
+            continue;
+        }
+        if (strcmp(line, GUARDS_LINE) == 0) {
+            in_guards = 1;
+            continue;
+        }
+        if (in_guards && line[0] == '/') {
+            continue;
+        }
+        in_guards = 0;
+
+        if (strncmp(line, TIME_VAR_LINE, strlen(TIME_VAR_LINE)) == 0) {
+            in_times = 1;
+            continue;
+        }
+        if (in_times) {
+            char *colon = strchr(line, ':');
+            double usr, sys, wall;
+            if (colon != NULL && sscanf(colon + 1, " %lf ( %*[^)]) %lf ( %*[^)]) %lf", &usr, &sys, &wall) == 3) {
+                if (strncmp(line, PARSING_LINE, strlen(PARSING_LINE)) == 0) {
+                    parsing = wall;
+                }
+            }
+            if (strncmp(line, TOTAL_LINE, strlen(TOTAL_LINE)) == 0) {
+                if (colon != NULL) {
+                    sscanf(colon + 1, " %*f %*f %lf", &total);
+                }
+                in_times = 0;
+            }
+            continue;
+        }
+        if (line[0] != '\0') {
+            fprintf(stderr, "%s\n", line);
+        }
+    }
+    fclose(fd);
+
+    // fold sizes of nested includes into their parents
+    for (int i = inc_count - 1; i >= 0; i--) {
+        for (int j = i - 1; j >= 0; j--) {
+            if (incs[j].depth < incs[i].depth) {
+                if (incs[j].depth == incs[i].depth - 1) {
+                    incs[j].inclusive += incs[i].inclusive;
+                }
+                break;
+            }
+        }
+    }
+
+    struct stat s;
+    double bytes = stat(source, &s) == 0 ? (double)s.st_size : 0;
+    for (int i = 0; i < inc_count; i++) {
+        if (incs[i].depth == 1) {
+            bytes += (double)incs[i].inclusive;
+        }
+    }
+
+    double share = (parsing > 0 && total > 0) ? parsing / total : 1.0;
+    for (int i = 0; i < inc_count; i++) {
+        if (bytes > 0) {
+            costs_add(hc, incs[i].path, wall_us * share * (double)incs[i].inclusive / bytes);
+        }
+        free(incs[i].path);
+    }
+    free(incs);
+    costs_merge(hc);
+
+    return 0;
+}
+
+/**
+ * find_output returns the value of -o in the arguments.
+ */
+static const char*
+find_output(int argc, char **argv)
+{
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "-o") == 0) {
+            return argv[i + 1];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * find_source returns the first C source in the
+ * arguments.
+ */
+static const char*
+find_source(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-' && (ends_with(argv[i], ".c") || ends_with(argv[i], ".cc") ||
+                                  ends_with(argv[i], ".cpp"))) {
+            return argv[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * record writes the result of a single compiler run.
+ */
+static void
+record(const char *dir, const char *source, const char *output, int is_link,
+       double wall_us, struct header_costs *hc)
+{
+    json_t *root = json_object();
+    json_object_set_new(root, "source", json_string(source != NULL ? source : ""));
+    json_object_set_new(root, "output", json_string(output != NULL ? output : ""));
+    json_object_set_new(root, "link", json_boolean(is_link));
+    json_object_set_new(root, "wall_us", json_real(wall_us));
+
+    json_t *headers = json_array();
+    for (int i = 0; i < hc->count; i++) {
+        json_t *h = json_object();
+        json_object_set_new(h, "path", json_string(hc->items[i].path));
+        json_object_set_new(h, "us", json_real(hc->items[i].us));
+        json_array_append_new(headers, h);
+    }
+    json_object_set_new(root, "headers", headers);
+
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/%d.json", dir, (int)getpid());
+    json_dump_file(root, path, JSON_COMPACT);
+    json_decref(root);
+}
+
+int
+timereport_wrap(int argc, char **argv)
+{
+    const char *dir = getenv(ENV_DIR);
+    const char *kind = getenv(ENV_KIND);
+
+    // anything given a source compiles it, linking or not
+    const char *source = find_source(argc, argv);
+    const char *output = find_output(argc, argv);
+    int is_compile = source != NULL;
+
+    char **args = calloc(argc + 3, sizeof(char*));
+    if (args == NULL) {
+        perror("unable to allocate memory for arguments");
+        return 1;
+    }
+    int n = 0;
+    for (int i = 0; i < argc; i++) {
+        args[n++] = argv[i];
+    }
+
+    int is_gcc = kind != NULL && strcmp(kind, KIND_GCC) == 0;
+    if (dir != NULL && is_compile) {
+        if (is_gcc) {
+            args[n++] = "-ftime-report";
+            args[n++] = "-H";
+        } else {
+            args[n++] = "-ftime-trace";
+        }
+    }
+
+    char err_path[PATH_MAX];
+    snprintf(err_path, PATH_MAX, "%s/%d.stderr", dir != NULL ? dir : ".", (int)getpid());
+
+    uint64_t start = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        free(args);
+        return 1;
+    }
+    if (pid == 0) {
+        if (dir != NULL && is_compile && is_gcc) {
+            int fd = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd >= 0) {
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+        }
+        execvp(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    double wall_us = (double)(now_ns() - start) / 1000.0;
+    free(args);
+
+    if (dir == NULL) {
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+
+    struct header_costs hc = { 0 };
+
+    if (is_compile && is_gcc) {
+        parse_gcc_output(err_path, source != NULL ? source : "", wall_us, &hc);
+        unlink(err_path);
+    } else if (is_compile && output != NULL) {
+        // clang writes the trace next to the object
+        char trace[PATH_MAX];
+        snprintf(trace, PATH_MAX, "%s", output);
+        char *ext = strrchr(trace, '.');
+        if (ext != NULL && strchr(ext, '/') == NULL) {
+            *ext = '\0';
+        }
+        strncat(trace, ".json", PATH_MAX - strlen(trace) - 1);
+        parse_clang_trace(trace, &hc);
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        record(dir, source, output, !is_compile, wall_us, &hc);
+    }
+    costs_free(&hc);
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+/**
+ * header_origin returns the dependency a header comes
+ * from, "system" for toolchain and OS headers and
+ * "project" for everything else.
+ */
+static const char*
+header_origin(const char *path, const char *cwd)
+{
+    struct dependencies *deps = config_get_dependencies();
+    const char *rel = NULL;
+
+    char prefix[PATH_MAX];
+    snprintf(prefix, PATH_MAX, "%s/%s/", cwd, SYSROOT_INCLUDE_DIR);
+    if (strncmp(path, SYSROOT_INCLUDE_DIR "/", strlen(SYSROOT_INCLUDE_DIR) + 1) == 0) {
+        rel = path + strlen(SYSROOT_INCLUDE_DIR) + 1;
+    } else if (strncmp(path, prefix, strlen(prefix)) == 0) {
+        rel = path + strlen(prefix);
+    }
+
+    for (int i = 0; i < deps->count; i++) {
+        char *src = dependency_path(deps->dependencies[i].name, deps->dependencies[i].vers);
+        int match = strncmp(path, src, strlen(src)) == 0;
+        if (!match && rel != NULL) {
+            char candidate[PATH_MAX];
+            snprintf(candidate, PATH_MAX, "%s/%s", src, rel);
+            match = access(candidate, F_OK) == 0;
+        }
+        free(src);
+        if (match) {
+            return deps->dependencies[i].name;
+        }
+    }
+
+    if (path[0] == '/' && strncmp(path, cwd, strlen(cwd)) != 0) {
+        return "system";
+    }
+    return "project";
+}
+
+/**
+ * tu_time is the compile time of a single TU.
+ */
+struct tu_time
+{
+    char *source;
+    double us;
+};
+
+/**
+ * cmp_tu orders TUs by time, slowest first.
+ */
+static int
+cmp_tu(const void *a, const void *b)
+{
+    double x = ((const struct tu_time *)a)->us;
+    double y = ((const struct tu_time *)b)->us;
+    return (x < y) - (x > y);
+}
+
+/**
+ * aggregate reads every record, prints the report and
+ * saves it as JSON.
+ */
+static int
+aggregate(const char *dir)
+{
+    DIR *dp = opendir(dir);
+    if (dp == NULL) {
+        perror(dir);
+        return -1;
+    }
+
+    struct tu_time *tus = NULL;
+    int tu_count = 0;
+    double link_us = 0, total_us = 0;
+    struct header_costs hc = { 0 };
+    struct dirent *dirp;
+
+    while ((dirp = readdir(dp)) != NULL) {
+        if (!ends_with(dirp->d_name, ".json")) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", dir, dirp->d_name);
+        json_error_t error;
+        json_t *rec = json_load_file(path, 0, &error);
+        if (rec == NULL) {
+            continue;
+        }
+
+        double us = json_number_value(json_object_get(rec, "wall_us"));
+        total_us += us;
+        if (json_is_true(json_object_get(rec, "link"))) {
+            link_us += us;
+            json_decref(rec);
+            continue;
+        }
+
+        struct tu_time *t = realloc(tus, (tu_count + 1) * sizeof(struct tu_time));
+        if (t != NULL) {
+            tus = t;
+            tus[tu_count].source = strdup(json_string_value(json_object_get(rec, "source")));
+            tus[tu_count].us = us;
+            tu_count++;
+        }
+
+        size_t i;
+        json_t *h;
+        json_array_foreach(json_object_get(rec, "headers"), i, h) {
+            costs_add(&hc, json_string_value(json_object_get(h, "path")),
+                      json_number_value(json_object_get(h, "us")));
+        }
+        json_decref(rec);
+    }
+    closedir(dp);
+
+    costs_merge(&hc);
+    qsort(hc.items, hc.count, sizeof(struct header_cost), cmp_cost_us);
+    qsort(tus, tu_count, sizeof(struct tu_time), cmp_tu);
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        cwd[0] = '\0';
+    }
+
+    json_t *root = json_object();
+    json_t *jtus = json_array();
+    json_t *jheaders = json_array();
+    json_object_set_new(root, "total_ms", json_real(total_us / 1000.0));
+    json_object_set_new(root, "link_ms", json_real(link_us / 1000.0));
+    json_object_set_new(root, "translation_units", jtus);
+    json_object_set_new(root, "headers", jheaders);
+
+    printf("compile and link time: %.1f ms over %d translation units, %.1f ms linking\n\n",
+           total_us / 1000.0, tu_count, link_us / 1000.0);
+
+    printf("slowest translation units:\n");
+    for (int i = 0; i < tu_count; i++) {
+        if (i < REPORT_TOP) {
+            printf("  %10.1f ms  %s\n", tus[i].us / 1000.0, tus[i].source);
+        }
+        json_array_append_new(jtus, json_pack("{s:s, s:f}", "source", tus[i].source,
+                                              "ms", tus[i].us / 1000.0));
+    }
+
+    printf("\nmost expensive headers by total inclusion time:\n");
+    printf("  %10s  %8s  %-30s  %s\n", "ms", "included", "from", "header");
+    for (int i = 0; i < hc.count; i++) {
+        const char *origin = header_origin(hc.items[i].path, cwd);
+        if (i < REPORT_TOP) {
+            printf("  %10.1f  %8d  %-30s  %s\n", hc.items[i].us / 1000.0, hc.items[i].count,
+                   origin, hc.items[i].path);
+        }
+        json_array_append_new(jheaders, json_pack("{s:s, s:f, s:i, s:s}", "path", hc.items[i].path,
+                                                  "ms", hc.items[i].us / 1000.0,
+                                                  "count", hc.items[i].count, "from", origin));
+    }
+    printf("\nfull report: %s\n", REPORT_FILE);
+
+    json_dump_file(root, REPORT_FILE, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    json_decref(root);
+
+    for (int i = 0; i < tu_count; i++) {
+        free(tus[i].source);
+    }
+    free(tus);
+    costs_free(&hc);
+
+    return 0;
+}
+
+/**
+ * compiler_kind returns KIND_CLANG if the compiler the
+ * build uses is clang and KIND_GCC otherwise, going by
+ * the version the toolchain probe cached.
+ */
+static const char*
+compiler_kind()
+{
+    const struct toolchain *tc = toolchain_get();
+    return tc != NULL && strstr(tc->version, "clang") != NULL ? KIND_CLANG : KIND_GCC;
+}
+
+/**
+ * reset_dir empties the record directory.
+ */
+static int
+reset_dir(const char *dir)
+{
+    if (remove_tree(dir) != 0 || mkdir_p(dir, 0700) != 0) {
+        perror(dir);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * wrapped_build runs the project's build with every
+ * compiler invocation recorded in dir.
+ */
+static int
+wrapped_build(const struct profile *profile, const char *dir)
+{
+    const char *cc = getenv("CC") != NULL ? getenv("CC") : "cc";
+    setenv(ENV_DIR, dir, 1);
+    setenv(ENV_KIND, compiler_kind(), 1);
+
+    char self[PATH_MAX];
+    self_path(self, sizeof(self));
+
+    struct strbuf args = { 0 };
+    strbuf_appendf(&args, "CC='%s %s %s'", self, TIMEREPORT_WRAP_CMD, cc);
+
+    int res = build_project_with(profile, args.buf);
+    strbuf_free(&args);
+    unsetenv(ENV_DIR);
+    unsetenv(ENV_KIND);
+
+    return res;
+}
+
+/**
+ * record_dir stores the absolute path of the record
+ * directory in dir.
+ */
+static int
+record_dir(char *dir, size_t len)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, PATH_MAX) == NULL) {
+        perror("getcwd");
+        return -1;
+    }
+    if (snprintf(dir, len, "%s/%s", cwd, REPORT_DIR) >= (int)len) {
+        fprintf(stderr, "error: path too long: %s\n", cwd);
+        return -1;
+    }
+    return 0;
+}
+
+int
+timereport_build(const struct profile *profile)
+{
+    char dir[PATH_MAX];
+    if (record_dir(dir, sizeof(dir)) != 0 || reset_dir(dir) != 0) {
+        return 1;
+    }
+
+    // every TU has to be compiled to be timed
+    build_clean();
+
+    int res = wrapped_build(profile, dir);
+    if (res != 0) {
+        return res;
+    }
+
+    return aggregate(dir) == 0 ? 0 : 1;
+}
+
+/**
+ * link_us returns the time spent in link steps recorded
+ * in dir or -1 if there were none.
+ */
+static double
+link_us(const char *dir)
+{
+    DIR *dp = opendir(dir);
+    if (dp == NULL) {
+        return -1;
+    }
+
+    double us = -1;
+    struct dirent *dirp;
+    while ((dirp = readdir(dp)) != NULL) {
+        if (!ends_with(dirp->d_name, ".json")) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", dir, dirp->d_name);
+        json_error_t error;
+        json_t *rec = json_load_file(path, 0, &error);
+        if (rec == NULL) {
+            continue;
+        }
+        if (json_is_true(json_object_get(rec, "link"))) {
+            us = (us < 0 ? 0 : us) + json_number_value(json_object_get(rec, "wall_us"));
+        }
+        json_decref(rec);
+    }
+    closedir(dp);
+
+    return us;
+}
+
+/**
+ * cmp_double orders doubles ascending.
+ */
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int
+timereport_links()
+{
+    char *output = build_output();
+    if (output[0] == '\0') {
+        fprintf(stderr, "error: link times are only reported for bin projects\n");
+        free(output);
+        return 1;
+    }
+
+    char dir[PATH_MAX];
+    if (record_dir(dir, sizeof(dir)) != 0) {
+        free(output);
+        return 1;
+    }
+
+    struct profiles *ps = config_get_profiles();
+    struct strbuf table = { 0 };
+    int res = 0;
+
+    // the builds print as they go so the table waits
+    strbuf_appendf(&table, "%-12s %-8s %-12s %12s %14s\n", "profile", "linker", "split-dwarf",
+                   "link (ms)", "size (bytes)");
+
+    for (int i = 0; i < ps->count; i++) {
+        struct profile *p = &ps->profiles[i];
+
+        config_apply_cc(p);
+        build_clean();
+        if (dependency_update_all(p, 1) != 0 || build_project(p) != 0) {
+            fprintf(stderr, "error: %s build failed\n", p->name);
+            res = 1;
+            break;
+        }
+
+        // removing the binary makes the build relink without
+        // compiling anything
+        double samples[LINK_RUNS];
+        int n = 0;
+        for (int run = 0; run < LINK_RUNS; run++) {
+            unlink(output);
+            if (reset_dir(dir) != 0 || wrapped_build(p, dir) != 0) {
+                res = 1;
+                break;
+            }
+            double us = link_us(dir);
+            if (us >= 0) {
+                samples[n++] = us;
+            }
+        }
+        if (res != 0) {
+            break;
+        }
+
+        struct stat s;
+        off_t size = stat(output, &s) == 0 ? s.st_size : 0;
+        const char *linker = toolchain_linker(p);
+
+        strbuf_appendf(&table, "%-12s %-8s %-12s ", p->name,
+                       linker[0] != '\0' ? linker : "default", p->split_dwarf ? "yes" : "no");
+        if (n > 0) {
+            qsort(samples, n, sizeof(double), cmp_double);
+            strbuf_appendf(&table, "%12.1f", samples[n / 2] / 1000.0);
+        } else {
+            // compiled and linked in one step
+            strbuf_appendf(&table, "%12s", "-");
+        }
+        strbuf_appendf(&table, " %14lld\n", (long long)size);
+    }
+
+    // leave a build of the configured profile behind
+    const struct profile *profile = config_get_profile();
+    config_apply_cc(profile);
+    build_clean();
+    if (res == 0) {
+        res = dependency_update_all(profile, 1) != 0 || build_project(profile) != 0;
+    }
+    if (res == 0) {
+        printf("\n%s", table.buf);
+    }
+    strbuf_free(&table);
+    free(output);
+
+    return res;
+}
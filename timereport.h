@@ -0,0 +1,67 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TIMEREPORT_H
+#define _TIMEREPORT_H
+
+#include "config.h"
+
+/**
+ * TIMEREPORT_WRAP_CMD is the hidden command flotsam runs as in place of the
+ * compiler while collecting a time report.
+ */
+#define TIMEREPORT_WRAP_CMD "__cc"
+
+/**
+ * timereport_build does a full build of the project with every compiler
+ * invocation timed. Translation units are compiled with -ftime-trace on clang
+ * and -ftime-report -H on gcc. The per TU results are aggregated into a
+ * report of the slowest TUs and the most expensive headers by total
+ * inclusion time along with the dependency they come from. The report is
+ * printed and saved to .flotsam/time-report.json.
+ */
+int
+timereport_build(const struct profile *profile);
+
+/**
+ * timereport_links builds the project with every profile and times
+ * relinking the binary, without recompiling, through the same compiler
+ * wrapper. The median link time, linker and binary size of each profile are
+ * printed so linker and debug info settings can be compared.
+ */
+int
+timereport_links();
+
+/**
+ * timereport_wrap runs the compiler given in argv[0] with the remaining
+ * arguments, times it and records the result for timereport_build. It
+ * returns the compiler's exit status.
+ */
+int
+timereport_wrap(int argc, char **argv);
+
+#endif /* _TIMEREPORT_H */
@@ -0,0 +1,649 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/utsname.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "toolchain.h"
+#include "util.h"
+
+#define DEFAULT_CC     "cc"
+#define INCLUDES_START "#include <...> search starts here:"
+#define INCLUDES_END   "End of search list."
+#define PROBE_MAIN     "int main(void) { return 0; }\n"
+
+// CACHE_VERSION changes whenever the probes do so older
+// caches are reprobed instead of missing facts
+#define CACHE_VERSION 3
+
+#ifdef __APPLE__
+#define MTIME_NSEC(s) ((s).st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(s) ((s).st_mtim.tv_nsec)
+#endif
+
+// probe_flags are the flags flotsam may add to builds
+// and needs to know the compiler accepts.
+static const char *probe_flags[] = {
+    "-march=native",
+    "-flto",
+    "-ffunction-sections",
+    "-fdata-sections",
+    "-fvisibility=hidden",
+    "-fno-semantic-interposition",
+    "-gsplit-dwarf",
+    "-ftime-trace",
+    "-ftime-report",
+    "-fno-omit-frame-pointer",
+    "-mno-omit-leaf-frame-pointer",
+    "-march=x86-64-v2",
+    "-march=x86-64-v3",
+    "-march=x86-64-v4",
+};
+
+// probe_linkers are the linkers a profile can select.
+static const char *probe_linkers[] = { "mold", "lld", "gold", "bfd" };
+
+static struct toolchain *toolchain = NULL;
+static struct strbuf make_args = { 0 };
+
+int
+toolchain_resolve(const char *cc, char *path, size_t len)
+{
+    char name[PATH_MAX];
+    snprintf(name, sizeof(name), "%.*s", (int)strcspn(cc, " \t"), cc);
+
+    char candidate[PATH_MAX];
+    if (strchr(name, '/') != NULL) {
+        snprintf(candidate, sizeof(candidate), "%s", name);
+    } else {
+        const char *env_path = getenv("PATH");
+        if (env_path == NULL) {
+            return -1;
+        }
+
+        candidate[0] = '\0';
+        for (const char *p = env_path; *p != '\0';) {
+            size_t n = strcspn(p, ":");
+            int written = snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)n, p, name);
+            if (written < (int)sizeof(candidate) && access(candidate, X_OK) == 0) {
+                break;
+            }
+            candidate[0] = '\0';
+            p += n + (p[n] == ':');
+        }
+    }
+
+    char real[PATH_MAX];
+    if (candidate[0] == '\0' || realpath(candidate, real) == NULL) {
+        return -1;
+    }
+    snprintf(path, len, "%s", real);
+
+    return 0;
+}
+
+/**
+ * resolve_cc stores the real path of the compiler named
+ * by $CC, or cc, in path.
+ */
+static int
+resolve_cc(char *path, size_t len)
+{
+    const char *cc = getenv("CC");
+    if (cc == NULL || cc[0] == '\0') {
+        cc = DEFAULT_CC;
+    }
+    return toolchain_resolve(cc, path, len);
+}
+
+uint64_t
+toolchain_id()
+{
+    char path[PATH_MAX];
+    struct stat s;
+    if (resolve_cc(path, sizeof(path)) != 0 || stat(path, &s) != 0) {
+        return 0;
+    }
+
+    int64_t mtime_sec = (int64_t)s.st_mtime;
+    int64_t mtime_nsec = (int64_t)MTIME_NSEC(s);
+    uint64_t ino = (uint64_t)s.st_ino;
+
+    uint64_t h = hash_str(HASH_SEED, path);
+    h = hash_bytes(h, &ino, sizeof(ino));
+    h = hash_bytes(h, &mtime_sec, sizeof(mtime_sec));
+    h = hash_bytes(h, &mtime_nsec, sizeof(mtime_nsec));
+
+    return h;
+}
+
+/**
+ * capture runs the given shell command and returns what
+ * it wrote to stdout, or NULL if it failed.
+ */
+static char*
+capture(const char *cmd)
+{
+    FILE *p = popen(cmd, "r");
+    if (p == NULL) {
+        return NULL;
+    }
+
+    struct strbuf sb = { 0 };
+    char line[1024];
+    while (fgets(line, sizeof(line), p) != NULL) {
+        strbuf_append(&sb, line);
+    }
+    if (pclose(p) != 0) {
+        strbuf_free(&sb);
+        return NULL;
+    }
+
+    return sb.buf;
+}
+
+/**
+ * first_line returns a copy of the first line of s.
+ */
+static char*
+first_line(const char *s)
+{
+    if (s == NULL) {
+        return strdup("");
+    }
+    return strndup(s, strcspn(s, "\n"));
+}
+
+/**
+ * probe_includes returns the compiler's default include
+ * search path separated by colons.
+ */
+static char*
+probe_includes(const char *cc)
+{
+    struct strbuf cmd = { 0 };
+    strbuf_appendf(&cmd, "'%s' -E -Wp,-v -xc /dev/null 2>&1 >/dev/null", cc);
+    char *out = capture(cmd.buf);
+    strbuf_free(&cmd);
+
+    struct strbuf sb = { 0 };
+    strbuf_append(&sb, "");
+    if (out == NULL) {
+        return sb.buf;
+    }
+
+    int in_list = 0;
+    for (char *line = strtok(out, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        if (strcmp(line, INCLUDES_START) == 0) {
+            in_list = 1;
+            continue;
+        }
+        if (strcmp(line, INCLUDES_END) == 0) {
+            break;
+        }
+        if (in_list && line[0] == ' ') {
+            // clang marks framework directories
+            char *marker = strstr(line, " (framework directory)");
+            if (marker != NULL) {
+                *marker = '\0';
+            }
+            strbuf_appendf(&sb, "%s%s", sb.len > 0 ? ":" : "", line + 1);
+        }
+    }
+    free(out);
+
+    return sb.buf;
+}
+
+/**
+ * probe_flag returns 1 if the compiler accepts the flag
+ * when compiling an empty file. The object goes to a
+ * real file since flags like -gsplit-dwarf write next
+ * to it.
+ */
+static int
+probe_flag(const char *cc, const char *flag)
+{
+    char obj[PATH_MAX], dwo[PATH_MAX];
+    const char *tmp = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    snprintf(obj, sizeof(obj), "%s/flotsam-probe-%d.o", tmp, (int)getpid());
+    snprintf(dwo, sizeof(dwo), "%s/flotsam-probe-%d.dwo", tmp, (int)getpid());
+
+    char *const argv[] = {
+        (char *)cc, "-Werror", (char *)flag, "-xc", "-c", "/dev/null", "-o", obj, NULL
+    };
+    uint64_t ns;
+    int res = run_timed(argv, &ns) == 0;
+
+    unlink(obj);
+    unlink(dwo);
+
+    return res;
+}
+
+/**
+ * linker_name maps the output of the linker's --version
+ * to the name -fuse-ld takes.
+ */
+static const char*
+linker_name(const char *version)
+{
+    if (version == NULL) {
+        return "";
+    }
+    if (strstr(version, "mold") != NULL) {
+        return "mold";
+    }
+    if (strstr(version, "LLD") != NULL) {
+        return "lld";
+    }
+    if (strstr(version, "GNU gold") != NULL) {
+        return "gold";
+    }
+    if (strstr(version, "GNU ld") != NULL) {
+        return "bfd";
+    }
+    return "";
+}
+
+/**
+ * probe_linker_support links an empty program with every known
+ * linker and records the ones that work along with the
+ * compiler's default.
+ */
+static int
+probe_linker_support(struct toolchain *tc)
+{
+    char src[PATH_MAX], exe[PATH_MAX];
+    const char *tmp = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    snprintf(src, sizeof(src), "%s/flotsam-probe-%d.c", tmp, (int)getpid());
+    snprintf(exe, sizeof(exe), "%s/flotsam-probe-%d", tmp, (int)getpid());
+
+    FILE *fd = fopen(src, "w");
+    if (fd == NULL) {
+        perror(src);
+        return -1;
+    }
+    fputs(PROBE_MAIN, fd);
+    fclose(fd);
+
+    struct strbuf linkers = { 0 };
+    strbuf_append(&linkers, "");
+    for (size_t i = 0; i < sizeof(probe_linkers) / sizeof(probe_linkers[0]); i++) {
+        char fuse[32];
+        snprintf(fuse, sizeof(fuse), "-fuse-ld=%s", probe_linkers[i]);
+
+        char *const argv[] = { tc->cc, fuse, src, "-o", exe, NULL };
+        uint64_t ns;
+        if (run_timed(argv, &ns) == 0) {
+            strbuf_appendf(&linkers, "%s%s", linkers.len > 0 ? " " : "", probe_linkers[i]);
+        }
+    }
+    tc->linkers = linkers.buf;
+
+    struct strbuf cmd = { 0 };
+    strbuf_appendf(&cmd, "'%s' -Wl,--version '%s' -o '%s' 2>/dev/null", tc->cc, src, exe);
+    char *out = capture(cmd.buf);
+    strbuf_free(&cmd);
+    tc->default_linker = strdup(linker_name(out));
+    free(out);
+
+    unlink(src);
+    unlink(exe);
+
+    return 0;
+}
+
+/**
+ * probe fills in the toolchain from the compiler itself.
+ */
+static int
+probe(struct toolchain *tc)
+{
+    struct strbuf cmd = { 0 };
+
+    strbuf_appendf(&cmd, "'%s' --version 2>/dev/null", tc->cc);
+    char *out = capture(cmd.buf);
+    strbuf_free(&cmd);
+    if (out == NULL) {
+        fprintf(stderr, "error: unable to run %s\n", tc->cc);
+        return -1;
+    }
+    tc->version = first_line(out);
+    free(out);
+
+    strbuf_appendf(&cmd, "'%s' -dumpmachine 2>/dev/null", tc->cc);
+    out = capture(cmd.buf);
+    strbuf_free(&cmd);
+    tc->target = first_line(out);
+    free(out);
+
+    tc->includes = probe_includes(tc->cc);
+
+    struct strbuf flags = { 0 };
+    strbuf_append(&flags, "");
+    for (size_t i = 0; i < sizeof(probe_flags) / sizeof(probe_flags[0]); i++) {
+        if (probe_flag(tc->cc, probe_flags[i])) {
+            strbuf_appendf(&flags, "%s%s", flags.len > 0 ? " " : "", probe_flags[i]);
+        }
+    }
+    tc->flags = flags.buf;
+
+    return probe_linker_support(tc);
+}
+
+/**
+ * cache_path returns the cache file for the compiler
+ * with the given id.
+ */
+static char*
+cache_path(uint64_t id)
+{
+    struct strbuf sb = { 0 };
+    strbuf_appendf(&sb, "%s%s/%016" PRIx64 ".json", getenv("HOME"), TOOLCHAIN_CACHE_DIR, id);
+    return sb.buf;
+}
+
+/**
+ * cache_load fills in the toolchain from the cache file.
+ */
+static int
+cache_load(struct toolchain *tc, const char *path)
+{
+    json_error_t error;
+    json_t *root = json_load_file(path, 0, &error);
+    if (root == NULL) {
+        return -1;
+    }
+    if (json_integer_value(json_object_get(root, "cache_version")) != CACHE_VERSION) {
+        json_decref(root);
+        return -1;
+    }
+
+    const char *fields[] = {
+        "version", "target", "includes", "flags", "linkers", "default_linker"
+    };
+    char **values[] = {
+        &tc->version, &tc->target, &tc->includes, &tc->flags, &tc->linkers, &tc->default_linker
+    };
+    int res = 0;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        const char *v = json_string_value(json_object_get(root, fields[i]));
+        if (v == NULL) {
+            res = -1;
+            break;
+        }
+        *values[i] = strdup(v);
+    }
+    json_decref(root);
+
+    return res;
+}
+
+/**
+ * cache_save writes the probed facts to the cache file.
+ */
+static void
+cache_save(const struct toolchain *tc, const char *path)
+{
+    struct strbuf dir = { 0 };
+    strbuf_appendf(&dir, "%s%s", getenv("HOME"), TOOLCHAIN_CACHE_DIR);
+    mkdir_p(dir.buf, 0700);
+    strbuf_free(&dir);
+
+    json_t *root = json_pack("{s:i, s:s, s:s, s:s, s:s, s:s, s:s, s:s}",
+                             "cache_version", CACHE_VERSION, "cc", tc->cc,
+                             "version", tc->version, "target", tc->target,
+                             "includes", tc->includes, "flags", tc->flags,
+                             "linkers", tc->linkers, "default_linker", tc->default_linker);
+    if (root == NULL) {
+        return;
+    }
+    json_dump_file(root, path, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    json_decref(root);
+}
+
+/**
+ * toolchain_free frees a partially or fully populated
+ * toolchain.
+ */
+static void
+toolchain_free(struct toolchain *tc)
+{
+    free(tc->cc);
+    free(tc->version);
+    free(tc->target);
+    free(tc->includes);
+    free(tc->flags);
+    free(tc->linkers);
+    free(tc->default_linker);
+    free(tc->sysname);
+    free(tc->machine);
+    free(tc);
+}
+
+const struct toolchain*
+toolchain_get()
+{
+    if (toolchain != NULL) {
+        return toolchain;
+    }
+
+    char cc[PATH_MAX];
+    uint64_t id = toolchain_id();
+    if (id == 0 || resolve_cc(cc, sizeof(cc)) != 0) {
+        fprintf(stderr, "error: unable to find the compiler\n");
+        return NULL;
+    }
+
+    struct toolchain *tc = calloc(1, sizeof(struct toolchain));
+    if (tc == NULL) {
+        perror("unable to allocate memory for toolchain");
+        return NULL;
+    }
+    tc->cc = strdup(cc);
+
+    char *path = cache_path(id);
+    if (cache_load(tc, path) != 0) {
+        char *cc_path = tc->cc;
+        tc->cc = NULL;
+        toolchain_free(tc);
+
+        tc = calloc(1, sizeof(struct toolchain));
+        if (tc == NULL) {
+            perror("unable to allocate memory for toolchain");
+            free(cc_path);
+            free(path);
+            return NULL;
+        }
+        tc->cc = cc_path;
+
+        if (probe(tc) != 0) {
+            free(path);
+            toolchain_free(tc);
+            return NULL;
+        }
+        cache_save(tc, path);
+    }
+    free(path);
+
+    // uname is a syscall so it isn't worth caching
+    struct utsname u;
+    if (uname(&u) == 0) {
+        tc->sysname = strdup(u.sysname);
+        tc->machine = strdup(u.machine);
+    } else {
+        tc->sysname = strdup("");
+        tc->machine = strdup("");
+    }
+
+    // the artifact cache key leaves out the path and inode
+    // so reinstalling the same compiler keeps artifacts
+    tc->hash = hash_str(HASH_SEED, tc->version);
+    tc->hash = hash_str(tc->hash, tc->target);
+    tc->hash = hash_str(tc->hash, tc->sysname);
+    tc->hash = hash_str(tc->hash, tc->machine);
+
+    toolchain = tc;
+
+    return toolchain;
+}
+
+void
+toolchain_reset()
+{
+    if (toolchain != NULL) {
+        toolchain_free(toolchain);
+        toolchain = NULL;
+    }
+}
+
+/**
+ * has_word returns 1 if word is one of the space
+ * separated words in list.
+ */
+static int
+has_word(const char *list, const char *word)
+{
+    size_t len = strlen(word);
+    for (const char *p = list; (p = strstr(p, word)) != NULL; p += len) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+toolchain_supports(const char *flag)
+{
+    const struct toolchain *tc = toolchain_get();
+    return tc != NULL && has_word(tc->flags, flag);
+}
+
+int
+toolchain_has_linker(const char *name)
+{
+    const struct toolchain *tc = toolchain_get();
+    return tc != NULL && has_word(tc->linkers, name);
+}
+
+const char*
+toolchain_linker(const struct profile *profile)
+{
+    static int warned = 0;
+
+    const struct toolchain *tc = toolchain_get();
+    if (tc == NULL) {
+        return "";
+    }
+    if (profile == NULL || profile->linker == NULL) {
+        return tc->default_linker;
+    }
+    if (toolchain_has_linker(profile->linker)) {
+        return profile->linker;
+    }
+
+    if (!warned) {
+        fprintf(stderr, "warning: linker %s isn't available, using the default linker\n",
+                profile->linker);
+        warned = 1;
+    }
+
+    return tc->default_linker;
+}
+
+void
+toolchain_profile_flags(const struct profile *profile, struct strbuf *cflags,
+                        struct strbuf *ldflags)
+{
+    if (profile == NULL) {
+        return;
+    }
+
+    const char *linker = toolchain_linker(profile);
+    if (profile->linker != NULL && strcmp(linker, profile->linker) == 0) {
+        strbuf_appendf(ldflags, " -fuse-ld=%s", linker);
+    }
+
+    // split debug info keeps DWARF out of the link and the
+    // index keeps gdb fast, bfd just can't build one
+    if (profile->split_dwarf && toolchain_supports("-gsplit-dwarf")) {
+        strbuf_append(cflags, " -gsplit-dwarf");
+        if (linker[0] != '\0' && strcmp(linker, "bfd") != 0) {
+            strbuf_append(ldflags, " -Wl,--gdb-index");
+        }
+    }
+}
+
+void
+toolchain_export()
+{
+    const struct toolchain *tc = toolchain_get();
+    if (tc == NULL) {
+        return;
+    }
+
+    setenv("FLOTSAM_CC", tc->cc, 1);
+    setenv("FLOTSAM_CC_VERSION", tc->version, 1);
+    setenv("FLOTSAM_CC_TARGET", tc->target, 1);
+    setenv("FLOTSAM_CC_INCLUDES", tc->includes, 1);
+    setenv("FLOTSAM_CC_FLAGS", tc->flags, 1);
+}
+
+const char*
+toolchain_make_args()
+{
+    if (make_args.buf != NULL) {
+        return make_args.buf;
+    }
+
+    const struct toolchain *tc = toolchain_get();
+    if (tc == NULL || tc->sysname[0] == '\0') {
+        return "";
+    }
+    strbuf_appendf(&make_args, "UNAME_S=%s UNAME_M=%s", tc->sysname, tc->machine);
+
+    return make_args.buf;
+}
@@ -0,0 +1,138 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TOOLCHAIN_H
+#define _TOOLCHAIN_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "util.h"
+
+#define TOOLCHAIN_CACHE_DIR "/.flotsam/toolchain"
+
+/**
+ * toolchain holds the facts probed from a compiler and
+ * the host it runs on.
+ */
+struct toolchain
+{
+    char *cc;
+    char *version;
+    char *target;
+    char *includes;
+    char *flags;
+    char *linkers;
+    char *default_linker;
+    char *sysname;
+    char *machine;
+    uint64_t hash;
+};
+
+/**
+ * toolchain_resolve stores the real path of the compiler command cc in path,
+ * looking it up in $PATH if needed. Only the first word of cc is used so
+ * launchers like ccache resolve to themselves. It returns -1 if the compiler
+ * can't be found.
+ */
+int
+toolchain_resolve(const char *cc, char *path, size_t len);
+
+/**
+ * toolchain_id returns an identifier of the compiler named by $CC, or cc,
+ * made from its resolved path, inode and modification time. It only stats
+ * the binary so it's cheap enough for the no-op build check. It returns 0 if
+ * the compiler can't be found.
+ */
+uint64_t
+toolchain_id();
+
+/**
+ * toolchain_get returns the facts of the current compiler. They're probed
+ * once per compiler binary and cached in ~/.flotsam/toolchain under its
+ * toolchain_id so replacing the compiler invalidates them. It returns NULL
+ * if the compiler can't be found or probed.
+ */
+const struct toolchain*
+toolchain_get();
+
+/**
+ * toolchain_reset drops the facts returned by toolchain_get so the next call
+ * probes the compiler named by $CC again. It's called whenever CC changes.
+ */
+void
+toolchain_reset();
+
+/**
+ * toolchain_supports returns 1 if the compiler accepts the given flag. Only
+ * the flags flotsam itself uses are probed.
+ */
+int
+toolchain_supports(const char *flag);
+
+/**
+ * toolchain_has_linker returns 1 if the compiler can link with the named
+ * linker through -fuse-ld.
+ */
+int
+toolchain_has_linker(const char *name);
+
+/**
+ * toolchain_linker returns the linker the profile links with: its own if
+ * available, the compiler's default otherwise. A missing linker is warned
+ * about once. The result may be an empty string if the default linker isn't
+ * recognized.
+ */
+const char*
+toolchain_linker(const struct profile *profile);
+
+/**
+ * toolchain_profile_flags appends the flags selecting the profile's linker
+ * and split debug info to cflags and ldflags. Flags the toolchain doesn't
+ * support are left out so the build falls back to the defaults.
+ */
+void
+toolchain_profile_flags(const struct profile *profile, struct strbuf *cflags,
+                        struct strbuf *ldflags);
+
+/**
+ * toolchain_export sets FLOTSAM_CC, FLOTSAM_CC_VERSION, FLOTSAM_CC_TARGET,
+ * FLOTSAM_CC_INCLUDES and FLOTSAM_CC_FLAGS in the environment so every build
+ * flotsam spawns sees them.
+ */
+void
+toolchain_export();
+
+/**
+ * toolchain_make_args returns variable overrides for the make command line,
+ * UNAME_S and UNAME_M, so Makefiles don't have to shell out for them. The
+ * returned string is owned by the toolchain.
+ */
+const char*
+toolchain_make_args();
+
+#endif /* _TOOLCHAIN_H */
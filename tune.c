@@ -0,0 +1,599 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "bench.h"
+#include "build.h"
+#include "config.h"
+#include "stats.h"
+#include "toolchain.h"
+#include "tune.h"
+#include "util.h"
+
+#define CONFIG_FILE     "Flotsam.json"
+#define CANDIDATE_BASE  "current"
+#define DEFAULT_CC      "cc"
+
+// skip_entries aren't copied into candidate trees.
+static const char *skip_entries[] = { ".git", ".flotsam", "bin" };
+
+// default matrix the candidates are built from for each
+// compiler when "candidates" isn't given.
+static const char *opt_levels[] = { "-O2", "-O3" };
+static const char *march_levels[] = { "", "-march=native" };
+
+/**
+ * candidate is a profile under test along with what
+ * was measured for it.
+ */
+struct candidate
+{
+    char *name;
+    json_t *profile;
+    char dir[PATH_MAX];
+    const char *status;
+    uint64_t build_ns;
+    off_t size;
+    double *samples;
+    struct stats stats;
+    double p;
+    double p_adjusted;
+};
+
+/**
+ * candidates is a growable list of candidates.
+ */
+struct candidates
+{
+    int count;
+    struct candidate *items;
+};
+
+/**
+ * candidate_add appends a candidate for the given
+ * profile, taking ownership of it.
+ */
+static int
+candidate_add(struct candidates *cs, const char *name, json_t *profile)
+{
+    struct candidate *items = realloc(cs->items, (cs->count + 1) * sizeof(struct candidate));
+    if (items == NULL) {
+        perror("unable to allocate memory for candidates");
+        json_decref(profile);
+        return -1;
+    }
+    cs->items = items;
+
+    struct candidate *c = &cs->items[cs->count++];
+    memset(c, 0, sizeof(struct candidate));
+    c->name = strdup(name);
+    c->profile = profile;
+    c->status = "ok";
+    snprintf(c->dir, sizeof(c->dir), "%s/%s", TUNE_DIR, name);
+
+    return 0;
+}
+
+/**
+ * candidates_free frees the list.
+ */
+static void
+candidates_free(struct candidates *cs)
+{
+    for (int i = 0; i < cs->count; i++) {
+        free(cs->items[i].name);
+        free(cs->items[i].samples);
+        json_decref(cs->items[i].profile);
+    }
+    free(cs->items);
+}
+
+/**
+ * profile_json converts a loaded profile to its
+ * Flotsam.json form.
+ */
+static json_t*
+profile_json(const struct profile *p, const char *cc)
+{
+    json_t *obj = json_object();
+    json_object_set_new(obj, "cflags", json_string(p != NULL ? p->cflags : ""));
+    json_object_set_new(obj, "ldflags", json_string(p != NULL ? p->ldflags : ""));
+    if (p != NULL && p->linker != NULL) {
+        json_object_set_new(obj, "linker", json_string(p->linker));
+    }
+    if (p != NULL && p->split_dwarf) {
+        json_object_set_new(obj, "split_dwarf", json_true());
+    }
+    json_object_set_new(obj, "cc", json_string(cc));
+
+    return obj;
+}
+
+/**
+ * add_matrix adds the default candidates for each of
+ * the given compilers.
+ */
+static int
+add_matrix(struct candidates *cs, json_t *compilers)
+{
+    size_t i;
+    json_t *value;
+    json_array_foreach(compilers, i, value) {
+        const char *cc = json_string_value(value);
+        char path[PATH_MAX];
+        if (cc == NULL || toolchain_resolve(cc, path, sizeof(path)) != 0) {
+            fprintf(stderr, "warning: compiler %s not found, skipping it\n",
+                    cc != NULL ? cc : "(invalid)");
+            continue;
+        }
+
+        char base[PATH_MAX];
+        snprintf(base, sizeof(base), "%s", cc);
+        const char *cc_name = basename(base);
+
+        for (size_t o = 0; o < sizeof(opt_levels) / sizeof(opt_levels[0]); o++) {
+            for (size_t m = 0; m < sizeof(march_levels) / sizeof(march_levels[0]); m++) {
+                for (int lto = 0; lto < 2; lto++) {
+                    struct strbuf name = { 0 };
+                    struct strbuf cflags = { 0 };
+
+                    strbuf_appendf(&name, "%s%s%s%s", cc_name, opt_levels[o],
+                                   march_levels[m][0] != '\0' ? "-native" : "",
+                                   lto ? "-lto" : "");
+                    strbuf_appendf(&cflags, "%s %s%s-DNDEBUG%s", opt_levels[o], march_levels[m],
+                                   march_levels[m][0] != '\0' ? " " : "", lto ? " -flto" : "");
+
+                    json_t *p = json_pack("{s:s, s:s, s:s}", "cflags", cflags.buf,
+                                          "ldflags", lto ? "-flto" : "", "cc", cc);
+                    int res = candidate_add(cs, name.buf, p);
+                    strbuf_free(&name);
+                    strbuf_free(&cflags);
+                    if (res != 0) {
+                        return -1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * prepare_tree creates the candidate's copy of the
+ * project with the candidate as its default profile.
+ */
+static int
+prepare_tree(struct candidate *c)
+{
+    size_t skip_count = sizeof(skip_entries) / sizeof(skip_entries[0]);
+    if (remove_tree(c->dir) != 0 || copy_tree(".", c->dir, skip_entries, skip_count) != 0) {
+        fprintf(stderr, "error: unable to copy the project to %s\n", c->dir);
+        return -1;
+    }
+
+    json_error_t error;
+    json_t *root = json_load_file(CONFIG_FILE, JSON_PRESERVE_ORDER, &error);
+    if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", CONFIG_FILE, error.line, error.text);
+        return -1;
+    }
+
+    json_t *profiles = json_object_get(root, "profiles");
+    if (!json_is_object(profiles)) {
+        profiles = json_object();
+        json_object_set_new(root, "profiles", profiles);
+    }
+    json_object_set(profiles, c->name, c->profile);
+    json_object_set_new(json_object_get(root, "package"), "profile", json_string(c->name));
+
+    struct strbuf path = { 0 };
+    strbuf_appendf(&path, "%s/%s", c->dir, CONFIG_FILE);
+    int res = json_dump_file(root, path.buf, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    strbuf_free(&path);
+    json_decref(root);
+
+    return res;
+}
+
+/**
+ * spawn starts flotsam with the given command in the
+ * candidate's tree with its output appended to a log.
+ */
+static pid_t
+spawn(const struct candidate *c, char *const argv[])
+{
+    struct strbuf log = { 0 };
+    strbuf_appendf(&log, "%s.log", c->dir);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int fd = open(log.buf, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (chdir(c->dir) != 0) {
+            _exit(127);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    strbuf_free(&log);
+
+    return pid;
+}
+
+/**
+ * run_all runs flotsam with the given command and option
+ * in every candidate tree that hasn't failed, at most
+ * jobs at a time, recording how long each took when
+ * timed is set.
+ */
+static void
+run_all(struct candidates *cs, const char *command, const char *option, const char *failure,
+        int jobs, int timed)
+{
+    char self[PATH_MAX];
+    self_path(self, sizeof(self));
+    char *const argv[] = { self, (char *)command, (char *)option, NULL };
+
+    pid_t *pids = calloc(cs->count, sizeof(pid_t));
+    uint64_t *starts = calloc(cs->count, sizeof(uint64_t));
+    if (pids == NULL || starts == NULL) {
+        perror("unable to allocate memory for jobs");
+        free(pids);
+        free(starts);
+        return;
+    }
+
+    int next = 0, running = 0;
+    while (next < cs->count || running > 0) {
+        while (running < jobs && next < cs->count) {
+            struct candidate *c = &cs->items[next++];
+            if (strcmp(c->status, "ok") != 0) {
+                continue;
+            }
+            starts[c - cs->items] = now_ns();
+            pids[c - cs->items] = spawn(c, argv);
+            if (pids[c - cs->items] < 0) {
+                c->status = failure;
+                continue;
+            }
+            running++;
+        }
+        if (running == 0) {
+            break;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            break;
+        }
+        for (int i = 0; i < cs->count; i++) {
+            if (pids[i] != pid) {
+                continue;
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                cs->items[i].status = failure;
+            } else if (timed) {
+                cs->items[i].build_ns = now_ns() - starts[i];
+            }
+            pids[i] = 0;
+            running--;
+        }
+    }
+
+    free(pids);
+    free(starts);
+}
+
+/**
+ * save_results writes every candidate's results.
+ */
+static void
+save_results(const struct candidates *cs, const char *bench_cmd)
+{
+    json_t *root = json_object();
+    json_t *arr = json_array();
+    json_object_set_new(root, "bench", json_string(bench_cmd));
+    json_object_set_new(root, "candidates", arr);
+
+    for (int i = 0; i < cs->count; i++) {
+        const struct candidate *c = &cs->items[i];
+        json_t *samples = json_array();
+        for (int j = 0; c->samples != NULL && j < c->stats.n; j++) {
+            json_array_append_new(samples, json_real(c->samples[j]));
+        }
+        json_t *obj = json_pack("{s:s, s:O, s:s, s:f, s:I, s:f, s:f, s:f, s:f, s:f, s:f, s:o}",
+                                "name", c->name, "profile", c->profile, "status", c->status,
+                                "build_ms", (double)c->build_ns / 1e6, "size", (json_int_t)c->size,
+                                "median_ms", c->stats.median, "mad_ms", c->stats.mad,
+                                "ci_low_ms", c->stats.ci_low, "ci_high_ms", c->stats.ci_high,
+                                "p_value", c->p, "p_adjusted", c->p_adjusted, "samples", samples);
+        json_array_append_new(arr, obj);
+    }
+
+    json_dump_file(root, TUNE_RESULTS, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    json_decref(root);
+}
+
+/**
+ * save_winner stores the winning profile in Flotsam.json
+ * and makes it the default.
+ */
+static int
+save_winner(const struct candidate *c)
+{
+    json_error_t error;
+    json_t *root = json_load_file(CONFIG_FILE, JSON_PRESERVE_ORDER, &error);
+    if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", CONFIG_FILE, error.line, error.text);
+        return -1;
+    }
+
+    json_t *profiles = json_object_get(root, "profiles");
+    if (!json_is_object(profiles)) {
+        profiles = json_object();
+        json_object_set_new(root, "profiles", profiles);
+    }
+    json_object_set(profiles, TUNE_PROFILE, c->profile);
+    json_object_set_new(json_object_get(root, "package"), "profile", json_string(TUNE_PROFILE));
+
+    int res = json_dump_file(root, CONFIG_FILE, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    json_decref(root);
+
+    return res;
+}
+
+/**
+ * load_candidates fills in the candidates from the tune
+ * section, the current profile always being first.
+ */
+static int
+load_candidates(json_t *tune, const struct profile *current, struct candidates *cs)
+{
+    const char *cc = getenv("CC") != NULL ? getenv("CC") : DEFAULT_CC;
+    if (candidate_add(cs, CANDIDATE_BASE, profile_json(current, cc)) != 0) {
+        return -1;
+    }
+
+    json_t *given = json_object_get(tune, "candidates");
+    if (json_is_object(given)) {
+        const char *key;
+        json_t *value;
+        json_object_foreach(given, key, value) {
+            if (!json_is_object(value) || strcmp(key, CANDIDATE_BASE) == 0) {
+                fprintf(stderr, "error: invalid tune candidate %s\n", key);
+                return -1;
+            }
+            if (candidate_add(cs, key, json_deep_copy(value)) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    json_t *compilers = json_object_get(tune, "compilers");
+    if (compilers == NULL) {
+        compilers = json_pack("[s]", cc);
+    } else {
+        json_incref(compilers);
+    }
+    int res = add_matrix(cs, compilers);
+    json_decref(compilers);
+
+    return res;
+}
+
+int
+tune_run(const struct profile *current)
+{
+    json_error_t error;
+    json_t *root = json_load_file(CONFIG_FILE, 0, &error);
+    if (root == NULL) {
+        fprintf(stderr, "error: %s:%d: %s\n", CONFIG_FILE, error.line, error.text);
+        return 1;
+    }
+
+    json_t *tune = json_object_get(root, "tune");
+    const char *bench_cmd = json_string_value(json_object_get(tune, "bench"));
+    if (bench_cmd == NULL) {
+        fprintf(stderr, "error: tune needs a \"bench\" command in the \"tune\" section\n");
+        json_decref(root);
+        return 1;
+    }
+
+    json_t *runs_val = json_object_get(tune, "runs");
+    json_t *warmup_val = json_object_get(tune, "warmup");
+    int runs = json_is_integer(runs_val) ? (int)json_integer_value(runs_val) : BENCH_DEFAULT_RUNS;
+    int warmup = json_is_integer(warmup_val) ? (int)json_integer_value(warmup_val)
+                                             : BENCH_DEFAULT_WARMUP;
+
+    struct candidates cs = { 0 };
+    if (load_candidates(tune, current, &cs) != 0 || mkdir_p(TUNE_DIR, 0700) != 0) {
+        candidates_free(&cs);
+        json_decref(root);
+        return 1;
+    }
+
+    char *output = build_output();
+    int res = 1;
+
+    printf("tuning %d candidates\n", cs.count);
+    for (int i = 0; i < cs.count; i++) {
+        struct strbuf log = { 0 };
+        strbuf_appendf(&log, "%s.log", cs.items[i].dir);
+        unlink(log.buf);
+        strbuf_free(&log);
+        if (prepare_tree(&cs.items[i]) != 0) {
+            cs.items[i].status = "copy failed";
+        }
+    }
+
+    // the copies may come with objects of the project's
+    // own build. Dependencies share a checkout so they're
+    // built one candidate at a time, the project builds in
+    // parallel.
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = jobs > 0 ? jobs : 1;
+    run_all(&cs, "clean", NULL, "clean failed", (int)jobs, 0);
+    run_all(&cs, "update", "--missing", "dependency build failed", 1, 0);
+    run_all(&cs, "build", "--force", "build failed", (int)jobs, 1);
+
+    struct bench_cmd *cmds = calloc(cs.count, sizeof(struct bench_cmd));
+    double **samples = calloc(cs.count, sizeof(double*));
+    if (cmds == NULL || samples == NULL) {
+        perror("unable to allocate memory for benchmarks");
+        goto out;
+    }
+    for (int i = 0; i < cs.count; i++) {
+        struct candidate *c = &cs.items[i];
+        struct strbuf bin = { 0 };
+        strbuf_appendf(&bin, "%s/%s", c->dir, output);
+
+        struct stat s;
+        c->size = output[0] != '\0' && stat(bin.buf, &s) == 0 ? s.st_size : 0;
+        strbuf_free(&bin);
+        c->samples = calloc(runs, sizeof(double));
+        samples[i] = c->samples;
+        cmds[i].dir = c->dir;
+        cmds[i].cmd = bench_cmd;
+        cmds[i].failed = strcmp(c->status, "ok") != 0;
+    }
+
+    printf("benchmarking: %s (%d runs each)\n", bench_cmd, runs);
+    if (bench_commands(cmds, cs.count, warmup, runs, samples) != 0) {
+        fprintf(stderr, "error: no candidate could be benchmarked, see %s/*.log\n", TUNE_DIR);
+        goto out;
+    }
+
+    struct candidate *base = &cs.items[0];
+    double *ps = calloc(cs.count, sizeof(double));
+    double *adjusted = calloc(cs.count, sizeof(double));
+    if (ps == NULL || adjusted == NULL) {
+        perror("unable to allocate memory for p-values");
+        free(ps);
+        free(adjusted);
+        goto out;
+    }
+    int m = 0;
+    for (int i = 0; i < cs.count; i++) {
+        struct candidate *c = &cs.items[i];
+        c->p = c->p_adjusted = 1.0;
+        if (cmds[i].failed) {
+            if (strcmp(c->status, "ok") == 0) {
+                c->status = "benchmark failed";
+            }
+            continue;
+        }
+        stats_compute(c->samples, runs, &c->stats);
+        if (i > 0 && !cmds[0].failed) {
+            c->p = stats_mann_whitney(c->samples, runs, base->samples, runs);
+            ps[m++] = c->p;
+        }
+    }
+
+    // every candidate is compared with the base, so the
+    // p-values are adjusted for the number of comparisons
+    // or one of many would win by chance
+    stats_holm(ps, m, adjusted);
+    int winner = -1;
+    for (int i = 1, k = 0; i < cs.count && !cmds[0].failed; i++) {
+        struct candidate *c = &cs.items[i];
+        if (cmds[i].failed) {
+            continue;
+        }
+        c->p_adjusted = adjusted[k++];
+        if (c->p_adjusted < STATS_ALPHA && c->stats.median < base->stats.median &&
+            (winner < 0 || c->stats.median < cs.items[winner].stats.median)) {
+            winner = i;
+        }
+    }
+    free(ps);
+    free(adjusted);
+
+    printf("\n%-24s %10s %12s %12s %10s %21s %8s %8s\n", "candidate", "build (s)",
+           "size (bytes)", "median (ms)", "MAD (ms)", "95% CI (ms)", "p", "p (Holm)");
+    for (int i = 0; i < cs.count; i++) {
+        struct candidate *c = &cs.items[i];
+        if (strcmp(c->status, "ok") != 0) {
+            printf("%-24s %s\n", c->name, c->status);
+            continue;
+        }
+        printf("%-24s %10.2f %12lld %12.3f %10.3f %10.3f-%-10.3f %8.4f %8.4f%s\n", c->name,
+               (double)c->build_ns / 1e9, (long long)c->size, c->stats.median, c->stats.mad,
+               c->stats.ci_low, c->stats.ci_high, c->p, c->p_adjusted, i == winner ? " *" : "");
+    }
+
+    save_results(&cs, bench_cmd);
+    printf("\nresults: %s\n", TUNE_RESULTS);
+
+    if (winner < 0) {
+        printf("no candidate is significantly faster than the current profile\n");
+        res = 0;
+        goto out;
+    }
+
+    struct candidate *w = &cs.items[winner];
+    printf("%s is %.2fx faster than the current profile, saved as profile \"%s\"\n", w->name,
+           base->stats.median / w->stats.median, TUNE_PROFILE);
+    res = save_winner(w) != 0;
+
+out:
+    free(cmds);
+    free(samples);
+    free(output);
+    candidates_free(&cs);
+    json_decref(root);
+
+    return res;
+}
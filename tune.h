@@ -0,0 +1,51 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _TUNE_H
+#define _TUNE_H
+
+#include "config.h"
+
+#define TUNE_DIR     ".flotsam/tune"
+#define TUNE_RESULTS ".flotsam/tune/results.json"
+#define TUNE_PROFILE "tuned"
+
+/**
+ * tune_run builds the project under a set of candidate profiles, each in its
+ * own copy of the project under TUNE_DIR, and runs the benchmark command from
+ * the "tune" section of Flotsam.json against every candidate with the runs
+ * interleaved. The candidates come from "tune" "candidates" or, if not
+ * given, a matrix of -O2/-O3, -march=native and LTO for each compiler in
+ * "tune" "compilers". Builds run in parallel. The fastest candidate that is
+ * significantly faster than the current profile is saved to Flotsam.json as
+ * the TUNE_PROFILE profile and made the default. Results of every candidate
+ * are written to TUNE_RESULTS.
+ */
+int
+tune_run(const struct profile *current);
+
+#endif /* _TUNE_H */
@@ -0,0 +1,466 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#include <time.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "util.h"
+
+#define STRBUF_MIN_CAP 64
+#define COPY_BUF_SIZE  65536
+#define FNV_PRIME      0x100000001b3ULL
+
+/**
+ * strbuf_grow makes sure there's room for at least n
+ * more bytes plus the terminating NUL.
+ */
+static int
+strbuf_grow(struct strbuf *sb, size_t n)
+{
+    if (sb->len + n + 1 <= sb->cap) {
+        return 0;
+    }
+
+    size_t cap = sb->cap ? sb->cap : STRBUF_MIN_CAP;
+    while (cap < sb->len + n + 1) {
+        cap *= 2;
+    }
+
+    char *buf = realloc(sb->buf, cap);
+    if (buf == NULL) {
+        perror("unable to allocate memory for string");
+        return -1;
+    }
+    sb->buf = buf;
+    sb->cap = cap;
+
+    return 0;
+}
+
+int
+strbuf_append(struct strbuf *sb, const char *s)
+{
+    size_t n = strlen(s);
+    if (strbuf_grow(sb, n) != 0) {
+        return -1;
+    }
+    memcpy(sb->buf + sb->len, s, n + 1);
+    sb->len += n;
+
+    return 0;
+}
+
+int
+strbuf_appendf(struct strbuf *sb, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return -1;
+    }
+
+    if (strbuf_grow(sb, (size_t)n) != 0) {
+        return -1;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(sb->buf + sb->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    sb->len += (size_t)n;
+
+    return 0;
+}
+
+void
+strbuf_free(struct strbuf *sb)
+{
+    free(sb->buf);
+    sb->buf = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+}
+
+int
+mkdir_p(const char *path, mode_t mode)
+{
+    char tmp[PATH_MAX];
+    if (strlen(path) >= sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(tmp, path);
+
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (mkdir(tmp, mode) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        *p = '/';
+    }
+    if (mkdir(tmp, mode) != 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+remove_tree(const char *path)
+{
+    struct stat s;
+    if (lstat(path, &s) != 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (!S_ISDIR(s.st_mode)) {
+        return unlink(path);
+    }
+
+    DIR *dp = opendir(path);
+    if (dp == NULL) {
+        return -1;
+    }
+
+    int res = 0;
+    struct dirent *dirp;
+    while (res == 0 && (dirp = readdir(dp)) != NULL) {
+        if (strcmp(dirp->d_name, ".") == 0 || strcmp(dirp->d_name, "..") == 0) {
+            continue;
+        }
+        char child[PATH_MAX];
+        snprintf(child, PATH_MAX, "%s/%s", path, dirp->d_name);
+        res = remove_tree(child);
+    }
+    closedir(dp);
+
+    return res == 0 ? rmdir(path) : res;
+}
+
+int
+copy_tree(const char *src, const char *dst, const char *skip[], size_t skip_count)
+{
+    if (mkdir_p(dst, 0700) != 0) {
+        perror(dst);
+        return -1;
+    }
+
+    DIR *dp = opendir(src);
+    if (dp == NULL) {
+        perror(src);
+        return -1;
+    }
+
+    int res = 0;
+    struct dirent *dirp;
+    while (res == 0 && (dirp = readdir(dp)) != NULL) {
+        int ignore = strcmp(dirp->d_name, ".") == 0 || strcmp(dirp->d_name, "..") == 0;
+        for (size_t i = 0; i < skip_count; i++) {
+            ignore |= strcmp(dirp->d_name, skip[i]) == 0;
+        }
+        if (ignore) {
+            continue;
+        }
+
+        char from[PATH_MAX], to[PATH_MAX];
+        snprintf(from, PATH_MAX, "%s/%s", src, dirp->d_name);
+        snprintf(to, PATH_MAX, "%s/%s", dst, dirp->d_name);
+
+        struct stat s;
+        if (lstat(from, &s) != 0) {
+            continue;
+        }
+        if (S_ISDIR(s.st_mode)) {
+            res = copy_tree(from, to, skip, skip_count);
+        } else if (S_ISREG(s.st_mode)) {
+            res = copy_file(from, to);
+        } else if (S_ISLNK(s.st_mode)) {
+            char target[PATH_MAX];
+            ssize_t n = readlink(from, target, sizeof(target) - 1);
+            if (n < 0) {
+                continue;
+            }
+            target[n] = '\0';
+            unlink(to);
+            res = symlink(target, to);
+        }
+    }
+    closedir(dp);
+
+    return res;
+}
+
+int
+copy_file(const char *src, const char *dst)
+{
+    struct stat s;
+    if (stat(src, &s) != 0) {
+        return -1;
+    }
+
+    int in = open(src, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+
+    unlink(dst);
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, s.st_mode & 0777);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    char buf[COPY_BUF_SIZE];
+    ssize_t n;
+    int res = 0;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, (size_t)n) != n) {
+            res = -1;
+            break;
+        }
+    }
+    if (n < 0) {
+        res = -1;
+    }
+
+    close(in);
+    if (close(out) != 0) {
+        res = -1;
+    }
+
+    return res;
+}
+
+int
+write_file_if_changed(const char *path, const char *contents)
+{
+    size_t len = 0;
+    char *prev = read_file(path, &len);
+    if (prev != NULL && strcmp(prev, contents) == 0) {
+        free(prev);
+        return 0;
+    }
+    free(prev);
+
+    FILE *fd = fopen(path, "w");
+    if (fd == NULL) {
+        perror(path);
+        return -1;
+    }
+    fputs(contents, fd);
+
+    return fclose(fd) == 0 ? 0 : -1;
+}
+
+/**
+ * reflink clones src to dst sharing the underlying
+ * extents. It only succeeds on filesystems with copy on
+ * write support such as btrfs and xfs.
+ */
+static int
+reflink(const char *src, const char *dst)
+{
+#if defined(__linux__) && defined(FICLONE)
+    struct stat s;
+    if (stat(src, &s) != 0) {
+        return -1;
+    }
+
+    int in = open(src, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, s.st_mode & 0777);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+
+    int res = ioctl(out, FICLONE, in);
+    close(in);
+    close(out);
+    if (res != 0) {
+        unlink(dst);
+    }
+
+    return res;
+#else
+    (void)src;
+    (void)dst;
+    return -1;
+#endif
+}
+
+int
+link_file(const char *src, const char *dst)
+{
+    struct stat ss, ds;
+
+    // already installed
+    if (stat(src, &ss) == 0 && stat(dst, &ds) == 0 &&
+        ss.st_dev == ds.st_dev && ss.st_ino == ds.st_ino) {
+        return 0;
+    }
+
+    unlink(dst);
+    if (link(src, dst) == 0) {
+        return 0;
+    }
+    if (reflink(src, dst) == 0) {
+        return 0;
+    }
+
+    return copy_file(src, dst);
+}
+
+char*
+read_file(const char *path, size_t *len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat s;
+    if (fstat(fd, &s) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char *buf = malloc(s.st_size + 1);
+    if (buf == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    ssize_t n = read(fd, buf, s.st_size);
+    close(fd);
+    if (n != s.st_size) {
+        free(buf);
+        return NULL;
+    }
+    buf[n] = '\0';
+    *len = (size_t)n;
+
+    return buf;
+}
+
+void
+self_path(char *path, size_t len)
+{
+#ifdef __linux__
+    ssize_t n = readlink("/proc/self/exe", path, len - 1);
+    if (n > 0) {
+        path[n] = '\0';
+        return;
+    }
+#endif
+    snprintf(path, len, "%s", "flotsam");
+}
+
+uint64_t
+now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int
+run_timed(char *const argv[], uint64_t *ns)
+{
+    uint64_t start = now_ns();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        if (null >= 0) {
+            dup2(null, STDIN_FILENO);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+    *ns = now_ns() - start;
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+uint64_t
+hash_bytes(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+uint64_t
+hash_str(uint64_t h, const char *s)
+{
+    if (s == NULL) {
+        return h;
+    }
+    // include the terminator so "ab","c" and "a","bc" differ
+    return hash_bytes(h, s, strlen(s) + 1);
+}
@@ -0,0 +1,155 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _UTIL_H
+#define _UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * strbuf is a growable, always NUL terminated string
+ * used to assemble command lines and paths.
+ */
+struct strbuf
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+/**
+ * strbuf_append appends the given string to the buffer.
+ */
+int
+strbuf_append(struct strbuf *sb, const char *s);
+
+/**
+ * strbuf_appendf appends the printf style formatted string
+ * to the buffer.
+ */
+int
+strbuf_appendf(struct strbuf *sb, const char *fmt, ...);
+
+/**
+ * strbuf_free frees the memory held by the buffer and
+ * resets it for reuse.
+ */
+void
+strbuf_free(struct strbuf *sb);
+
+/**
+ * mkdir_p creates the given directory and all of its
+ * missing parents.
+ */
+int
+mkdir_p(const char *path, mode_t mode);
+
+/**
+ * remove_tree removes the given path and everything below it.
+ */
+int
+remove_tree(const char *path);
+
+/**
+ * copy_file copies the contents and mode of src to dst,
+ * replacing dst if it exists.
+ */
+int
+copy_file(const char *src, const char *dst);
+
+/**
+ * copy_tree copies the directory src to dst, leaving out entries named in
+ * skip. Files are copied rather than linked so builds in dst don't change
+ * src.
+ */
+int
+copy_tree(const char *src, const char *dst, const char *skip[], size_t skip_count);
+
+/**
+ * read_file returns the NUL terminated contents of the given file and stores
+ * its length in len. NULL is returned if it can't be read. The returned
+ * string needs to be freed by the caller.
+ */
+char*
+read_file(const char *path, size_t *len);
+
+/**
+ * write_file_if_changed writes the given contents to path unless the file
+ * already holds exactly that, leaving its mtime alone for tools like make
+ * that key off of it.
+ */
+int
+write_file_if_changed(const char *path, const char *contents);
+
+/**
+ * link_file makes dst refer to the contents of src as cheaply as possible,
+ * replacing dst if it exists. A hard link is tried first, then a reflink
+ * where the filesystem supports them and finally a plain copy.
+ */
+int
+link_file(const char *src, const char *dst);
+
+/**
+ * run_timed runs the given command with its output discarded and stores the
+ * wall clock time it took in nanoseconds. It returns the command's exit
+ * status or -1 if it couldn't be started.
+ */
+int
+run_timed(char *const argv[], uint64_t *ns);
+
+/**
+ * self_path stores the path of the running flotsam binary in path, falling
+ * back to looking it up in $PATH.
+ */
+void
+self_path(char *path, size_t len);
+
+/**
+ * now_ns returns the current monotonic time in nanoseconds.
+ */
+uint64_t
+now_ns();
+
+/**
+ * hash_str returns the 64 bit FNV-1a hash of the given
+ * string continuing from the given seed. Use HASH_SEED
+ * to start a new hash.
+ */
+#define HASH_SEED 0xcbf29ce484222325ULL
+
+uint64_t
+hash_str(uint64_t h, const char *s);
+
+/**
+ * hash_bytes is hash_str for arbitrary memory.
+ */
+uint64_t
+hash_bytes(uint64_t h, const void *data, size_t len);
+
+#endif /* _UTIL_H */
@@ -0,0 +1,346 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2025 Brian J. Downs, John K. Moore
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#else
+#include <sys/syslimits.h>
+#endif
+#include <unistd.h>
+
+#include "build.h"
+#include "config.h"
+#include "dependency.h"
+#include "util.h"
+#include "watch.h"
+
+#define DEBOUNCE_MS    100
+#define CONFIG_FILE    "Flotsam.json"
+#define WATCH_MASK     (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+// skip_dirs are project directories holding build output
+// or generated files which don't need watching.
+static const char *skip_dirs[] = { "bin", "build", "deps" };
+
+// watch_exts are the files whose changes cause a rebuild.
+static const char *watch_exts[] = { ".c", ".h", ".mk" };
+
+/**
+ * action_run builds the project or runs its tests.
+ */
+static int
+action_run(enum watch_action action, const struct profile *profile, uint64_t key)
+{
+    uint64_t start = now_ns();
+    int res;
+
+    if (action == WATCH_TEST) {
+        struct strbuf cmd = { 0 };
+        strbuf_appendf(&cmd, "%s test", config_get_build());
+        res = system(cmd.buf) == 0 ? 0 : 1;
+        strbuf_free(&cmd);
+    } else {
+        res = build_recorded(profile, key);
+    }
+
+    printf("[flotsam] %s %s in %.0f ms, watching for changes\n",
+           action == WATCH_TEST ? "tests" : "build", res == 0 ? "finished" : "failed",
+           (double)(now_ns() - start) / 1e6);
+    fflush(stdout);
+
+    return res;
+}
+
+/**
+ * load_config reloads Flotsam.json and selects the profile
+ * given on the command line. An invalid config leaves the
+ * previous one and its profile in place.
+ */
+static int
+load_config(const char *profile_name, struct profile **profile)
+{
+    if (config_reload(profile_name) != 0) {
+        return -1;
+    }
+    *profile = config_get_profile();
+
+    return 0;
+}
+
+#ifdef __linux__
+
+// watch_paths maps watch descriptors to the directory
+// they watch.
+static char **watch_paths;
+static int watch_path_count;
+static int root_wd = -1;
+
+/**
+ * is_watched_file returns 1 if a change to the file
+ * should trigger a rebuild. Files flotsam writes itself
+ * are ignored so a rebuild can't trigger another.
+ */
+static int
+is_watched_file(const char *name)
+{
+    if (name[0] == '.' || strcmp(name, "flotsam.mk") == 0) {
+        return 0;
+    }
+    if (strcmp(name, "Makefile") == 0 || strcmp(name, CONFIG_FILE) == 0) {
+        return 1;
+    }
+
+    size_t len = strlen(name);
+    for (size_t i = 0; i < sizeof(watch_exts) / sizeof(watch_exts[0]); i++) {
+        size_t ext_len = strlen(watch_exts[i]);
+        if (len > ext_len && strcmp(name + len - ext_len, watch_exts[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * add_watch watches a single directory.
+ */
+static int
+add_watch(int fd, const char *path)
+{
+    int wd = inotify_add_watch(fd, path, WATCH_MASK);
+    if (wd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    if (wd >= watch_path_count) {
+        char **paths = realloc(watch_paths, (wd + 1) * sizeof(char*));
+        if (paths == NULL) {
+            perror("unable to allocate memory for watches");
+            return -1;
+        }
+        memset(paths + watch_path_count, 0, (wd + 1 - watch_path_count) * sizeof(char*));
+        watch_paths = paths;
+        watch_path_count = wd + 1;
+    }
+    free(watch_paths[wd]);
+    watch_paths[wd] = strdup(path);
+
+    return wd;
+}
+
+/**
+ * add_tree watches the given directory and everything
+ * below it returning the watch descriptor of the top.
+ * Hidden directories are skipped as are the project's
+ * output directories when is_project is set.
+ */
+static int
+add_tree(int fd, const char *path, int is_project)
+{
+    int wd = add_watch(fd, path);
+    if (wd < 0) {
+        return -1;
+    }
+
+    DIR *dp = opendir(path);
+    if (dp == NULL) {
+        return -1;
+    }
+
+    struct dirent *dirp;
+    while ((dirp = readdir(dp)) != NULL) {
+        if (dirp->d_name[0] == '.') {
+            continue;
+        }
+
+        int skip = 0;
+        for (size_t i = 0; is_project && strcmp(path, ".") == 0 &&
+                           i < sizeof(skip_dirs) / sizeof(skip_dirs[0]); i++) {
+            skip |= strcmp(dirp->d_name, skip_dirs[i]) == 0;
+        }
+        if (skip) {
+            continue;
+        }
+
+        char child[PATH_MAX];
+        if (snprintf(child, PATH_MAX, "%s/%s", path, dirp->d_name) >= PATH_MAX) {
+            continue;
+        }
+
+        struct stat s;
+        if (lstat(child, &s) == 0 && S_ISDIR(s.st_mode)) {
+            add_tree(fd, child, is_project);
+        }
+    }
+    closedir(dp);
+
+    return wd;
+}
+
+/**
+ * add_dependencies watches the checkouts of every
+ * dependency for header changes.
+ */
+static void
+add_dependencies(int fd)
+{
+    struct dependencies *deps = config_get_dependencies();
+
+    for (int i = 0; i < deps->count; i++) {
+        char *path = dependency_path(deps->dependencies[i].name, deps->dependencies[i].vers);
+        struct stat s;
+        if (stat(path, &s) == 0) {
+            add_tree(fd, path, 0);
+        }
+        free(path);
+    }
+}
+
+/**
+ * drain reads all pending events and records whether any
+ * watched file or the config changed. New directories
+ * are watched as they appear.
+ */
+static void
+drain(int fd, int *changed, int *config_changed)
+{
+    char buf[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t len = read(fd, buf, sizeof(buf));
+    for (char *p = buf; len > 0 && p < buf + len;) {
+        struct inotify_event *ev = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + ev->len;
+
+        if (ev->len == 0 || ev->wd < 0 || ev->wd >= watch_path_count || watch_paths[ev->wd] == NULL) {
+            continue;
+        }
+
+        if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->name[0] != '.') {
+            char child[PATH_MAX];
+            snprintf(child, PATH_MAX, "%s/%s", watch_paths[ev->wd], ev->name);
+            add_tree(fd, child, strncmp(child, "./", 2) == 0);
+            *changed = 1;
+            continue;
+        }
+
+        if (!is_watched_file(ev->name)) {
+            continue;
+        }
+        *changed = 1;
+        if (ev->wd == root_wd && strcmp(ev->name, CONFIG_FILE) == 0) {
+            *config_changed = 1;
+        }
+    }
+}
+
+int
+watch_run(enum watch_action action, const char *profile_name, uint64_t key)
+{
+    struct profile *profile = config_get_profile();
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        perror("inotify_init1");
+        return 1;
+    }
+
+    root_wd = add_tree(fd, ".", 1);
+    if (root_wd < 0) {
+        close(fd);
+        return 1;
+    }
+    add_dependencies(fd);
+
+    action_run(action, profile, key);
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    for (;;) {
+        int changed = 0;
+        int config_changed = 0;
+
+        if (poll(&pfd, 1, -1) < 0) {
+            perror("poll");
+            break;
+        }
+        drain(fd, &changed, &config_changed);
+
+        // wait for the burst to settle, editors often write
+        // several files or the same file several times
+        while (poll(&pfd, 1, DEBOUNCE_MS) > 0) {
+            drain(fd, &changed, &config_changed);
+        }
+        if (!changed) {
+            continue;
+        }
+
+        if (config_changed) {
+            if (load_config(profile_name, &profile) != 0) {
+                fprintf(stderr, "[flotsam] keeping the previous config, watching for changes\n");
+                continue;
+            }
+            if (build_update(profile, 1) != 0) {
+                fprintf(stderr, "[flotsam] dependency update failed, watching for changes\n");
+                continue;
+            }
+            add_dependencies(fd);
+        }
+
+        action_run(action, profile, key);
+    }
+
+    close(fd);
+
+    return 1;
+}
+
+#else
+
+int
+watch_run(enum watch_action action, const char *profile_name, uint64_t key)
+{
+    (void)action;
+    (void)profile_name;
+    (void)key;
+    (void)action_run;
+    (void)load_config;
+
+    fprintf(stderr, "error: watch mode requires inotify which is only available on Linux\n");
+
+    return 1;
+}
+
+#endif